@@ -0,0 +1,329 @@
+#include "allocation_tracker.h"
+
+#include "imgui.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+namespace {
+
+constexpr int TagCount = (int)AllocationTag::Count;
+
+struct TagCounters
+{
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<int64_t> live_bytes{ 0 };
+    std::atomic<int64_t> peak_live_bytes{ 0 };
+};
+
+// Constant initialized, allocations made before main are counted too
+TagCounters g_Tags[TagCount];
+std::atomic<uint64_t> g_StepCount{ 0 };
+std::atomic<uint64_t> g_StepAllocationCount{ 0 };
+std::atomic<uint64_t> g_StepBytes{ 0 };
+std::atomic<uint64_t> g_StepMaxAllocationCount{ 0 };
+
+thread_local AllocationTag t_Tag = AllocationTag::Other;
+thread_local uint64_t t_AllocationCount = 0;
+thread_local uint64_t t_AllocatedBytes = 0;
+
+template <class T>
+void store_max(std::atomic<T>& max, T value)
+{
+    T current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+#ifdef FCSIM_ALLOCATION_TRACKING
+
+// Size and tag of the block, kept in front of it so that a free is charged to the tag which allocated
+struct alignas(16) BlockHeader
+{
+    size_t size;
+    AllocationTag tag;
+};
+
+void* allocate(size_t size)
+{
+    BlockHeader* header = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+    if (!header) {
+        return nullptr;
+    }
+    header->size = size;
+    header->tag = t_Tag;
+
+    TagCounters& c = g_Tags[(int)header->tag];
+    c.count.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(size, std::memory_order_relaxed);
+    const int64_t live = c.live_bytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+    store_max(c.peak_live_bytes, live);
+    t_AllocationCount += 1;
+    t_AllocatedBytes += size;
+    return header + 1;
+}
+
+void deallocate(void* p)
+{
+    if (!p) {
+        return;
+    }
+    BlockHeader* header = static_cast<BlockHeader*>(p) - 1;
+    g_Tags[(int)header->tag].live_bytes.fetch_sub((int64_t)header->size, std::memory_order_relaxed);
+    free(header);
+}
+
+#endif
+
+}
+
+#ifdef FCSIM_ALLOCATION_TRACKING
+
+void* operator new(size_t size)
+{
+    if (void* p = allocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (void* p = allocate(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    deallocate(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    deallocate(p);
+}
+
+#endif
+
+const char* allocation_tag_name(AllocationTag tag)
+{
+    switch (tag) {
+    case AllocationTag::Other: return "Other";
+    case AllocationTag::Simulation: return "Simulation";
+    case AllocationTag::Timeline: return "Timeline";
+    case AllocationTag::Drawing: return "Drawing";
+    case AllocationTag::Ui: return "UI";
+    case AllocationTag::Count: break;
+    }
+    return "";
+}
+
+AllocationStats AllocationSnapshot::total() const
+{
+    AllocationStats total;
+    for (const AllocationStats& t : tags) {
+        total.count += t.count;
+        total.bytes += t.bytes;
+        total.live_bytes += t.live_bytes;
+        // Tags do not peak at the same time, the sum is an upper bound
+        total.peak_live_bytes += t.peak_live_bytes;
+    }
+    return total;
+}
+
+AllocationScope::AllocationScope(AllocationTag tag)
+    : m_previous(t_Tag)
+{
+    t_Tag = tag;
+}
+
+AllocationScope::~AllocationScope()
+{
+    t_Tag = m_previous;
+}
+
+AllocationStepScope::AllocationStepScope()
+    : m_scope(AllocationTag::Simulation)
+    , m_count(t_AllocationCount)
+    , m_bytes(t_AllocatedBytes)
+{
+}
+
+AllocationStepScope::~AllocationStepScope()
+{
+    const uint64_t count = t_AllocationCount - m_count;
+    g_StepCount.fetch_add(1, std::memory_order_relaxed);
+    g_StepAllocationCount.fetch_add(count, std::memory_order_relaxed);
+    g_StepBytes.fetch_add(t_AllocatedBytes - m_bytes, std::memory_order_relaxed);
+    store_max(g_StepMaxAllocationCount, count);
+}
+
+namespace allocation_tracker {
+
+bool is_enabled()
+{
+#ifdef FCSIM_ALLOCATION_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+AllocationSnapshot snapshot()
+{
+    AllocationSnapshot s;
+    for (int i = 0; i < TagCount; i++) {
+        s.tags[i].count = g_Tags[i].count.load(std::memory_order_relaxed);
+        s.tags[i].bytes = g_Tags[i].bytes.load(std::memory_order_relaxed);
+        s.tags[i].live_bytes = g_Tags[i].live_bytes.load(std::memory_order_relaxed);
+        s.tags[i].peak_live_bytes = g_Tags[i].peak_live_bytes.load(std::memory_order_relaxed);
+    }
+    s.step_count = g_StepCount.load(std::memory_order_relaxed);
+    s.step_allocation_count = g_StepAllocationCount.load(std::memory_order_relaxed);
+    s.step_bytes = g_StepBytes.load(std::memory_order_relaxed);
+    s.step_max_allocation_count = g_StepMaxAllocationCount.load(std::memory_order_relaxed);
+    return s;
+}
+
+void reset_peaks()
+{
+    for (TagCounters& t : g_Tags) {
+        t.peak_live_bytes.store(t.live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    g_StepMaxAllocationCount.store(0, std::memory_order_relaxed);
+}
+
+uint64_t thread_allocation_count()
+{
+    return t_AllocationCount;
+}
+
+uint64_t thread_allocated_bytes()
+{
+    return t_AllocatedBytes;
+}
+
+}
+
+void draw_allocations(AllocationView& view)
+{
+    ImGui::SetNextWindowSize(ImVec2(700, 250), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Allocations");
+
+    if (!allocation_tracker::is_enabled()) {
+        ImGui::TextUnformatted("Built without FCSIM_ALLOCATION_TRACKING");
+        ImGui::End();
+        return;
+    }
+
+    // The frame which just ended is the difference with the snapshot of the previous one
+    const AllocationSnapshot current = allocation_tracker::snapshot();
+    allocation_tracker::reset_peaks();
+    if (view.has_previous) {
+        FrameAllocations frame;
+        for (int i = 0; i < TagCount; i++) {
+            frame.tags[i].count = current.tags[i].count - view.previous.tags[i].count;
+            frame.tags[i].bytes = current.tags[i].bytes - view.previous.tags[i].bytes;
+            frame.tags[i].live_bytes = current.tags[i].live_bytes;
+            frame.tags[i].peak_live_bytes = current.tags[i].peak_live_bytes;
+        }
+        frame.step_count = current.step_count - view.previous.step_count;
+        frame.step_allocation_count = current.step_allocation_count - view.previous.step_allocation_count;
+        frame.step_bytes = current.step_bytes - view.previous.step_bytes;
+        frame.step_max_allocation_count = current.step_max_allocation_count;
+        view.frames.push_back(frame);
+    }
+    view.previous = current;
+    view.has_previous = true;
+
+    ImGui::SliderInt("Averaged Frames", &view.frame_count, 1, 600);
+    const size_t frame_count = (size_t)std::max(1, view.frame_count);
+    if (view.frames.size() > frame_count) {
+        view.frames.erase(view.frames.begin(), view.frames.end() - frame_count);
+    }
+    const float n = (float)std::max<size_t>(1, view.frames.size());
+
+    ImGui::Columns(5, "allocations");
+    for (const char* header : { "Tag", "Allocs / frame", "KB / frame", "Live KB", "Peak live KB" }) {
+        ImGui::Text("%s", header);
+        ImGui::NextColumn();
+    }
+    ImGui::Separator();
+    for (int i = 0; i < TagCount; i++) {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+        int64_t peak = 0;
+        for (const FrameAllocations& f : view.frames) {
+            count += f.tags[i].count;
+            bytes += f.tags[i].bytes;
+            peak = std::max(peak, f.tags[i].peak_live_bytes);
+        }
+        ImGui::Text("%s", allocation_tag_name((AllocationTag)i));
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", count / n);
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", bytes / n / 1024.f);
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", current.tags[i].live_bytes / 1024.f);
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", peak / 1024.f);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    uint64_t steps = 0;
+    uint64_t step_count = 0;
+    uint64_t step_bytes = 0;
+    uint64_t step_max = 0;
+    for (const FrameAllocations& f : view.frames) {
+        steps += f.step_count;
+        step_count += f.step_allocation_count;
+        step_bytes += f.step_bytes;
+        step_max = std::max(step_max, f.step_max_allocation_count);
+    }
+    ImGui::Separator();
+    if (steps > 0) {
+        ImGui::Text("%.1f steps / frame: %.2f allocs / step, %.0f bytes / step, at most %llu allocs in a step",
+            steps / n, (float)step_count / steps, (float)step_bytes / steps, (unsigned long long)step_max);
+    } else {
+        ImGui::Text("No simulation step in the last frames");
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Heap allocations counted per subsystem. With FCSIM_ALLOCATION_TRACKING defined the
+// global operator new and delete are replaced, every allocation is charged to the tag
+// of the innermost AllocationScope of its thread and its free to the same tag.
+// Without it the scopes still compile and every counter stays at zero.
+//
+//     void Simulator::draw()
+//     {
+//         AllocationScope allocations(AllocationTag::Drawing);
+//         ...
+
+enum class AllocationTag : uint8_t
+{
+    Other,
+    Simulation,
+    Timeline,
+    Drawing,
+    Ui,
+    Count,
+};
+
+const char* allocation_tag_name(AllocationTag tag);
+
+struct AllocationStats
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    int64_t live_bytes = 0;
+    // Highest live bytes since the last reset_peaks
+    int64_t peak_live_bytes = 0;
+};
+
+struct AllocationSnapshot
+{
+    AllocationStats tags[(int)AllocationTag::Count];
+    // Steps of any simulator, and what they allocated
+    uint64_t step_count = 0;
+    uint64_t step_allocation_count = 0;
+    uint64_t step_bytes = 0;
+    uint64_t step_max_allocation_count = 0;
+
+    AllocationStats total() const;
+};
+
+class AllocationScope
+{
+public:
+    explicit AllocationScope(AllocationTag tag);
+    ~AllocationScope();
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    AllocationTag m_previous;
+};
+
+// A simulation step: tags its allocations as Simulation and counts them per step
+class AllocationStepScope
+{
+public:
+    AllocationStepScope();
+    ~AllocationStepScope();
+
+    AllocationStepScope(const AllocationStepScope&) = delete;
+    AllocationStepScope& operator=(const AllocationStepScope&) = delete;
+
+private:
+    AllocationScope m_scope;
+    uint64_t m_count;
+    uint64_t m_bytes;
+};
+
+namespace allocation_tracker {
+
+// True when the allocator hook is compiled in
+bool is_enabled();
+
+// Counts and bytes are totals since the start, live bytes are current
+AllocationSnapshot snapshot();
+void reset_peaks();
+
+// Allocations made by the calling thread
+uint64_t thread_allocation_count();
+uint64_t thread_allocated_bytes();
+
+}
+
+// Counts of one UI frame, differences of two snapshots
+struct FrameAllocations
+{
+    AllocationStats tags[(int)AllocationTag::Count];
+    uint64_t step_count = 0;
+    uint64_t step_allocation_count = 0;
+    uint64_t step_bytes = 0;
+    uint64_t step_max_allocation_count = 0;
+};
+
+struct AllocationView
+{
+    int frame_count = 60;
+    bool has_previous = false;
+    AllocationSnapshot previous;
+    // The last frames, the oldest first
+    std::vector<FrameAllocations> frames;
+};
+
+// Averages per frame and per step over the last frames, called once per UI frame
+void draw_allocations(AllocationView& view);
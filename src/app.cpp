@@ -0,0 +1,153 @@
+#include "app.h"
+
+#include <string.h>
+
+#include "NodeEditor.h"
+#include "flow_script.h"
+
+namespace ed = ax::NodeEditor;
+
+App* App::s_App;
+
+std::shared_ptr<JobType> create_job_type(const char* name, float duration,
+    bool is_first, bool generate_next, bool release_frame)
+{
+    auto j = std::make_shared<JobType>();
+    j->duration = duration;
+    j->is_first = is_first;
+    j->generate_next = generate_next;
+    j->release_frame = release_frame;
+    strncpy(j->name, name, 250);
+
+    return j;
+}
+
+void App::init()
+{
+    s_App = new App();
+    s_App->NodeEditorContext = ax::NodeEditor::CreateEditor();
+    ed::SetCurrentEditor(s_App->NodeEditorContext);
+
+    App::set_preset(get_default_preset());
+
+    s_App->Flows = create_builtin_flows();
+    s_App->Flow = s_App->Flows[0];
+}
+
+std::vector<std::shared_ptr<FrameFlow>> create_builtin_flows()
+{
+    std::vector<std::shared_ptr<FrameFlow>> flows;
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Default");
+
+        flows.push_back(flow);
+    }
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Simple Frame");
+        flow->stages.clear();
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 1, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 1, false, 1));
+        flow->start_next_frame_stage = flow->stages.size() - 1;
+
+        flows.push_back(flow);
+    }
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Jobification");
+        flow->stages.clear();
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 4, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 4, false, 1));
+        flow->start_next_frame_stage = flow->stages.size() - 1;
+
+        flows.push_back(flow);
+    }
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Interleave stages");
+        flow->stages.clear();
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 1, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 1, false, 1));
+        flow->start_next_frame_stage = 0;
+
+        flows.push_back(flow);
+    }
+
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Realistic Jobification");
+        flow->stages.clear();
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game1", 0, 1.f, 5, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game2", 0, 1.f, 3, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game3", 0, 1.f, 6, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render1", 1, 1.f, 8, false, 1));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render2", 1, 1.f, 4, false, 1));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render3", 1, 1.f, 6, false, 1));
+        flow->start_next_frame_stage = flow->stages.size() - 1;
+
+        flows.push_back(flow);
+    }
+
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Realistic Jobification - Interleaved");
+        flow->stages.clear();
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game1", 0, 1.f, 5, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game2", 0, 1.f, 3, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game3", 0, 1.f, 6, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render1", 1, 1.f, 8, true, 1));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render2", 1, 1.f, 4, true, 1));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render3", 1, 1.f, 6, true, 1));
+        flow->start_next_frame_stage = 2;
+
+        flows.push_back(flow);
+    }
+
+    {
+        auto flow = std::make_shared<FrameFlow>("Realistic Jobification - Gpu");
+        flow->stages.clear();
+        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 4, false, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 4, false, 1));
+        flow->stages.push_back(std::make_shared<FrameStage>("Kick", 1, 0.2f, 1, false, 1));
+        flow->stages.push_back(std::make_shared<FrameStage>("Render", 2, 1.f, 1, false, 2, true, 0));
+        flow->stages.push_back(std::make_shared<FrameStage>("Async Compute", 2, 0.5f, 1, false, 2, true, 1));
+        flow->start_next_frame_stage = 1;
+
+        flows.push_back(flow);
+    }
+
+    {
+        // Same frame as "Realistic Jobification - Interleaved", with a render stage per shadow cascade
+        const int shadow_cascades = 2;
+        FlowScript script("Scripted Jobification");
+        script.group("Game");
+        script.stage("Simulate Game1").parallel_for(5);
+        script.stage("Simulate Game2").parallel_for(3);
+        script.stage("Simulate Game3").parallel_for(6).next_frame_slot();
+        script.group("Render");
+        script.stage("Prepare Render").parallel_for(8).previous_frame("Render");
+        for (int i = 0; i < shadow_cascades; i++) {
+            script.stage("Shadow Cascade" + std::to_string(i), 0.5f).parallel_for(4).previous_frame("Render");
+        }
+        script.stage("Submit Render").parallel_for(6).previous_frame("Render");
+
+        flows.push_back(script.build());
+    }
+
+    return flows;
+}
+
+void App::set_preset(const Preset& p)
+{
+    s_App->Pattern = p.pattern();
+    if (!s_App->OnlyFramePattern)
+    {
+        s_App->SimOption = p.option();
+    }
+    s_App->SimOption.Name = p.name();
+}
+
+App& App::get() {
+    return *s_App;
+}
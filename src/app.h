@@ -1,10 +1,19 @@
 #pragma once
 
+#include <map>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "node_editor.h"
 #include "visualizer.h"
+#include "ensemble.h"
+#include "executor.h"
+#include "calibration.h"
+#include "golden_trace.h"
+#include "profiler.h"
+#include "allocation_tracker.h"
+#include "trace_file.h"
+#include "frame_diff.h"
 
 
 #include "NodeEditor.h"
@@ -22,6 +31,21 @@ struct App
     SimulationOption SimOption;
     ControlOption ControlOption;
     DisplayOption DisplayOption;
+    EnsembleOption EnsembleOption;
+    ExecutionOption ExecutionOption;
+    CalibrationOption CalibrationOption;
+    CaptureImport CaptureImport;
+    TraceFiles TraceFiles;
+    FrameDiffView FrameDiff;
+    GoldenTraceView GoldenTraces;
+    ProfilerView Profiler;
+    AllocationView Allocations;
+
+    std::shared_ptr<EnsembleReport> Ensemble;
+    std::future<EnsembleReport> EnsembleRun;
+    std::shared_ptr<ExecutionReport> Execution;
+    std::map<WaitMode, std::shared_ptr<ExecutionReport>> ExecutionByWait;
+    std::shared_ptr<CalibrationReport> Calibration;
 
     ax::NodeEditor::EditorContext* NodeEditorContext = nullptr;
 
@@ -29,6 +53,7 @@ struct App
     int SelectedPreset = 0;
 
     std::shared_ptr<Simulator> CurrentSimulation;
+    std::shared_ptr<Simulator> PacingBaseline;
 
     std::unordered_set<std::shared_ptr<Simulator>> FrozenSimulations;
 
@@ -36,6 +61,7 @@ struct App
 
     static void init();
     static App& get();
+    static bool is_initialized() { return s_App != nullptr; }
 private:
     App() = default;
 
@@ -44,3 +70,6 @@ private:
 
 std::shared_ptr<JobType> create_job_type(const char* name, float duration,
     bool is_first = false, bool generate_next = false, bool release_frame = false);
+
+// The flows listed by the application, the library builds its own without the app
+std::vector<std::shared_ptr<FrameFlow>> create_builtin_flows();
@@ -0,0 +1,527 @@
+// Microbenchmarks of the simulation hot paths, without a window.
+//
+//     fcsim-bench [--filter text] [--out fcsim-bench.json] [--baseline previous.json]
+//
+// Every benchmark runs batches of doubling size until a batch lasts MinBatchMs, like
+// Google Benchmark. With a baseline the exit code is 1 when a benchmark got slower
+// than RegressionRatio. Allocations are counted per op and per AllocationTag by the
+// allocation tracker, which this target always compiles in.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "imgui.h"
+#include "allocation_tracker.h"
+#include "app.h"
+#include "job_system.h"
+#include "simulator.h"
+#include "visualizer.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double MinBatchMs = 200.0;
+// Wall time after which a batch which times only a part of its work stops
+constexpr double MaxBatchWallMs = 2000.0;
+constexpr int64_t MaxBatchCount = int64_t(1) << 24;
+constexpr double RegressionRatio = 1.2;
+// Steps of the timeline which is culled and drawn
+constexpr int DrawStepCount = 20000;
+
+struct BenchmarkResult
+{
+    std::string name;
+    // What one operation is: a step, a frame, a call
+    const char* unit;
+    int64_t count = 0;
+    double ns_per_op = 0.0;
+    double allocations_per_op = 0.0;
+    double bytes_per_op = 0.0;
+    double tag_allocations_per_op[(int)AllocationTag::Count] = {};
+};
+
+class Bench
+{
+public:
+    explicit Bench(const std::string& filter) : m_filter(filter) {}
+
+    // batch runs count operations, the setup it does is timed with them
+    void run(const std::string& name, const char* unit, const std::function<void(int64_t count)>& batch)
+    {
+        run_timed(name, unit, [&](int64_t count) {
+            auto start = Clock::now();
+            batch(count);
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        });
+    }
+
+    // batch runs count operations and returns the nanoseconds they took, without its setup
+    void run_timed(const std::string& name, const char* unit, const std::function<double(int64_t count)>& batch)
+    {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos) {
+            return;
+        }
+
+        BenchmarkResult result;
+        result.name = name;
+        result.unit = unit;
+        for (int64_t count = 1; count <= MaxBatchCount; count *= 2) {
+            const AllocationSnapshot before = allocation_tracker::snapshot();
+            auto start = Clock::now();
+            const double ns = batch(count);
+            const double wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            const AllocationSnapshot after = allocation_tracker::snapshot();
+
+            result.count = count;
+            result.ns_per_op = ns / count;
+            result.allocations_per_op = double(after.total().count - before.total().count) / count;
+            result.bytes_per_op = double(after.total().bytes - before.total().bytes) / count;
+            for (int i = 0; i < (int)AllocationTag::Count; i++) {
+                result.tag_allocations_per_op[i] = double(after.tags[i].count - before.tags[i].count) / count;
+            }
+            if (ns >= MinBatchMs * 1e6 || wall_ms >= MaxBatchWallMs) {
+                break;
+            }
+        }
+
+        printf("%-64s %12.1f ns/%-6s %14.0f %s/s %10.2f allocs/%s %10.0f bytes/%s\n", name.c_str(), result.ns_per_op, unit, 1e9 / result.ns_per_op, unit, result.allocations_per_op, unit, result.bytes_per_op, unit);
+        if (result.allocations_per_op > 0.0) {
+            printf("%-64s", "");
+            for (int i = 0; i < (int)AllocationTag::Count; i++) {
+                if (result.tag_allocations_per_op[i] > 0.0) {
+                    printf(" %s %.2f", allocation_tag_name((AllocationTag)i), result.tag_allocations_per_op[i]);
+                }
+            }
+            printf("\n");
+        }
+        m_results.push_back(result);
+    }
+
+    const std::vector<BenchmarkResult>& results() const { return m_results; }
+
+    // A benchmark whose operations lost or duplicated items, the exit code is then 1
+    void fail(const std::string& name)
+    {
+        printf("Inconsistent: %s lost or duplicated items\n", name.c_str());
+        m_failure_count += 1;
+    }
+    int failure_count() const { return m_failure_count; }
+
+private:
+    std::string m_filter;
+    std::vector<BenchmarkResult> m_results;
+    int m_failure_count = 0;
+};
+
+std::string escape_json(const std::string& text)
+{
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+// One benchmark per line so that a baseline is read back without a json parser
+std::string to_json(const std::vector<BenchmarkResult>& results)
+{
+    std::stringstream s;
+    s << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& r = results[i];
+        s << "    { \"name\": \"" << escape_json(r.name) << "\", \"unit\": \"" << r.unit << "\", \"count\": " << r.count
+          << ", \"ns_per_op\": " << r.ns_per_op << ", \"allocations_per_op\": " << r.allocations_per_op << ", \"bytes_per_op\": " << r.bytes_per_op;
+        for (int t = 0; t < (int)AllocationTag::Count; t++) {
+            s << ", \"" << allocation_tag_name((AllocationTag)t) << "_allocations_per_op\": " << r.tag_allocations_per_op[t];
+        }
+        s << " }" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    s << "  ]\n}\n";
+    return s.str();
+}
+
+std::map<std::string, double> read_baseline(const char* path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        const char* name = strstr(line.c_str(), "\"name\": \"");
+        const char* ns = strstr(line.c_str(), "\"ns_per_op\": ");
+        if (name && ns) {
+            name += strlen("\"name\": \"");
+            std::string key;
+            for (const char* c = name; *c && *c != '"'; c++) {
+                if (*c == '\\' && c[1]) {
+                    c++;
+                }
+                key += *c;
+            }
+            baseline[key] = atof(ns + strlen("\"ns_per_op\": "));
+        }
+    }
+    return baseline;
+}
+
+void init_headless_imgui()
+{
+    ImGui::CreateContext();
+    ImGuiIO& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(1920.f, 1080.f);
+    io.DeltaTime = 1.f / 60.f;
+    io.IniFilename = nullptr;
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+}
+
+// Draws into the window draw lists of one ImGui frame, nothing is rendered
+template <class Draw>
+size_t draw_headless(Draw&& draw)
+{
+    ImGui::NewFrame();
+    draw();
+    ImGui::Render();
+    size_t vertex_count = 0;
+    ImDrawData* data = ImGui::GetDrawData();
+    for (int i = 0; i < data->CmdListsCount; i++) {
+        vertex_count += data->CmdLists[i]->VtxBuffer.Size;
+    }
+    return vertex_count;
+}
+
+void bench_frame_simulator(Bench& bench)
+{
+    for (int core_count : { 2, 8 }) {
+        for (int max_frame_index : { 100, 1000 }) {
+            FrameSetting setting;
+            setting.coreCount = core_count;
+            setting.maxFrameIndex = max_frame_index;
+
+            const std::string suffix = "/cores:" + std::to_string(core_count) + "/frames:" + std::to_string(max_frame_index);
+            bench.run("SimulationContext::Schedule" + suffix, "call", [&](int64_t count) {
+                SimulationContext context(setting);
+                int time = 0;
+                for (int64_t i = 0; i < count; i++) {
+                    // Requests arrive faster than the cores finish, some wait and some do not
+                    time += setting.resolution / (2 * core_count);
+                    context.Schedule(time, setting.resolution / 2);
+                }
+            });
+
+            // Simulate only looks up the cache, Compute is the simulation it caches
+            bench.run("FrameSimulator::Compute" + suffix, "frame", [&](int64_t count) {
+                for (int64_t simulated = 0; simulated < count; simulated += max_frame_index + 1) {
+                    FrameSimulator::Compute(setting);
+                }
+            });
+        }
+    }
+}
+
+void bench_simulator(Bench& bench)
+{
+    App& app = App::get();
+    auto step = [&](const std::string& name, std::shared_ptr<FrameFlow> flow, const SimulationOption& option) {
+        bench.run("Simulator::step/" + name, "step", [&](int64_t count) {
+            Simulator sim(flow, option);
+            for (int64_t i = 0; i < count; i++) {
+                sim.step(false);
+            }
+        });
+    };
+
+    for (const auto& flow : app.Flows) {
+        step(std::string("flow:") + flow->name, flow, app.SimOption);
+    }
+    for (int i = 0; i < get_preset_count(); i++) {
+        const Preset& preset = get_preset(i);
+        step(std::string("preset:") + preset.name(), app.Flows[0], preset.option());
+    }
+}
+
+void bench_draw(Bench& bench)
+{
+    App& app = App::get();
+
+    // A long timeline of which only the start is in the window
+    for (const auto& flow : app.Flows) {
+        Simulator sim(flow, app.SimOption);
+        for (int i = 0; i < DrawStepCount; i++) {
+            sim.step(false);
+        }
+        bench.run(std::string("Simulator::draw/flow:") + flow->name, "draw", [&](int64_t count) {
+            for (int64_t i = 0; i < count; i++) {
+                draw_headless([&]() { sim.draw(); });
+            }
+        });
+    }
+
+    FrameSetting setting;
+    setting.speculate = false;
+    FrameSimulator simulator;
+    simulator.Simulate(setting);
+    bench.run("FrameSimulator::Draw", "draw", [&](int64_t count) {
+        for (int64_t i = 0; i < count; i++) {
+            draw_headless([&]() { simulator.Draw(setting); });
+        }
+    });
+}
+
+// Every item is consumed exactly once
+class HitCounter
+{
+public:
+    explicit HitCounter(int64_t count) : m_hits(new std::atomic<int>[count]), m_count(count)
+    {
+        for (int64_t i = 0; i < count; i++) {
+            m_hits[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<int>* item(int64_t i) { return &m_hits[i]; }
+
+    bool hit_once() const
+    {
+        for (int64_t i = 0; i < m_count; i++) {
+            if (m_hits[i].load(std::memory_order_relaxed) != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::unique_ptr<std::atomic<int>[]> m_hits;
+    int64_t m_count;
+};
+
+void bench_job_system(Bench& bench)
+{
+    const int thread_count = std::max(2, (int)std::thread::hardware_concurrency());
+    const std::string threads = "/threads:" + std::to_string(thread_count);
+
+    bench.run("WorkStealingDeque::push+pop", "item", [&](int64_t count) {
+        HitCounter hits(count);
+        WorkStealingDeque<std::atomic<int>*> deque;
+        for (int64_t i = 0; i < count; i++) {
+            deque.push(hits.item(i));
+        }
+        while (deque.pop()) {
+        }
+    });
+
+    // The owner pushes and pops every other item while the other threads steal
+    bool steal_consistent = true;
+    bench.run_timed("WorkStealingDeque::steal" + threads, "item", [&](int64_t count) {
+        HitCounter hits(count);
+        WorkStealingDeque<std::atomic<int>*> deque;
+        std::atomic<int64_t> consumed{ 0 };
+        std::atomic<bool> done{ false };
+        auto consume = [&](std::atomic<int>* item) {
+            item->fetch_add(1, std::memory_order_relaxed);
+            consumed.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        auto start = Clock::now();
+        std::vector<std::thread> thieves;
+        for (int t = 1; t < thread_count; t++) {
+            thieves.emplace_back([&]() {
+                while (!done.load(std::memory_order_acquire)) {
+                    if (auto item = deque.steal()) {
+                        consume(item);
+                    }
+                }
+            });
+        }
+        for (int64_t i = 0; i < count; i++) {
+            deque.push(hits.item(i));
+            if (i % 2 == 1) {
+                if (auto item = deque.pop()) {
+                    consume(item);
+                }
+            }
+        }
+        while (auto item = deque.pop()) {
+            consume(item);
+        }
+        while (consumed.load(std::memory_order_relaxed) < count) {
+            std::this_thread::yield();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        done = true;
+        for (auto& t : thieves) {
+            t.join();
+        }
+        steal_consistent = steal_consistent && hits.hit_once();
+        return ns;
+    });
+    if (!steal_consistent) {
+        bench.fail("WorkStealingDeque::steal");
+    }
+
+    // Half of the threads produce, the other half consume
+    bool mpmc_consistent = true;
+    bench.run("MpmcQueue::push+pop" + threads, "item", [&](int64_t count) {
+        HitCounter hits(count);
+        MpmcQueue<std::atomic<int>*> queue;
+        const int producer_count = thread_count / 2;
+        const int consumer_count = thread_count - producer_count;
+        std::atomic<int64_t> consumed{ 0 };
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < producer_count; p++) {
+            producers.emplace_back([&, p]() {
+                for (int64_t i = p; i < count; i += producer_count) {
+                    while (!queue.push(hits.item(i))) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        std::vector<std::thread> consumers;
+        for (int c = 0; c < consumer_count; c++) {
+            consumers.emplace_back([&]() {
+                std::atomic<int>* item = nullptr;
+                while (consumed.load(std::memory_order_relaxed) < count) {
+                    if (queue.pop(item)) {
+                        item->fetch_add(1, std::memory_order_relaxed);
+                        consumed.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (auto& t : producers) {
+            t.join();
+        }
+        for (auto& t : consumers) {
+            t.join();
+        }
+        mpmc_consistent = mpmc_consistent && hits.hit_once();
+    });
+    if (!mpmc_consistent) {
+        bench.fail("MpmcQueue::push+pop");
+    }
+
+    AlignedPtr<JobSystem> system = make_aligned<JobSystem>(thread_count - 1);
+    const std::string workers = "/workers:" + std::to_string(system->thread_count());
+
+    // A root task fans out to its own deque, the other workers steal
+    bench.run("JobSystem::submit" + workers, "task", [&](int64_t count) {
+        struct Root
+        {
+            JobSystem* system;
+            std::vector<JobSystem::Task>* tasks;
+        };
+
+        std::vector<JobSystem::Task> tasks((size_t)count);
+        DependencyCounter counter((int)count + 1);
+        for (auto& t : tasks) {
+            t.function = [](void*) {};
+            t.counter = &counter;
+        }
+        Root root_data = { system.get(), &tasks };
+        JobSystem::Task root;
+        root.function = [](void* data) {
+            Root& r = *static_cast<Root*>(data);
+            for (auto& t : *r.tasks) {
+                r.system->submit(&t);
+            }
+        };
+        root.data = &root_data;
+        root.counter = &counter;
+
+        system->submit(&root);
+        system->wait(counter);
+    });
+
+    // From the submit to a parked worker running the task, this thread does not help
+    bench.run_timed(std::string("JobSystem::wakeup/") + Parker::implementation(), "wakeup", [&](int64_t count) {
+        double ns = 0.0;
+        for (int64_t i = 0; i < count; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            Clock::time_point stamp;
+            DependencyCounter counter(1);
+            JobSystem::Task task;
+            task.function = [](void* data) { *static_cast<Clock::time_point*>(data) = Clock::now(); };
+            task.data = &stamp;
+            task.counter = &counter;
+
+            auto start = Clock::now();
+            system->submit(&task);
+            while (counter.value() > 0) {
+                std::this_thread::yield();
+            }
+            ns += std::chrono::duration<double, std::nano>(stamp - start).count();
+        }
+        return ns;
+    });
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::string filter;
+    std::string out = "fcsim-bench.json";
+    const char* baseline_path = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--filter") == 0) {
+            filter = argv[i + 1];
+        } else if (strcmp(argv[i], "--out") == 0) {
+            out = argv[i + 1];
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            baseline_path = argv[i + 1];
+        } else {
+            fprintf(stderr, "usage: %s [--filter text] [--out file.json] [--baseline file.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    init_headless_imgui();
+    App::init();
+
+    Bench bench(filter);
+    bench_frame_simulator(bench);
+    bench_simulator(bench);
+    bench_draw(bench);
+    bench_job_system(bench);
+
+    std::ofstream(out) << to_json(bench.results());
+    printf("Wrote %s\n", out.c_str());
+
+    int regression_count = 0;
+    if (baseline_path) {
+        std::map<std::string, double> baseline = read_baseline(baseline_path);
+        for (const auto& r : bench.results()) {
+            auto it = baseline.find(r.name);
+            if (it != baseline.end() && it->second > 0.0 && r.ns_per_op > it->second * RegressionRatio) {
+                printf("Regression: %s %.1f ns -> %.1f ns (x%.2f)\n", r.name.c_str(), it->second, r.ns_per_op, r.ns_per_op / it->second);
+                regression_count += 1;
+            }
+        }
+        printf("%d regressions against %s\n", regression_count, baseline_path);
+    }
+
+    return regression_count > 0 || bench.failure_count() > 0 ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+#include "calibration.h"
+
+#include "job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+struct Parameter
+{
+    const char* name;
+    float SimulationOption::* field;
+    float low;
+    float high;
+    // Overhead and latency ranges are in vsync periods
+    bool per_vsync;
+    // A speed is swept by ratios rather than by steps
+    bool logarithmic;
+};
+
+const Parameter Parameters[] = {
+    { "Core Speed", &SimulationOption::CoreSpeed, 0.25f, 4.f, false, true },
+    { "Dispatch Overhead", &SimulationOption::DispatchOverhead, 0.f, 0.1f, true, false },
+    { "Wakeup Latency", &SimulationOption::WakeupLatency, 0.f, 0.2f, true, false },
+    { "Duration Noise", &SimulationOption::Random, 0.f, 1.f, false, false },
+};
+
+// Each round narrows the sweeps around the best values by this factor
+constexpr float RoundNarrowing = 0.5f;
+
+// Mean absolute difference of the sorted samples, the larger run is sampled at the ranks of the smaller one
+float sorted_error(std::vector<float> a, std::vector<float> b)
+{
+    if (a.empty() || b.empty()) {
+        return 0.f;
+    }
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+
+    const size_t count = std::min(a.size(), b.size());
+    double error = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        error += std::abs(a[i * a.size() / count] - b[i * b.size() / count]);
+    }
+    return (float)(error / count);
+}
+
+std::vector<float> samples(const float* values, int frame_count, int warmup_frame_count)
+{
+    std::vector<float> result;
+    for (int i = warmup_frame_count; i < frame_count; i++) {
+        // Frames without the stage have a negative offset
+        if (values[i] >= 0.f) {
+            result.push_back(values[i]);
+        }
+    }
+    return result;
+}
+
+FrameSummary simulate(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, int frame_count)
+{
+    Simulator sim(flow, option);
+    sim.run_frames(frame_count);
+    return summarize_frames(sim, std::string());
+}
+
+class Calibration
+{
+public:
+    Calibration(std::shared_ptr<FrameFlow> flow, const FrameSummary& measured, const CalibrationOption& calibration)
+        : m_flow(flow)
+        , m_measured(measured)
+        , m_calibration(calibration)
+    {}
+
+    // Errors of the candidates, in parallel like the ensemble
+    std::vector<float> evaluate(const std::vector<SimulationOption>& candidates)
+    {
+        std::vector<float> errors(candidates.size());
+        parallel_for((int)candidates.size(), m_calibration.ThreadCount, [&](int i) {
+            errors[i] = evaluate(candidates[i]);
+        });
+
+        m_evaluation_count += (int)candidates.size();
+        return errors;
+    }
+
+    int evaluation_count() const { return m_evaluation_count; }
+
+private:
+    float evaluate(SimulationOption option) const
+    {
+        // Without noise every seed gives the same run
+        const int seed_count = option.Random > 0.f ? std::max(1, m_calibration.SeedCount) : 1;
+        const int first_seed = option.Seed;
+        option.AutoSeed = false;
+
+        float error = 0.f;
+        for (int s = 0; s < seed_count; s++) {
+            option.Seed = first_seed + s;
+            error += calibration_error(m_measured, simulate(m_flow, option, m_measured.frame_count()), m_calibration.WarmupFrameCount);
+        }
+        return error / seed_count;
+    }
+
+    std::shared_ptr<FrameFlow> m_flow;
+    const FrameSummary& m_measured;
+    const CalibrationOption& m_calibration;
+    int m_evaluation_count = 0;
+};
+
+}
+
+float calibration_error(const FrameSummary& measured, const FrameSummary& simulated, int warmup_frame_count)
+{
+    float error = 0.f;
+    int metric_count = 0;
+    auto add = [&](std::vector<float> a, std::vector<float> b) {
+        if (!a.empty()) {
+            // A run which misses the metric is as far as the metric is large
+            error += b.empty() ? sorted_error(a, std::vector<float>(1, 0.f)) : sorted_error(std::move(a), std::move(b));
+            metric_count += 1;
+        }
+    };
+
+    add(samples(measured.interval.data(), measured.frame_count(), warmup_frame_count), samples(simulated.interval.data(), simulated.frame_count(), warmup_frame_count));
+    add(samples(measured.latency.data(), measured.frame_count(), warmup_frame_count), samples(simulated.latency.data(), simulated.frame_count(), warmup_frame_count));
+    for (int i = 0; i < measured.stage_count(); i++) {
+        auto it = std::find(simulated.stage_names.begin(), simulated.stage_names.end(), measured.stage_names[i]);
+        std::vector<float> b;
+        if (it != simulated.stage_names.end()) {
+            b = samples(simulated.stage((int)(it - simulated.stage_names.begin())), simulated.frame_count(), warmup_frame_count);
+        }
+        add(samples(measured.stage(i), measured.frame_count(), warmup_frame_count), std::move(b));
+    }
+
+    return metric_count > 0 ? error / metric_count : 0.f;
+}
+
+CalibrationReport run_calibration(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const FrameSummary& measured, const CalibrationOption& calibration)
+{
+    auto begin = std::chrono::steady_clock::now();
+
+    CalibrationReport report;
+    report.flow_name = flow->name;
+    report.measured_name = measured.name;
+    report.option = option;
+
+    Calibration fit(flow, measured, calibration);
+    SimulationOption& best = report.option;
+    float best_error = fit.evaluate(std::vector<SimulationOption>(1, best))[0];
+    report.initial_error = best_error;
+
+    // Coordinate descent: sweep one parameter with the others at their best value
+    const int candidate_count = std::max(2, calibration.CandidateCount);
+    float width = 1.f;
+    for (int round = 0; round < calibration.RoundCount; round++) {
+        for (const Parameter& p : Parameters) {
+            // The sweep is linear in the log of a logarithmic parameter
+            const float scale = p.per_vsync ? option.VsyncPeriod : 1.f;
+            auto to_sweep = [&](float value) { return p.logarithmic ? std::log(value) : value / scale; };
+            auto from_sweep = [&](float value) { return p.logarithmic ? std::exp(value) : value * scale; };
+            const float low = to_sweep(p.low * scale);
+            const float high = to_sweep(p.high * scale);
+            const float half = 0.5f * width * (high - low);
+            const float center = to_sweep(best.*p.field);
+            const float from = std::max(low, center - half);
+            const float to = std::min(high, center + half);
+
+            std::vector<SimulationOption> candidates(candidate_count, best);
+            for (int i = 0; i < candidate_count; i++) {
+                candidates[i].*p.field = from_sweep(from + (to - from) * i / (candidate_count - 1));
+            }
+            std::vector<float> errors = fit.evaluate(candidates);
+
+            // The current value is kept unless a candidate does better
+            for (int i = 0; i < candidate_count; i++) {
+                if (errors[i] < best_error) {
+                    best_error = errors[i];
+                    best = candidates[i];
+                }
+            }
+        }
+        report.round_errors.push_back(best_error);
+        width *= RoundNarrowing;
+    }
+
+    for (const Parameter& p : Parameters) {
+        report.parameters.push_back({ p.name, option.*p.field, best.*p.field });
+    }
+    report.error = best_error;
+    report.evaluation_count = fit.evaluation_count();
+    report.duration_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    return report;
+}
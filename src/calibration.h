@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "visualizer.h"
+#include "frame_diff.h"
+
+struct CalibrationOption
+{
+    // Each round sweeps every parameter in turn around its best value, then narrows the sweep
+    int RoundCount = 4;
+    int CandidateCount = 9;
+    // Seeds simulated per candidate, the duration noise is only seen over several runs
+    int SeedCount = 4;
+    int ThreadCount = 0;
+    // First frames of both runs which are ignored
+    int WarmupFrameCount = 2;
+};
+
+struct CalibrationParameter
+{
+    std::string name;
+    float initial = 0.f;
+    float value = 0.f;
+};
+
+struct CalibrationReport
+{
+    std::string flow_name;
+    std::string measured_name;
+    // Option with the fitted machine model
+    SimulationOption option;
+    std::vector<CalibrationParameter> parameters;
+    // Mean error per frame and per metric in vsync periods
+    float initial_error = 0.f;
+    float error = 0.f;
+    // Best error after each round
+    std::vector<float> round_errors;
+    int evaluation_count = 0;
+    float duration_ms = 0.f;
+};
+
+// Mean absolute difference of the frame intervals, latencies and stage offsets of
+// both runs. Each metric is sorted first, so that runs with a different noise
+// sequence compare by distribution and the spread of the noise is fitted too.
+float calibration_error(const FrameSummary& measured, const FrameSummary& simulated, int warmup_frame_count);
+
+// Fit the core speed, dispatch overhead, wakeup latency and duration noise of the
+// option so that simulating the flow reproduces the measured frames. Candidates of
+// a sweep are simulated in parallel, each only depends on its option and seed.
+CalibrationReport run_calibration(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const FrameSummary& measured, const CalibrationOption& calibration);
@@ -0,0 +1,530 @@
+#include "capture.h"
+
+#include "imgui.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+struct CaptureHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t frame_count;
+    uint32_t column_count;
+    uint64_t names_offset;
+};
+
+constexpr uint32_t CaptureVersion = 1;
+
+std::string trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n\"");
+    if (begin == std::string::npos) {
+        return std::string();
+    }
+    size_t end = s.find_last_not_of(" \t\r\n\"");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Gathers the durations of each stage, in the order the stages are first seen
+class CaptureBuilder
+{
+public:
+    explicit CaptureBuilder(const CaptureMapping& mapping) : m_mapping(mapping) {}
+
+    // Column receiving the durations of a captured name, -1 when it is ignored
+    int column(const std::string& name)
+    {
+        std::string stage = name;
+        if (!m_mapping.empty()) {
+            auto it = std::find_if(m_mapping.begin(), m_mapping.end(), [&](const auto& m) { return m.first == name; });
+            if (it == m_mapping.end()) {
+                return -1;
+            }
+            stage = it->second;
+        }
+
+        auto it = std::find(m_names.begin(), m_names.end(), stage);
+        if (it != m_names.end()) {
+            return (int)(it - m_names.begin());
+        }
+        m_names.push_back(stage);
+        m_columns.emplace_back();
+        return (int)m_names.size() - 1;
+    }
+
+    // Several captured names may map to the same stage, their durations add up
+    void add(int column, int frame, float duration)
+    {
+        assert(column >= 0 && column < (int)m_columns.size());
+        if (frame < 0) {
+            return;
+        }
+        auto& values = m_columns[column];
+        if (frame >= (int)values.size()) {
+            values.resize(frame + 1, 0.f);
+        }
+        values[frame] += duration;
+    }
+
+    bool write(const std::string& output, std::string& error) const
+    {
+        if (m_columns.empty()) {
+            error = "no stage found in the capture";
+            return false;
+        }
+
+        // Only keep the frames captured for every stage
+        size_t frame_count = m_columns[0].size();
+        for (const auto& values : m_columns) {
+            frame_count = std::min(frame_count, values.size());
+        }
+        if (frame_count == 0) {
+            error = "no frame found in the capture";
+            return false;
+        }
+
+        std::ofstream file(output, std::ios::binary);
+        if (!file) {
+            error = "can not write " + output;
+            return false;
+        }
+
+        CaptureHeader header;
+        memcpy(header.magic, "FCAP", 4);
+        header.version = CaptureVersion;
+        header.frame_count = (uint32_t)frame_count;
+        header.column_count = (uint32_t)m_columns.size();
+        header.names_offset = sizeof(CaptureHeader) + sizeof(float) * frame_count * m_columns.size();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& values : m_columns) {
+            file.write(reinterpret_cast<const char*>(values.data()), sizeof(float) * frame_count);
+        }
+        for (const auto& name : m_names) {
+            file.write(name.c_str(), name.size() + 1);
+        }
+
+        if (!file) {
+            error = "can not write " + output;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const CaptureMapping& m_mapping;
+    std::vector<std::string> m_names;
+    std::vector<std::vector<float>> m_columns;
+};
+
+// Just enough of a json reader to walk the events of a chrome trace
+class JsonReader
+{
+public:
+    JsonReader(const char* begin, const char* end) : m_p(begin), m_end(end) {}
+
+    bool consume(char c)
+    {
+        skip_space();
+        if (m_p < m_end && *m_p == c) {
+            m_p++;
+            return true;
+        }
+        return false;
+    }
+
+    char peek()
+    {
+        skip_space();
+        return m_p < m_end ? *m_p : '\0';
+    }
+
+    bool read_string(std::string& out)
+    {
+        out.clear();
+        if (!consume('"')) {
+            return false;
+        }
+        while (m_p < m_end && *m_p != '"') {
+            if (*m_p == '\\' && m_p + 1 < m_end) {
+                m_p++;
+            }
+            out.push_back(*m_p++);
+        }
+        if (m_p >= m_end) {
+            return false;
+        }
+        m_p++;
+        return true;
+    }
+
+    bool read_number(double& out)
+    {
+        skip_space();
+        char* end = nullptr;
+        out = strtod(m_p, &end);
+        if (end == m_p) {
+            return false;
+        }
+        m_p = end;
+        return true;
+    }
+
+    bool skip_value()
+    {
+        std::string s;
+        double d;
+        switch (peek()) {
+        case '"':
+            return read_string(s);
+        case '{':
+        case '[': {
+            char close = *m_p == '{' ? '}' : ']';
+            m_p++;
+            while (!consume(close)) {
+                if (close == '}' && !(read_string(s) && consume(':'))) {
+                    return false;
+                }
+                if (!skip_value()) {
+                    return false;
+                }
+                consume(',');
+            }
+            return true;
+        }
+        case 't':
+        case 'f':
+        case 'n':
+            while (m_p < m_end && isalpha((unsigned char)*m_p)) {
+                m_p++;
+            }
+            return true;
+        default:
+            return read_number(d);
+        }
+    }
+
+private:
+    void skip_space()
+    {
+        while (m_p < m_end && isspace((unsigned char)*m_p)) {
+            m_p++;
+        }
+    }
+
+    const char* m_p;
+    const char* m_end;
+};
+
+struct TraceEvent
+{
+    std::string name;
+    std::string ph;
+    double dur = 0.0;
+    double frame = -1.0;
+};
+
+bool read_event(JsonReader& reader, TraceEvent& event)
+{
+    if (!reader.consume('{')) {
+        return false;
+    }
+    std::string key;
+    while (!reader.consume('}')) {
+        if (!reader.read_string(key) || !reader.consume(':')) {
+            return false;
+        }
+        bool ok = true;
+        if (key == "name") {
+            ok = reader.read_string(event.name);
+        } else if (key == "ph") {
+            ok = reader.read_string(event.ph);
+        } else if (key == "dur") {
+            ok = reader.read_number(event.dur);
+        } else if (key == "args" && reader.peek() == '{') {
+            reader.consume('{');
+            while (ok && !reader.consume('}')) {
+                ok = reader.read_string(key) && reader.consume(':');
+                if (ok && key == "frame" && reader.peek() != '"') {
+                    ok = reader.read_number(event.frame);
+                } else if (ok) {
+                    ok = reader.skip_value();
+                }
+                reader.consume(',');
+            }
+        } else {
+            ok = reader.skip_value();
+        }
+        if (!ok) {
+            return false;
+        }
+        reader.consume(',');
+    }
+    return true;
+}
+
+}
+
+CaptureMapping parse_capture_mapping(const char* text)
+{
+    CaptureMapping mapping;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            continue;
+        }
+        std::string name = trim(line.substr(0, separator));
+        std::string stage = trim(line.substr(separator + 1));
+        if (!name.empty() && !stage.empty()) {
+            mapping.emplace_back(name, stage);
+        }
+    }
+    return mapping;
+}
+
+std::shared_ptr<FrameCapture> FrameCapture::open(const std::string& path, std::string& error)
+{
+    auto capture = std::make_shared<FrameCapture>();
+    if (!capture->m_file.open(path)) {
+        error = "can not open " + path;
+        return nullptr;
+    }
+
+    const uint8_t* data = capture->m_file.data();
+    const size_t size = capture->m_file.size();
+    CaptureHeader header;
+    if (size < sizeof(header)) {
+        error = path + " is not a capture";
+        return nullptr;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, "FCAP", 4) != 0) {
+        error = path + " is not a capture";
+        return nullptr;
+    }
+    if (header.version != CaptureVersion) {
+        error = path + " has an unsupported version " + std::to_string(header.version);
+        return nullptr;
+    }
+    const uint64_t columns_end = sizeof(header) + sizeof(float) * (uint64_t)header.frame_count * header.column_count;
+    if (header.frame_count == 0 || columns_end > header.names_offset || header.names_offset > size) {
+        error = path + " is truncated";
+        return nullptr;
+    }
+
+    const char* name = reinterpret_cast<const char*>(data + header.names_offset);
+    const char* end = reinterpret_cast<const char*>(data + size);
+    for (uint32_t i = 0; i < header.column_count; i++) {
+        const char* name_end = static_cast<const char*>(memchr(name, '\0', end - name));
+        if (name_end == nullptr) {
+            error = path + " is truncated";
+            return nullptr;
+        }
+        capture->m_names.push_back(name);
+        name = name_end + 1;
+    }
+
+    capture->m_frame_count = (int)header.frame_count;
+    capture->m_column_count = (int)header.column_count;
+    capture->m_columns = reinterpret_cast<const float*>(data + sizeof(header));
+
+    // FNV-1a over the whole file
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    capture->m_content_hash = hash;
+    return capture;
+}
+
+int FrameCapture::find_column(const char* name) const
+{
+    for (int i = 0; i < m_column_count; i++) {
+        if (strcmp(m_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool import_capture_csv(const std::string& path, const CaptureMapping& mapping, const std::string& output, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file) {
+        error = "can not open " + path;
+        return false;
+    }
+
+    CaptureBuilder builder(mapping);
+    std::string line;
+    std::string cell;
+    std::vector<int> columns;
+    int frame_column = -1;
+    if (std::getline(file, line)) {
+        std::istringstream cells(line);
+        while (std::getline(cells, cell, ',')) {
+            std::string name = trim(cell);
+            if (name == "frame") {
+                frame_column = (int)columns.size();
+                columns.push_back(-1);
+            } else {
+                columns.push_back(builder.column(name));
+            }
+        }
+    }
+
+    std::vector<float> values(columns.size());
+    for (int row = 0; std::getline(file, line); row++) {
+        if (trim(line).empty()) {
+            row--;
+            continue;
+        }
+        const char* p = line.c_str();
+        for (size_t c = 0; c < columns.size(); c++) {
+            char* end = nullptr;
+            values[c] = strtof(p, &end);
+            p = strchr(end, ',');
+            if (p == nullptr) {
+                values.resize(c + 1);
+                break;
+            }
+            p++;
+        }
+        int frame = frame_column >= 0 && frame_column < (int)values.size() ? (int)values[frame_column] : row;
+        for (size_t c = 0; c < values.size(); c++) {
+            if (columns[c] >= 0) {
+                builder.add(columns[c], frame, values[c]);
+            }
+        }
+        values.resize(columns.size());
+    }
+
+    return builder.write(output, error);
+}
+
+bool import_capture_chrome_trace(const std::string& path, const CaptureMapping& mapping, const std::string& output, std::string& error)
+{
+    MappedFile file;
+    if (!file.open(path)) {
+        error = "can not open " + path;
+        return false;
+    }
+
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    JsonReader reader(begin, begin + file.size());
+
+    // Either an array of events or an object with a traceEvents array
+    std::string key;
+    if (reader.consume('{')) {
+        while (true) {
+            if (!reader.read_string(key) || !reader.consume(':')) {
+                error = "no traceEvents in " + path;
+                return false;
+            }
+            if (key == "traceEvents") {
+                break;
+            }
+            reader.skip_value();
+            reader.consume(',');
+        }
+    }
+    if (!reader.consume('[')) {
+        error = path + " is not a chrome trace";
+        return false;
+    }
+
+    CaptureBuilder builder(mapping);
+    std::unordered_map<std::string, int> occurrences;
+    TraceEvent event;
+    while (!reader.consume(']')) {
+        event = TraceEvent();
+        if (!read_event(reader, event)) {
+            error = path + " is not a valid chrome trace";
+            return false;
+        }
+        reader.consume(',');
+
+        if (event.ph != "X") {
+            continue;
+        }
+        int column = builder.column(event.name);
+        if (column < 0) {
+            continue;
+        }
+        int frame = event.frame >= 0.0 ? (int)event.frame : occurrences[event.name]++;
+        builder.add(column, frame, (float)(event.dur / 1000.0));
+    }
+
+    return builder.write(output, error);
+}
+
+bool draw_capture_import(CaptureImport& import)
+{
+    bool changed = false;
+    std::string error;
+
+    ImGui::InputText("Capture File", import.path, sizeof(import.path));
+    ImGui::InputTextMultiline("Name=Stage", import.mapping, sizeof(import.mapping), ImVec2(0.f, 60.f));
+
+    const std::string path = import.path;
+    const std::string output = path + ".fcap";
+    auto load = [&](const std::string& fcap) {
+        auto capture = FrameCapture::open(fcap, error);
+        if (capture) {
+            import.capture = capture;
+            import.status = "Loaded " + fcap;
+            changed = true;
+        } else {
+            import.status = error;
+        }
+    };
+
+    if (ImGui::Button("Import Csv")) {
+        if (import_capture_csv(path, parse_capture_mapping(import.mapping), output, error)) {
+            load(output);
+        } else {
+            import.status = error;
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Import Chrome Trace")) {
+        if (import_capture_chrome_trace(path, parse_capture_mapping(import.mapping), output, error)) {
+            load(output);
+        } else {
+            import.status = error;
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Open .fcap")) {
+        load(path);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Unload") && import.capture) {
+        import.capture = nullptr;
+        import.status.clear();
+        changed = true;
+    }
+
+    if (!import.status.empty()) {
+        ImGui::TextWrapped("%s", import.status.c_str());
+    }
+    if (import.capture) {
+        ImGui::Text("%d frames", import.capture->frame_count());
+        for (int i = 0; i < import.capture->column_count(); i++) {
+            ImGui::BulletText("%s", import.capture->column_name(i));
+        }
+    }
+
+    return changed;
+}
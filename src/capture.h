@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Captured durations are in milliseconds, a vsync period of the simulations lasts 1/60 s
+constexpr float CaptureVsyncPeriodMs = 1000.f / 60.f;
+
+// Capture name -> stage name, captured names which are not listed are ignored.
+// An empty mapping keeps every captured name as is.
+using CaptureMapping = std::vector<std::pair<std::string, std::string>>;
+
+CaptureMapping parse_capture_mapping(const char* text);
+
+// Per frame stage durations of a measured capture, read in place from a mapped
+// .fcap file: a header, one float column per stage, then the stage names.
+class FrameCapture
+{
+public:
+    static std::shared_ptr<FrameCapture> open(const std::string& path, std::string& error);
+
+    int frame_count() const { return m_frame_count; }
+    int column_count() const { return m_column_count; }
+    const char* column_name(int column) const { return m_names[column]; }
+    int find_column(const char* name) const;
+    // Hash of the durations and the names, the same for every open of a capture
+    uint64_t content_hash() const { return m_content_hash; }
+
+    // Frames past the end of the capture replay it from the start
+    float duration(int column, int frame) const
+    {
+        return m_columns[(size_t)column * m_frame_count + (size_t)frame % m_frame_count];
+    }
+
+private:
+    MappedFile m_file;
+    int m_frame_count = 0;
+    int m_column_count = 0;
+    const float* m_columns = nullptr;
+    std::vector<const char*> m_names;
+    uint64_t m_content_hash = 0;
+};
+
+// Convert a capture to a .fcap file. Csv files have a header row with the stage
+// names and one row per frame, an optional "frame" column gives the frame index.
+// Chrome traces are read from their complete events, the frame index comes from
+// args.frame or else from the count of previous events with the same name.
+bool import_capture_csv(const std::string& path, const CaptureMapping& mapping, const std::string& output, std::string& error);
+bool import_capture_chrome_trace(const std::string& path, const CaptureMapping& mapping, const std::string& output, std::string& error);
+
+struct CaptureImport
+{
+    char path[256] = "capture.csv";
+    char mapping[1024] = "";
+    std::string status;
+    std::shared_ptr<const FrameCapture> capture;
+};
+
+// Import and open controls, returns true when the capture changed
+bool draw_capture_import(CaptureImport& import);
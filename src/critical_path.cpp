@@ -0,0 +1,254 @@
+#include "critical_path.h"
+
+#include "node_editor.h"
+#include "visualizer.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+struct StageNode
+{
+    int job_count = 0;
+    float start = std::numeric_limits<float>::max();
+    float end = 0.f;
+    float latest_end = std::numeric_limits<float>::max();
+};
+
+// Flows with gpu stages release their frame at present, a node after the stages of the frame
+bool has_present(FrameFlow& flow)
+{
+    return flow.gpu_queue_count() > 0;
+}
+
+int release_node(FrameFlow& flow)
+{
+    return has_present(flow) ? (int)flow.stages.size() : flow.last_cpu_stage();
+}
+
+void add_predecessors(FrameFlow& flow, int pool_size, int frame, int stage, std::vector<std::pair<int, int>>& preds)
+{
+    preds.clear();
+
+    const int stage_count = (int)flow.stages.size();
+    if (stage == stage_count) {
+        // The present waits for the cpu chain and every gpu stage, frames are presented in order
+        if (flow.last_cpu_stage() >= 0) {
+            preds.emplace_back(frame, flow.last_cpu_stage());
+        }
+        for (int i = 0; i < stage_count; i++) {
+            if (flow.stages[i]->gpu) {
+                preds.emplace_back(frame, i);
+            }
+        }
+        if (frame > 0) {
+            preds.emplace_back(frame - 1, stage_count);
+        }
+        return;
+    }
+
+    const FrameStage& s = *flow.stages[stage];
+    int previous = flow.previous_cpu_stage(stage);
+    if (previous >= 0) {
+        // Cpu stages follow the cpu chain, gpu stages are submitted by their kick
+        preds.emplace_back(frame, previous);
+    } else if (frame > 0) {
+        preds.emplace_back(frame - 1, flow.start_next_frame_stage);
+        if (frame >= pool_size && release_node(flow) >= 0) {
+            preds.emplace_back(frame - pool_size, release_node(flow));
+        }
+    }
+
+    if (s.gpu) {
+        // Gpu queues execute in submission order
+        int same_queue = -1;
+        for (int i = stage - 1; i >= 0 && same_queue < 0; i--) {
+            if (flow.stages[i]->gpu && flow.stages[i]->gpu_queue == s.gpu_queue) {
+                same_queue = i;
+            }
+        }
+        if (same_queue >= 0) {
+            preds.emplace_back(frame, same_queue);
+        } else if (frame > 0) {
+            for (int i = (int)flow.stages.size() - 1; i > stage; i--) {
+                if (flow.stages[i]->gpu && flow.stages[i]->gpu_queue == s.gpu_queue) {
+                    preds.emplace_back(frame - 1, i);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (s.wait && frame > 0) {
+        for (int i = 0; i < stage_count; i++) {
+            if (flow.stages[i]->stage_tag == s.wait_tag) {
+                preds.emplace_back(frame - 1, i);
+            }
+        }
+    }
+}
+
+}
+
+const StageSlack* CriticalPathAnalysis::find(int frame, int stage) const
+{
+    if (frame < 0 || frame >= frame_count || stage < 0 || stage >= stage_count) {
+        return nullptr;
+    }
+    return &slacks[frame * stage_count + stage];
+}
+
+bool CriticalPathAnalysis::is_critical(int frame, int stage) const
+{
+    auto s = find(frame, stage);
+    return s && s->critical;
+}
+
+bool CriticalPathAnalysis::is_critical_stage(int stage) const
+{
+    return stage >= 0 && (size_t)stage < stage_critical_ratio.size() && stage_critical_ratio[stage] >= 0.5f;
+}
+
+float compute_lower_bound(FrameFlow& flow, int core_count)
+{
+    return std::max(flow.compute_critical_path_time(), flow.compute_total_work() / core_count);
+}
+
+CriticalPathAnalysis analyze_critical_path(FrameFlow& flow, const SimulationOption& option, const std::vector<TimeBox>& timeboxes)
+{
+    CriticalPathAnalysis result;
+    result.span = flow.compute_critical_path_time();
+    result.work = flow.compute_total_work();
+    result.lower_bound = std::max(result.span, result.work / option.CoreNum);
+    result.upper_bound = result.work / option.CoreNum + result.span;
+    result.interval_bound = std::max(result.work / option.CoreNum, result.span / option.FramePoolSize);
+
+    const int stage_count = (int)flow.stages.size();
+    result.stage_count = stage_count;
+    // Each frame has a node per stage, then its present
+    const bool present = has_present(flow);
+    const int node_count = stage_count + (present ? 1 : 0);
+
+    // Gather the jobs of each stage of each frame
+    std::vector<StageNode> nodes;
+    for (const auto& t : timeboxes) {
+        const bool is_present = present && t.stage < 0 && t.type == TimeBoxType::Out;
+        if ((t.stage < 0 && !is_present) || t.stage >= stage_count || t.frame < 0) {
+            continue;
+        }
+        size_t index = (size_t)(t.frame * node_count + (is_present ? stage_count : t.stage));
+        if (index >= nodes.size()) {
+            nodes.resize((size_t)((t.frame + 1) * node_count));
+        }
+        StageNode& n = nodes[index];
+        n.job_count += 1;
+        n.start = std::min(n.start, t.raw_start());
+        n.end = std::max(n.end, t.raw_end());
+    }
+
+    // Only analyze the leading frames which are entirely scheduled
+    int frame_count = 0;
+    while ((size_t)((frame_count + 1) * node_count) <= nodes.size()) {
+        bool complete = true;
+        for (int s = 0; s < node_count; s++) {
+            const int job_count = s < stage_count ? flow.stages[s]->split_count : 1;
+            if (nodes[frame_count * node_count + s].job_count < job_count) {
+                complete = false;
+                break;
+            }
+        }
+        if (!complete) {
+            break;
+        }
+        frame_count += 1;
+    }
+    nodes.resize((size_t)(frame_count * node_count));
+    result.frame_count = frame_count;
+
+    if (frame_count == 0) {
+        return result;
+    }
+
+    // Backward pass, predecessors always have a lower node index
+    std::vector<std::pair<int, int>> preds;
+    std::vector<float> frame_start(frame_count, std::numeric_limits<float>::max());
+    std::vector<float> frame_end(frame_count, 0.f);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        frame_start[i / node_count] = std::min(frame_start[i / node_count], nodes[i].start);
+        frame_end[i / node_count] = std::max(frame_end[i / node_count], nodes[i].end);
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        nodes[i].latest_end = frame_end[i / node_count];
+    }
+    for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+        StageNode& n = nodes[i];
+        float latest_start = n.latest_end - (n.end - n.start);
+
+        add_predecessors(flow, option.FramePoolSize, i / node_count, i % node_count, preds);
+        for (const auto& p : preds) {
+            StageNode& pred = nodes[p.first * node_count + p.second];
+            pred.latest_end = std::min(pred.latest_end, latest_start);
+        }
+    }
+
+    const float epsilon = result.span * 1e-4f;
+
+    // The slacks are only kept for the stages
+    result.slacks.resize((size_t)(frame_count * stage_count));
+    result.stage_min_slack.assign(stage_count, std::numeric_limits<float>::max());
+    result.stage_mean_slack.assign(stage_count, 0.f);
+    result.stage_critical_ratio.assign(stage_count, 0.f);
+    float total_frame_time = 0.f;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if ((int)(i % node_count) >= stage_count) {
+            continue;
+        }
+        const StageNode& n = nodes[i];
+        StageSlack& s = result.slacks[(i / node_count) * stage_count + i % node_count];
+        s.frame_index = (int)(i / node_count);
+        s.stage_index = (int)(i % node_count);
+        s.start = n.start;
+        s.end = n.end;
+        s.slack = std::max(0.f, n.latest_end - n.end);
+        s.critical = s.slack <= epsilon;
+
+        result.stage_min_slack[s.stage_index] = std::min(result.stage_min_slack[s.stage_index], s.slack);
+        result.stage_mean_slack[s.stage_index] += s.slack / frame_count;
+        result.stage_critical_ratio[s.stage_index] += s.critical ? 1.f / frame_count : 0.f;
+    }
+    for (int f = 0; f < frame_count; f++) {
+        total_frame_time += frame_end[f] - frame_start[f];
+    }
+    result.mean_frame_time = total_frame_time / frame_count;
+
+    // Walk back from the end of the last frame, following the predecessor which ended last
+    int current = (frame_count - 1) * node_count;
+    for (int s = 1; s < node_count; s++) {
+        if (nodes[(frame_count - 1) * node_count + s].end > nodes[current].end) {
+            current = (frame_count - 1) * node_count + s;
+        }
+    }
+    while (current >= 0) {
+        const int frame = current / node_count;
+        const int stage = current % node_count;
+        if (stage < stage_count) {
+            result.critical_path.push_back(frame * stage_count + stage);
+            result.critical_path_work += nodes[current].end - nodes[current].start;
+        }
+
+        add_predecessors(flow, option.FramePoolSize, frame, stage, preds);
+        int next = -1;
+        float next_end = -1.f;
+        for (const auto& p : preds) {
+            int index = p.first * node_count + p.second;
+            if (nodes[index].end > next_end) {
+                next = index;
+                next_end = nodes[index].end;
+            }
+        }
+        current = next;
+    }
+
+    return result;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+struct FrameFlow;
+struct SimulationOption;
+struct TimeBox;
+
+struct StageSlack
+{
+    int frame_index = -1;
+    int stage_index = -1;
+    float start = 0.f;
+    float end = 0.f;
+    float slack = 0.f;
+    bool critical = false;
+};
+
+// Result of the critical path analysis of a finished simulation.
+// Slack is how late a stage of a frame could have ended without delaying
+// the end of its own frame or of any frame depending on it.
+struct CriticalPathAnalysis
+{
+    // Sum of the job durations along the stage chain (infinite cores)
+    float span = 0.f;
+    // Sum of all the job durations of a frame (single core)
+    float work = 0.f;
+    // Graham/Brent bounds of the frame time for the simulated core count
+    float lower_bound = 0.f;
+    float upper_bound = 0.f;
+    // Minimal frame interval allowed by the core count and the frame pool size
+    float interval_bound = 0.f;
+
+    int frame_count = 0;
+    int stage_count = 0;
+    float mean_frame_time = 0.f;
+
+    std::vector<StageSlack> slacks;
+    std::vector<float> stage_min_slack;
+    std::vector<float> stage_mean_slack;
+    std::vector<float> stage_critical_ratio;
+
+    // Stages which determined the end of the last analyzed frame, from last to first,
+    // as frame * stage_count + stage like the slacks
+    std::vector<int> critical_path;
+    float critical_path_work = 0.f;
+
+    const StageSlack* find(int frame, int stage) const;
+    bool is_critical(int frame, int stage) const;
+    bool is_critical_stage(int stage) const;
+};
+
+float compute_lower_bound(FrameFlow& flow, int core_count);
+CriticalPathAnalysis analyze_critical_path(FrameFlow& flow, const SimulationOption& option, const std::vector<TimeBox>& timeboxes);
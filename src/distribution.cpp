@@ -0,0 +1,183 @@
+#include "distribution.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float Pi = 3.14159265358979f;
+
+uint32_t split_mix(uint64_t& state)
+{
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+}
+
+const char* distribution_name(DistributionType type)
+{
+    switch (type) {
+    case DistributionType::Lognormal: return "Lognormal";
+    case DistributionType::Gamma: return "Gamma";
+    case DistributionType::Histogram: return "Histogram";
+    case DistributionType::AutoRegressive: return "AR(1)";
+    case DistributionType::Markov: return "Markov";
+    default: return "Default";
+    }
+}
+
+DurationSampler::DurationSampler(const DurationDistribution& distribution, uint32_t seed)
+    : m_distribution(distribution)
+    , m_samples(BlockSize)
+    , m_uniform(BlockSize)
+    , m_normal(BlockSize)
+{
+    uint64_t state = seed;
+    for (int i = 0; i < LaneCount; i++) {
+        // xorshift lanes must not be zero
+        m_lanes[i] = split_mix(state) | 1u;
+    }
+
+    float total = 0.f;
+    for (float w : m_distribution.histogram) {
+        total += std::max(w, 0.f);
+        m_histogram_cdf.push_back(total);
+    }
+    for (float& c : m_histogram_cdf) {
+        c = total > 0.f ? c / total : 1.f;
+    }
+}
+
+void DurationSampler::fill_uniform(float* out, int count)
+{
+    assert(count % LaneCount == 0);
+
+    uint32_t lanes[LaneCount];
+    std::copy(m_lanes, m_lanes + LaneCount, lanes);
+    for (int i = 0; i < count; i += LaneCount) {
+        for (int l = 0; l < LaneCount; l++) {
+            uint32_t x = lanes[l];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            lanes[l] = x;
+            // Uniform in (0, 1), never 0 so its log is defined
+            out[i + l] = ((x >> 8) + 0.5f) * (1.f / 16777216.f);
+        }
+    }
+    std::copy(lanes, lanes + LaneCount, m_lanes);
+}
+
+void DurationSampler::fill_normal(float* out, int count)
+{
+    assert(count % 2 == 0);
+
+    fill_uniform(m_uniform.data(), count);
+    const int half = count / 2;
+    for (int i = 0; i < half; i++) {
+        float r = std::sqrt(-2.f * std::log(m_uniform[i]));
+        float a = 2.f * Pi * m_uniform[half + i];
+        out[i] = r * std::cos(a);
+        out[half + i] = r * std::sin(a);
+    }
+}
+
+float DurationSampler::next_gamma(float shape)
+{
+    // Marsaglia and Tsang, boosted for shapes below 1
+    if (shape < 1.f) {
+        float gamma = next_gamma(shape + 1.f);
+        fill_uniform(m_uniform.data(), LaneCount);
+        return gamma * std::pow(m_uniform[0], 1.f / shape);
+    }
+
+    const float d = shape - 1.f / 3.f;
+    const float c = 1.f / std::sqrt(9.f * d);
+    float normal[LaneCount];
+    while (true) {
+        fill_normal(normal, LaneCount);
+        fill_uniform(m_uniform.data(), LaneCount);
+        for (int i = 0; i < LaneCount; i++) {
+            float v = 1.f + c * normal[i];
+            if (v <= 0.f) {
+                continue;
+            }
+            v = v * v * v;
+            float z2 = normal[i] * normal[i];
+            if (std::log(m_uniform[i]) < 0.5f * z2 + d - d * v + d * std::log(v)) {
+                return d * v;
+            }
+        }
+    }
+}
+
+void DurationSampler::refill()
+{
+    const DurationDistribution& d = m_distribution;
+    float* out = m_samples.data();
+
+    switch (d.type) {
+    case DistributionType::Lognormal: {
+        fill_normal(out, BlockSize);
+        const float mu = -0.5f * d.sigma * d.sigma;
+        for (int i = 0; i < BlockSize; i++) {
+            out[i] = std::exp(mu + d.sigma * out[i]);
+        }
+        break;
+    }
+    case DistributionType::Gamma: {
+        const float shape = std::max(d.shape, 0.05f);
+        for (int i = 0; i < BlockSize; i++) {
+            out[i] = next_gamma(shape) / shape;
+        }
+        break;
+    }
+    case DistributionType::Histogram: {
+        fill_uniform(m_uniform.data(), BlockSize);
+        fill_uniform(out, BlockSize);
+        const int bin_count = (int)m_histogram_cdf.size();
+        const float bin_width = bin_count > 0 ? d.histogram_max / bin_count : 0.f;
+        for (int i = 0; i < BlockSize; i++) {
+            int bin = (int)(std::lower_bound(m_histogram_cdf.begin(), m_histogram_cdf.end(), m_uniform[i]) - m_histogram_cdf.begin());
+            bin = std::min(bin, bin_count - 1);
+            out[i] = (bin + out[i]) * bin_width;
+        }
+        break;
+    }
+    case DistributionType::AutoRegressive: {
+        // AR(1) over the log of the multiplier, its stationary spread is sigma
+        fill_normal(m_normal.data(), BlockSize);
+        const float phi = std::min(std::max(d.correlation, -0.999f), 0.999f);
+        const float innovation = std::sqrt(1.f - phi * phi);
+        const float mu = -0.5f * d.sigma * d.sigma;
+        for (int i = 0; i < BlockSize; i++) {
+            m_ar_state = phi * m_ar_state + innovation * m_normal[i];
+            out[i] = m_ar_state;
+        }
+        for (int i = 0; i < BlockSize; i++) {
+            out[i] = std::exp(mu + d.sigma * out[i]);
+        }
+        break;
+    }
+    case DistributionType::Markov: {
+        // Two states chain, the spike state multiplies the duration until it is left
+        fill_normal(m_normal.data(), BlockSize);
+        fill_uniform(m_uniform.data(), BlockSize);
+        const float mu = -0.5f * d.sigma * d.sigma;
+        for (int i = 0; i < BlockSize; i++) {
+            m_spike = m_spike ? m_uniform[i] < d.spike_persistence : m_uniform[i] < d.spike_probability;
+            out[i] = std::exp(mu + d.sigma * m_normal[i]) * (m_spike ? d.spike_ratio : 1.f);
+        }
+        break;
+    }
+    default:
+        std::fill(out, out + BlockSize, 1.f);
+        break;
+    }
+
+    m_next = 0;
+}
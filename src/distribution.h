@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+enum class DistributionType
+{
+    Default,
+    Lognormal,
+    Gamma,
+    Histogram,
+    AutoRegressive,
+    Markov,
+};
+
+// Distribution of the duration multiplier of a stage. Lognormal, gamma and AR(1) have a mean of 1,
+// Markov adds its spikes on top of it and the histogram is an empirical distribution of the multiplier.
+struct DurationDistribution
+{
+    DistributionType type = DistributionType::Default;
+
+    // Lognormal, AR(1) and Markov spread of the log of the multiplier
+    float sigma = 0.25f;
+    // Gamma shape, the scale is its inverse
+    float shape = 4.f;
+    // AR(1) coefficient between two consecutive frames
+    float correlation = 0.8f;
+    // Markov spikes, like scene streaming
+    float spike_probability = 0.05f;
+    float spike_persistence = 0.8f;
+    float spike_ratio = 3.f;
+    // Weights of equal width bins over [0, histogram_max]
+    float histogram_max = 3.f;
+    std::vector<float> histogram = { 0.f, 1.f, 4.f, 8.f, 4.f, 1.f, 0.5f, 0.25f, 0.125f };
+};
+
+const char* distribution_name(DistributionType type);
+
+// Generate the multipliers of a stage in bulk into a buffer. The jobs of a stage each draw
+// their own multiplier, except for AR(1) and Markov which evolve once per frame and give
+// every job of the stage in that frame the same one.
+// The uniform generator is a set of independent xorshift lanes so the fill loops vectorize.
+class DurationSampler
+{
+public:
+    static constexpr int BlockSize = 256;
+    static constexpr int LaneCount = 8;
+
+    DurationSampler(const DurationDistribution& distribution, uint32_t seed);
+
+    DistributionType type() const { return m_distribution.type; }
+
+    bool correlated() const { return m_distribution.type == DistributionType::AutoRegressive || m_distribution.type == DistributionType::Markov; }
+
+    float next(int frame_index)
+    {
+        if (!correlated()) {
+            return draw();
+        }
+        if (frame_index != m_frame_index) {
+            m_frame_index = frame_index;
+            m_frame_sample = draw();
+        }
+        return m_frame_sample;
+    }
+
+private:
+    float draw()
+    {
+        if (m_next == BlockSize) {
+            refill();
+        }
+        return m_samples[m_next++];
+    }
+
+    void refill();
+    void fill_uniform(float* out, int count);
+    void fill_normal(float* out, int count);
+    float next_gamma(float shape);
+
+    DurationDistribution m_distribution;
+    uint32_t m_lanes[LaneCount];
+
+    std::vector<float> m_samples;
+    std::vector<float> m_uniform;
+    std::vector<float> m_normal;
+    std::vector<float> m_histogram_cdf;
+    int m_next = BlockSize;
+
+    // Correlated state carried from one block to the next
+    float m_ar_state = 0.f;
+    bool m_spike = false;
+    // Frame whose multiplier was last drawn by a correlated distribution
+    int m_frame_index = -1;
+    float m_frame_sample = 1.f;
+};
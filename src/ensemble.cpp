@@ -0,0 +1,235 @@
+#include "ensemble.h"
+
+#include "job_system.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+namespace {
+
+struct RunResult
+{
+    std::vector<float> frame_times;
+    std::vector<float> latencies;
+    int missed_vsync = 0;
+};
+
+RunResult simulate_run(std::shared_ptr<FrameFlow> flow, SimulationOption option, const EnsembleOption& ensemble)
+{
+    RunResult result;
+
+    // The interval a frame is expected to be shown for when it made its vsync, the limiter
+    // one rounded up to a vsync while the adaptive limiter changes it
+    std::vector<float> expected_intervals;
+    const bool presents_on_vsync = option.Vsync && flow->gpu_queue_count() > 0;
+    Simulator sim(flow, option);
+    if (presents_on_vsync) {
+        sim.set_frame_listener([&](int, const FrameRate&) {
+            const float period = option.VsyncPeriod;
+            const float limited = std::ceil(sim.get_limiter().interval() / period - 0.001f) * period;
+            expected_intervals.push_back(std::max(period, limited));
+        });
+    }
+    sim.run_frames(ensemble.WarmupFrameCount + ensemble.FrameCount);
+
+    const auto& framerates = sim.get_framerates();
+    for (size_t i = std::max(1, ensemble.WarmupFrameCount); i < framerates.size(); i++) {
+        result.frame_times.push_back(framerates[i].duration);
+        result.latencies.push_back(framerates[i].latency);
+        if (presents_on_vsync && framerates[i].duration > expected_intervals[i] * 1.001f) {
+            result.missed_vsync += 1;
+        }
+    }
+
+    return result;
+}
+
+float percentile(std::vector<float>& samples, float p)
+{
+    if (samples.empty()) {
+        return 0.f;
+    }
+    size_t rank = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+}
+
+// The frames of a run are correlated, so the confidence interval is a bootstrap over whole runs
+EnsembleMetric aggregate(const std::vector<RunResult>& runs, std::vector<float> RunResult::* field, const EnsembleOption& ensemble)
+{
+    const float ps[] = { 0.5f, 0.9f, 0.99f, 0.999f };
+    PercentileEstimate* estimates[4];
+
+    EnsembleMetric metric;
+    estimates[0] = &metric.p50;
+    estimates[1] = &metric.p90;
+    estimates[2] = &metric.p99;
+    estimates[3] = &metric.p999;
+
+    std::vector<float> samples;
+    for (const auto& r : runs) {
+        samples.insert(samples.end(), (r.*field).begin(), (r.*field).end());
+    }
+    for (float s : samples) {
+        metric.mean += s / samples.size();
+    }
+    for (int p = 0; p < 4; p++) {
+        estimates[p]->value = percentile(samples, ps[p]);
+    }
+
+    std::vector<std::vector<float>> resampled(4);
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<int> pick(0, (int)runs.size() - 1);
+    for (int b = 0; b < ensemble.BootstrapCount && !runs.empty(); b++) {
+        samples.clear();
+        for (size_t i = 0; i < runs.size(); i++) {
+            const auto& r = runs[pick(generator)];
+            samples.insert(samples.end(), (r.*field).begin(), (r.*field).end());
+        }
+        for (int p = 0; p < 4; p++) {
+            resampled[p].push_back(percentile(samples, ps[p]));
+        }
+    }
+    for (int p = 0; p < 4; p++) {
+        estimates[p]->low = resampled[p].empty() ? estimates[p]->value : percentile(resampled[p], 0.025f);
+        estimates[p]->high = resampled[p].empty() ? estimates[p]->value : percentile(resampled[p], 0.975f);
+    }
+
+    return metric;
+}
+
+PercentileEstimate aggregate_missed_vsync(const std::vector<RunResult>& runs, const EnsembleOption& ensemble)
+{
+    auto rate = [&](const std::vector<int>& indices) {
+        int missed = 0;
+        int total = 0;
+        for (int i : indices) {
+            missed += runs[i].missed_vsync;
+            total += (int)runs[i].frame_times.size();
+        }
+        return total > 0 ? float(missed) / total : 0.f;
+    };
+
+    std::vector<int> indices(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        indices[i] = (int)i;
+    }
+
+    PercentileEstimate estimate;
+    estimate.value = rate(indices);
+
+    std::vector<float> resampled;
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<int> pick(0, (int)runs.size() - 1);
+    for (int b = 0; b < ensemble.BootstrapCount && !runs.empty(); b++) {
+        for (auto& i : indices) {
+            i = pick(generator);
+        }
+        resampled.push_back(rate(indices));
+    }
+    estimate.low = resampled.empty() ? estimate.value : percentile(resampled, 0.025f);
+    estimate.high = resampled.empty() ? estimate.value : percentile(resampled, 0.975f);
+
+    return estimate;
+}
+
+std::string escape_json(const std::string& text)
+{
+    std::string result;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result;
+}
+
+void write_estimate(std::ostream& s, const char* name, const PercentileEstimate& e)
+{
+    s << "\"" << name << "\": { \"value\": " << e.value << ", \"low\": " << e.low << ", \"high\": " << e.high << " }";
+}
+
+void write_metric(std::ostream& s, const char* name, const EnsembleMetric& m)
+{
+    s << "  \"" << name << "\": {\n";
+    s << "    \"mean\": " << m.mean << ",\n";
+    s << "    "; write_estimate(s, "p50", m.p50); s << ",\n";
+    s << "    "; write_estimate(s, "p90", m.p90); s << ",\n";
+    s << "    "; write_estimate(s, "p99", m.p99); s << ",\n";
+    s << "    "; write_estimate(s, "p99.9", m.p999); s << "\n";
+    s << "  }";
+}
+
+}
+
+EnsembleReport run_ensemble(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const EnsembleOption& ensemble)
+{
+    auto begin = std::chrono::steady_clock::now();
+
+    // Results are stored by seed
+    std::vector<RunResult> runs(std::max(0, ensemble.RunCount));
+    const int thread_count = parallel_for(ensemble.RunCount, ensemble.ThreadCount, [&](int i) {
+        SimulationOption run_option = option;
+        run_option.Seed = option.Seed + i;
+        run_option.AutoSeed = false;
+        runs[i] = simulate_run(flow, run_option, ensemble);
+    });
+
+    EnsembleReport report;
+    report.flow_name = flow->name;
+    report.option = option;
+    report.run_count = (int)runs.size();
+    report.thread_count = thread_count;
+    for (const auto& r : runs) {
+        report.frame_count += (int)r.frame_times.size();
+    }
+    report.frame_time = aggregate(runs, &RunResult::frame_times, ensemble);
+    report.latency = aggregate(runs, &RunResult::latencies, ensemble);
+    report.has_missed_vsync = option.Vsync && flow->gpu_queue_count() > 0;
+    if (report.has_missed_vsync) {
+        report.missed_vsync_rate = aggregate_missed_vsync(runs, ensemble);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    report.duration_ms = std::chrono::duration<float, std::milli>(end - begin).count();
+
+    return report;
+}
+
+std::future<EnsembleReport> start_ensemble(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const EnsembleOption& ensemble)
+{
+    auto copy = std::make_shared<FrameFlow>(*flow);
+    for (auto& stage : copy->stages) {
+        stage = std::make_shared<FrameStage>(*stage);
+    }
+    return std::async(std::launch::async, [copy, option, ensemble]() {
+        return run_ensemble(copy, option, ensemble);
+    });
+}
+
+std::string EnsembleReport::to_json() const
+{
+    std::stringstream s;
+    s << "{\n";
+    s << "  \"flow\": \"" << escape_json(flow_name) << "\",\n";
+    s << "  \"core_count\": " << option.CoreNum << ",\n";
+    s << "  \"frame_pool_size\": " << option.FramePoolSize << ",\n";
+    s << "  \"random\": " << option.Random << ",\n";
+    s << "  \"first_seed\": " << option.Seed << ",\n";
+    s << "  \"vsync\": " << (option.Vsync ? "true" : "false") << ",\n";
+    s << "  \"vsync_period\": " << option.VsyncPeriod << ",\n";
+    s << "  \"run_count\": " << run_count << ",\n";
+    s << "  \"frame_count\": " << frame_count << ",\n";
+    write_metric(s, "frame_time", frame_time); s << ",\n";
+    write_metric(s, "latency", latency);
+    if (has_missed_vsync) {
+        s << ",\n  "; write_estimate(s, "missed_vsync_rate", missed_vsync_rate);
+    }
+    s << "\n";
+    s << "}\n";
+    return s.str();
+}
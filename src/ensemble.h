@@ -0,0 +1,58 @@
+#pragma once
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "visualizer.h"
+
+struct EnsembleOption
+{
+    int RunCount = 64;
+    int ThreadCount = 0;
+    int FrameCount = 300;
+    int WarmupFrameCount = 10;
+    int BootstrapCount = 200;
+};
+
+// Percentile with its 95% confidence interval
+struct PercentileEstimate
+{
+    float value = 0.f;
+    float low = 0.f;
+    float high = 0.f;
+};
+
+struct EnsembleMetric
+{
+    float mean = 0.f;
+    PercentileEstimate p50;
+    PercentileEstimate p90;
+    PercentileEstimate p99;
+    PercentileEstimate p999;
+};
+
+struct EnsembleReport
+{
+    std::string flow_name;
+    SimulationOption option;
+    int run_count = 0;
+    int thread_count = 0;
+    int frame_count = 0;
+    float duration_ms = 0.f;
+
+    EnsembleMetric frame_time;
+    EnsembleMetric latency;
+    // Only when the frames are presented on vsync, a frame missed it when shown for longer than the limited interval
+    bool has_missed_vsync = false;
+    PercentileEstimate missed_vsync_rate;
+
+    std::string to_json() const;
+};
+
+// Simulate the flow with RunCount consecutive seeds starting at option.Seed.
+// Every run only depends on its seed so the report does not depend on the thread count.
+EnsembleReport run_ensemble(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const EnsembleOption& ensemble);
+// Runs the ensemble on a worker thread over a copy of the flow, so the flow can be edited meanwhile
+std::future<EnsembleReport> start_ensemble(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const EnsembleOption& ensemble);
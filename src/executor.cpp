@@ -0,0 +1,529 @@
+#include "executor.h"
+
+#include "fiber.h"
+#include "job_system.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint64_t CalibrationIterations = 1 << 18;
+constexpr int CalibrationCount = 8;
+// The run stops when no job started or completed for this many vsync periods
+constexpr int StallVsyncCount = 60;
+constexpr int FiberSwitchCount = 1 << 20;
+
+// Dependent xorshift steps, the compiler can neither vectorize nor skip them
+uint64_t busy_work(uint64_t iterations, uint64_t state)
+{
+    for (uint64_t i = 0; i < iterations; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+    }
+    return state;
+}
+
+bool pin_thread(std::thread& thread, int cpu)
+{
+#if defined(_WIN32)
+    return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+class Execution
+{
+public:
+    Execution(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const ExecutionOption& execution)
+        : m_simulator(std::make_shared<Simulator>(flow, option))
+        , m_flow(flow)
+        , m_option(option)
+        , m_execution(execution)
+        , m_wait(execution.Wait == WaitMode::Fiber && !FibersSupported ? WaitMode::Block : execution.Wait)
+        , m_unit_us(execution.VsyncMs * 1000.0 / option.VsyncPeriod)
+        , m_stall_time(std::chrono::microseconds((int64_t)(StallVsyncCount * execution.VsyncMs * 1000.0)))
+    {}
+
+    ExecutionReport run()
+    {
+        ExecutionReport report;
+        report.timeline = m_simulator;
+
+        // Best of a few runs, the first ones also wake the core up
+        uint64_t state = 1;
+        for (int i = 0; i < CalibrationCount; i++) {
+            auto start = Clock::now();
+            state = busy_work(CalibrationIterations, state);
+            double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            m_iterations_per_us = std::max(m_iterations_per_us, CalibrationIterations / std::max(us, 1e-3));
+        }
+        m_sink += state;
+
+        // Same lanes as the simulation: the cores, the gpu queues then the display
+        const int gpu_queue_count = m_flow->gpu_queue_count();
+        const int lane_count = m_option.CoreNum + gpu_queue_count + (gpu_queue_count > 0 ? 1 : 0);
+        m_cores.resize(lane_count);
+        for (int i = 0; i < lane_count; i++) {
+            m_cores[i].index = i;
+            if (i >= m_option.CoreNum + gpu_queue_count) {
+                m_cores[i].lane = Lane::Display;
+            } else if (i >= m_option.CoreNum) {
+                m_cores[i].lane = Lane::Gpu;
+                m_cores[i].queue = i - m_option.CoreNum;
+            }
+        }
+        m_idle_core_count = m_option.CoreNum;
+        for (int i = 0; i < m_option.CoreNum; i++) {
+            m_states.push_back(i + 1);
+        }
+        m_contexts.resize(m_option.CoreNum);
+
+        if (m_wait == WaitMode::Fiber) {
+            m_simulator->set_stage_listener([this](int frame_index, int stage_tag) { finish_stage(frame_index, stage_tag); });
+        }
+        while (m_simulator->start_requested_frame()) {
+        }
+
+        m_held.resize(lane_count);
+        m_start = Clock::now();
+        m_deadline = m_start + std::chrono::milliseconds(m_execution.TimeoutMs);
+        m_last_progress = m_start;
+
+        // The cores are the workers of a job system and only they are pinned, the gpu
+        // and display lanes stand for other devices and keep a thread each
+        m_jobs = make_aligned<JobSystem>(m_option.CoreNum);
+        const int cpu_count = std::max(1, (int)std::thread::hardware_concurrency());
+        for (int i = 0; i < m_jobs->thread_count(); i++) {
+            if (m_execution.PinThreads && pin_thread(m_jobs->thread(i), i % cpu_count)) {
+                report.pinned_thread_count += 1;
+            }
+        }
+        std::vector<std::thread> threads;
+        for (const Core& core : m_cores) {
+            if (core.lane != Lane::Cpu) {
+                threads.emplace_back([this, core]() { worker(core); });
+            }
+        }
+
+        // This thread watches for the stall and the deadline
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            dispatch();
+            while (!m_stop) {
+                wait(lock);
+            }
+        }
+        report.thread_count = m_jobs->thread_count() + (int)threads.size();
+        // The tasks still queued see the stop and return
+        m_jobs.reset();
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (uint64_t state : m_states) {
+            m_sink += state;
+        }
+
+        const float duration = now();
+        m_simulator->set_stage_listener(nullptr);
+        m_simulator->freeze(m_flow->name);
+        m_simulator->set_name(std::string("Measured ") + m_flow->name + " (Core = " + std::to_string(m_option.CoreNum) + ", Frame Pool = " + std::to_string(m_option.FramePoolSize) + ")");
+
+        report.frame_count = (int)m_simulator->get_framerates().size();
+        report.duration_ms = std::chrono::duration<float, std::milli>(Clock::now() - m_start).count();
+        report.iterations_per_us = (float)m_iterations_per_us;
+        report.mean_overrun = m_job_count > 0 ? (float)(m_overrun_sum / m_job_count) : 0.f;
+        report.max_overrun = m_max_overrun;
+        report.wait = m_wait;
+        report.cpu_utilization = duration > 0.f ? (float)(m_cpu_busy_time / (duration * m_option.CoreNum)) : 0.f;
+        if (m_wait == WaitMode::Fiber) {
+            report.fiber_count = (int)m_fiber_pool.allocated_count();
+            report.fiber_switch_ns = measure_fiber_switch_ns(FiberSwitchCount);
+            report.fiber_wait_ns = measure_fiber_wait_ns(FiberSwitchCount);
+        }
+        report.timed_out = m_timed_out;
+        report.stall = m_stall;
+        return report;
+    }
+
+private:
+    float now() const
+    {
+        return (float)(std::chrono::duration<double, std::micro>(Clock::now() - m_start).count() / m_unit_us);
+    }
+
+    // Thread of a gpu queue or of the display, they only take ready jobs
+    void worker(const Core& core)
+    {
+        uint64_t state = core.index + 1;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            while (!m_stop && !m_simulator->has_ready_job(core)) {
+                wait(lock);
+            }
+            if (m_stop) {
+                break;
+            }
+
+            std::shared_ptr<Job> job = m_simulator->pop_job(core, true);
+            m_last_progress = Clock::now();
+
+            // Like a simulated lane, the lane holds the job until it can complete
+            execute(core, job, lock, state, [&]() {
+                m_held[core.index] = job;
+                wait(lock);
+            });
+            m_held[core.index] = nullptr;
+        }
+
+        m_sink += state;
+    }
+
+    // Hands the jobs the idle cores would take to the job system, called with the mutex held
+    void dispatch()
+    {
+        // The cores accept the same jobs, a blocking or fiber core also takes the jobs which wait for the previous frame
+        const Core& core = m_cores[0];
+        const bool ready_only = m_wait == WaitMode::Queue;
+        while (!m_stop && m_idle_core_count > 0) {
+            const bool resume = !m_resumed.empty();
+            if (!resume && !(ready_only ? m_simulator->has_ready_job(core) : m_simulator->has_job(core))) {
+                break;
+            }
+
+            std::unique_ptr<CoreTask> task(new CoreTask());
+            task->task.function = run_core_task;
+            task->task.data = task.get();
+            task->execution = this;
+            if (resume) {
+                task->fiber_task = static_cast<FiberTask*>(m_resumed.front()->data());
+                m_resumed.pop_front();
+            } else {
+                task->job = m_simulator->pop_job(core, ready_only);
+                m_last_progress = Clock::now();
+            }
+            m_idle_core_count -= 1;
+            m_jobs->submit(&task.release()->task);
+        }
+    }
+
+    // Runs on the worker of the core which takes the task
+    static void run_core_task(void* data)
+    {
+        std::unique_ptr<CoreTask> task(static_cast<CoreTask*>(data));
+        Execution& e = *task->execution;
+
+        // The job system is being destroyed once the run stopped
+        std::unique_lock<std::mutex> lock(e.m_mutex);
+        if (e.m_stop) {
+            return;
+        }
+        const int worker = e.m_jobs->worker_index();
+        assert(worker >= 0);
+        if (e.m_wait == WaitMode::Fiber) {
+            e.run_fiber_task(worker, task->job, task->fiber_task);
+        } else {
+            e.run_job(e.m_cores[worker], task->job, lock, e.m_states[worker]);
+        }
+        e.m_idle_core_count += 1;
+        e.dispatch();
+    }
+
+    void run_job(const Core& core, const std::shared_ptr<Job>& job, std::unique_lock<std::mutex>& lock, uint64_t& state)
+    {
+        // A blocking core waits for the previous frame on its thread
+        while (!m_stop && !job->is_ready()) {
+            m_held[core.index] = job;
+            wait(lock);
+        }
+
+        // Like a simulated core, the core holds the job until it can complete
+        execute(core, job, lock, state, [&]() {
+            m_held[core.index] = job;
+            wait(lock);
+        });
+        m_held[core.index] = nullptr;
+    }
+
+    // Runs the job then completes it, calls wait_for_change while it can not complete
+    template <class Wait>
+    void execute(const Core& core, const std::shared_ptr<Job>& job, std::unique_lock<std::mutex>& lock, uint64_t& state, Wait&& wait_for_change)
+    {
+        if (m_stop) {
+            return;
+        }
+
+        const float start = now();
+        job->before_schedule(start);
+        const float duration = job->duration();
+        lock.unlock();
+
+        // The display waits for the flip, the other lanes work
+        if (core.lane == Lane::Display) {
+            std::this_thread::sleep_until(m_start + std::chrono::microseconds((int64_t)((start + duration) * m_unit_us)));
+        } else {
+            state = busy_work((uint64_t)(duration * m_unit_us * m_iterations_per_us), state);
+        }
+        const float end = now();
+
+        lock.lock();
+        m_simulator->record_timebox(core, *job, start, end - start);
+        if (core.lane != Lane::Display) {
+            m_overrun_sum += end - start - duration;
+            m_max_overrun = std::max(m_max_overrun, end - start - duration);
+            m_job_count += 1;
+        }
+        if (core.lane == Lane::Cpu) {
+            m_cpu_busy_time += end - start;
+        }
+
+        while (!m_stop && !job->try_exec(core.lane == Lane::Display ? end : now())) {
+            wait_for_change();
+        }
+        m_last_progress = Clock::now();
+        while (m_simulator->start_requested_frame()) {
+        }
+        if ((int)m_simulator->get_framerates().size() >= m_execution.FrameCount) {
+            stop();
+        }
+
+        // The fibers which could not complete try again
+        m_resumed.insert(m_resumed.end(), m_retry.begin(), m_retry.end());
+        m_retry.clear();
+        dispatch();
+        m_condition.notify_all();
+    }
+
+    struct FiberTask
+    {
+        Execution* execution = nullptr;
+        std::shared_ptr<Job> job;
+        Fiber* fiber = nullptr;
+        // Set by the worker which switches to the fiber
+        const Core* core = nullptr;
+        FiberContext* worker = nullptr;
+        uint64_t* state = nullptr;
+        bool done = false;
+    };
+
+    // A job or a suspended fiber handed to the job system, deleted by the worker which runs it
+    struct CoreTask
+    {
+        JobSystem::Task task;
+        Execution* execution = nullptr;
+        std::shared_ptr<Job> job;
+        // Resumed instead of starting the job on a new fiber
+        FiberTask* fiber_task = nullptr;
+    };
+
+    // The mutex stays locked across the switches between a worker and its fibers,
+    // so that a fiber is never resumed before it is done switching away
+    void run_fiber_task(int worker, const std::shared_ptr<Job>& job, FiberTask* task)
+    {
+        if (!task) {
+            std::unique_ptr<FiberTask> created(new FiberTask());
+            created->execution = this;
+            created->job = job;
+            created->fiber = m_fiber_pool.acquire();
+            created->fiber->start(run_fiber, created.get());
+            task = created.get();
+            m_fiber_tasks.emplace(task, std::move(created));
+        }
+
+        task->core = &m_cores[worker];
+        task->worker = &m_contexts[worker];
+        task->state = &m_states[worker];
+        switch_fiber(m_contexts[worker], task->fiber->context());
+
+        if (task->done) {
+            m_fiber_pool.release(task->fiber);
+            m_fiber_tasks.erase(task);
+        }
+    }
+
+    static void run_fiber(void* data)
+    {
+        FiberTask& task = *static_cast<FiberTask*>(data);
+        Execution& e = *task.execution;
+
+        // Adopt the mutex the worker holds, and hand it back on each switch
+        std::unique_lock<std::mutex> lock(e.m_mutex, std::adopt_lock);
+        auto suspend = [&]() {
+            lock.release();
+            switch_fiber(task.fiber->context(), *task.worker);
+            lock = std::unique_lock<std::mutex>(e.m_mutex, std::adopt_lock);
+        };
+
+        // Waits for the previous frame without blocking the worker
+        WaitableCounter* counter = e.wait_counter(*task.job);
+        if (counter && counter->add_waiter(task.fiber)) {
+            suspend();
+        }
+
+        e.execute(*task.core, task.job, lock, *task.state, [&]() {
+            e.m_retry.push_back(task.fiber);
+            suspend();
+        });
+
+        task.done = true;
+        lock.release();
+        switch_fiber(task.fiber->context(), *task.worker);
+    }
+
+    // Counter of the previous frame stage the job waits for, nullptr when it does not wait
+    WaitableCounter* wait_counter(const Job& job)
+    {
+        if (job.stage_index() < 0 || job.frame_index() <= 0) {
+            return nullptr;
+        }
+        const FrameStage& stage = *m_flow->stages[job.stage_index()];
+        return stage.wait ? &stage_counter(job.frame_index() - 1, stage.wait_tag) : nullptr;
+    }
+
+    WaitableCounter& stage_counter(int frame_index, int stage_tag)
+    {
+        auto& counter = m_stage_counters[std::make_pair(frame_index, stage_tag)];
+        if (!counter) {
+            counter.reset(new WaitableCounter(m_flow->count_stage(stage_tag)));
+        }
+        return *counter;
+    }
+
+    // Called by the simulator with the mutex held
+    void finish_stage(int frame_index, int stage_tag)
+    {
+        std::vector<Fiber*> resumed;
+        stage_counter(frame_index, stage_tag).release(resumed);
+        m_resumed.insert(m_resumed.end(), resumed.begin(), resumed.end());
+
+        // Only the next frame waits for this one, older counters are done
+        while (!m_stage_counters.empty() && m_stage_counters.begin()->first.first < frame_index - 2 * m_option.FramePoolSize) {
+            m_stage_counters.erase(m_stage_counters.begin());
+        }
+    }
+
+    // Waits for another lane to change the state, stops the run when it takes too long
+    void wait(std::unique_lock<std::mutex>& lock)
+    {
+        if (m_condition.wait_until(lock, std::min(m_deadline, m_last_progress + m_stall_time)) == std::cv_status::no_timeout || m_stop) {
+            return;
+        }
+
+        auto time = Clock::now();
+        if (time >= m_deadline) {
+            m_timed_out = true;
+            stop();
+        } else if (time >= m_last_progress + m_stall_time) {
+            // The jobs the cores can not complete tell why nothing runs
+            for (size_t i = 0; i < m_held.size(); i++) {
+                if (m_held[i]) {
+                    m_stall += m_simulator->lane_name((int)i) + " holds " + held_reason(*m_held[i]);
+                }
+            }
+            for (const auto& task : m_fiber_tasks) {
+                m_stall += "A fiber holds " + held_reason(*task.second->job);
+            }
+            if (m_stall.empty()) {
+                m_stall = "No job is ready\n";
+            }
+            stop();
+        }
+    }
+
+    std::string held_reason(const Job& job) const
+    {
+        const char* reason = !job.is_ready() ? "previous frame" : m_simulator->frame_pool_empty() ? "frame pool empty" : "frames in flight";
+        return std::string(job.name()) + " of frame " + std::to_string(job.frame_index()) + " (" + reason + ")\n";
+    }
+
+    // Called with the mutex held
+    void stop()
+    {
+        m_stop = true;
+        m_condition.notify_all();
+    }
+
+    std::shared_ptr<Simulator> m_simulator;
+    std::shared_ptr<FrameFlow> m_flow;
+    SimulationOption m_option;
+    ExecutionOption m_execution;
+    const WaitMode m_wait;
+    const double m_unit_us;
+    const Clock::duration m_stall_time;
+    double m_iterations_per_us = 0.0;
+
+    Clock::time_point m_start;
+    Clock::time_point m_deadline;
+    Clock::time_point m_last_progress;
+
+    // Workers of the cores, a job is submitted for each idle core
+    AlignedPtr<JobSystem> m_jobs;
+    std::vector<Core> m_cores;
+    int m_idle_core_count = 0;
+    // Kernel state and scheduler context of each worker
+    std::vector<uint64_t> m_states;
+    std::vector<FiberContext> m_contexts;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+    bool m_timed_out = false;
+    std::string m_stall;
+    // Job each core executed but can not complete yet
+    std::vector<std::shared_ptr<Job>> m_held;
+    double m_overrun_sum = 0.0;
+    float m_max_overrun = 0.f;
+    int m_job_count = 0;
+    double m_cpu_busy_time = 0.0;
+
+    FiberPool m_fiber_pool;
+    std::unordered_map<FiberTask*, std::unique_ptr<FiberTask>> m_fiber_tasks;
+    // Fibers any core may continue
+    std::deque<Fiber*> m_resumed;
+    // Fibers which executed their job but could not complete it, they try again after the next completion
+    std::vector<Fiber*> m_retry;
+    std::map<std::pair<int, int>, std::unique_ptr<WaitableCounter>> m_stage_counters;
+    std::atomic<uint64_t> m_sink{ 0 };
+};
+
+}
+
+const char* wait_mode_name(WaitMode mode)
+{
+    switch (mode) {
+    case WaitMode::Queue: return "Queue";
+    case WaitMode::Block: return "Block";
+    case WaitMode::Fiber: return "Fiber";
+    }
+    return "";
+}
+
+ExecutionReport run_execution(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const ExecutionOption& execution)
+{
+    Execution run(flow, option, execution);
+    return run.run();
+}
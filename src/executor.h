@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "visualizer.h"
+
+// How a core waits for the previous frame or for a job it can not complete yet
+enum class WaitMode
+{
+    // Only ready jobs are taken, a core holds a job it can not complete
+    Queue,
+    // The next job is taken even when it waits, the thread blocks until it can run
+    Block,
+    // The job suspends its fiber and the core continues another job
+    Fiber,
+};
+
+const char* wait_mode_name(WaitMode mode);
+
+struct ExecutionOption
+{
+    int FrameCount = 60;
+    // Real duration of SimulationOption::VsyncPeriod
+    float VsyncMs = 16.667f;
+    bool PinThreads = true;
+    int TimeoutMs = 10000;
+    // Applies to the cores, the gpu and display lanes always queue
+    WaitMode Wait = WaitMode::Queue;
+};
+
+struct ExecutionReport
+{
+    // Measured timeline in simulation units, frozen once the run is over
+    std::shared_ptr<Simulator> timeline;
+    int frame_count = 0;
+    int thread_count = 0;
+    int pinned_thread_count = 0;
+    float duration_ms = 0.f;
+    float iterations_per_us = 0.f;
+    // Measured minus requested duration of the cpu and gpu jobs, in simulation units
+    float mean_overrun = 0.f;
+    float max_overrun = 0.f;
+    // Blocking is used instead of fibers where they are not supported
+    WaitMode wait = WaitMode::Queue;
+    // Time the cores spent in job kernels over the time they were available
+    float cpu_utilization = 0.f;
+    int fiber_count = 0;
+    // Nanoseconds of a switch to a fiber and back, measured after the run
+    float fiber_switch_ns = 0.f;
+    // Nanoseconds of a fiber suspending on a counter until it is released and resumed
+    float fiber_wait_ns = 0.f;
+    bool timed_out = false;
+    // Why the lanes stopped making progress, one line per blocked core, empty when they did not
+    std::string stall;
+};
+
+// Execute the flow with the cores as the workers of a JobSystem and one thread per gpu
+// queue and display lane. The jobs are
+// the jobs of a simulation, they spin a calibrated kernel for their duration and
+// complete through Job::try_exec, so splits, wait tags, the frame pool and the
+// generation of the next frame behave as simulated. Pacing is not applied.
+ExecutionReport run_execution(std::shared_ptr<FrameFlow> flow, const SimulationOption& option, const ExecutionOption& execution);
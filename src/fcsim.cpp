@@ -0,0 +1,307 @@
+#include "fcsim.h"
+#include "fcsim_c.h"
+
+#include "app.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Built once, the app is never initialized by the library
+const std::vector<std::shared_ptr<FrameFlow>>& builtin_flows()
+{
+    static const std::vector<std::shared_ptr<FrameFlow>> flows = create_builtin_flows();
+    return flows;
+}
+
+float mean(const float* values, int count)
+{
+    float sum = 0.f;
+    for (int i = 0; i < count; i++) {
+        sum += values[i];
+    }
+    return sum / count;
+}
+
+}
+
+namespace fcsim {
+
+std::vector<std::string> flow_names()
+{
+    std::vector<std::string> names;
+    for (const auto& flow : builtin_flows()) {
+        names.push_back(flow->name);
+    }
+    return names;
+}
+
+std::shared_ptr<FrameFlow> find_flow(const std::string& name)
+{
+    for (const auto& flow : builtin_flows()) {
+        if (name == flow->name) {
+            return flow;
+        }
+    }
+    return nullptr;
+}
+
+Session::Session(std::shared_ptr<FrameFlow> flow, const SimulationOption& option)
+{
+    m_simulator.reset(new Simulator(flow, option));
+    m_simulator->set_frame_listener([this](int frame_index, const FrameRate& rate) {
+        m_presented_frame_count += 1;
+        if (m_steady_state_run) {
+            m_intervals.push_back(rate.duration);
+        }
+        if (m_callback) {
+            m_callback(frame_index, rate);
+        }
+    });
+}
+
+void Session::set_frame_callback(std::function<void(int frame_index, const FrameRate& rate)> callback)
+{
+    m_callback = callback;
+}
+
+void Session::set_keep_results(bool keep)
+{
+    m_keep_results = keep;
+}
+
+bool Session::step()
+{
+    // Steps until the next frame is presented
+    return m_simulator->run_frames(1, MaxStepsPerFrame, !m_keep_results) > 0;
+}
+
+int Session::run_frames(int count)
+{
+    const int first = m_presented_frame_count;
+    while (m_presented_frame_count - first < count && step()) {
+    }
+    return m_presented_frame_count - first;
+}
+
+bool Session::run_to_steady_state(const SteadyStateOption& option)
+{
+    const int window = std::max(1, option.WindowFrameCount);
+    m_intervals.clear();
+    m_steady_state_run = true;
+
+    bool steady = false;
+    while (!steady && (int)m_intervals.size() < option.MaxFrameCount && step()) {
+        const int count = (int)m_intervals.size();
+        if (count >= 2 * window) {
+            const float last = mean(m_intervals.data() + count - window, window);
+            const float previous = mean(m_intervals.data() + count - 2 * window, window);
+            steady = std::abs(last - previous) <= option.Tolerance * std::abs(previous);
+        }
+    }
+    m_intervals.clear();
+    m_steady_state_run = false;
+    return steady;
+}
+
+}
+
+struct fcsim_flow
+{
+    std::shared_ptr<FrameFlow> builtin;
+    std::unique_ptr<FlowScript> script;
+};
+
+struct fcsim_session
+{
+    std::unique_ptr<fcsim::Session> session;
+    fcsim_frame_callback callback = nullptr;
+    void* user = nullptr;
+};
+
+static_assert(sizeof(fcsim_frame) == sizeof(FrameRate), "fcsim_frame is read in place of FrameRate");
+static_assert(offsetof(fcsim_frame, present_time) == offsetof(FrameRate, timestamp), "fcsim_frame is read in place of FrameRate");
+static_assert(offsetof(fcsim_frame, interval) == offsetof(FrameRate, duration), "fcsim_frame is read in place of FrameRate");
+static_assert(offsetof(fcsim_frame, latency) == offsetof(FrameRate, latency), "fcsim_frame is read in place of FrameRate");
+
+int fcsim_api_version(void)
+{
+    return fcsim::ApiVersion;
+}
+
+fcsim_flow* fcsim_flow_find(const char* name)
+{
+    auto flow = fcsim::find_flow(name);
+    if (!flow) {
+        return nullptr;
+    }
+    fcsim_flow* f = new fcsim_flow();
+    f->builtin = flow;
+    return f;
+}
+
+fcsim_flow* fcsim_flow_create(const char* name)
+{
+    fcsim_flow* f = new fcsim_flow();
+    f->script.reset(new FlowScript(name));
+    return f;
+}
+
+void fcsim_flow_group(fcsim_flow* flow, const char* group)
+{
+    flow->script->group(group);
+}
+
+void fcsim_flow_stage(fcsim_flow* flow, const char* stage, float weight)
+{
+    flow->script->stage(stage, weight);
+}
+
+void fcsim_flow_parallel_for(fcsim_flow* flow, int count)
+{
+    flow->script->parallel_for(count);
+}
+
+void fcsim_flow_previous_frame(fcsim_flow* flow, const char* group)
+{
+    flow->script->previous_frame(group);
+}
+
+void fcsim_flow_next_frame_slot(fcsim_flow* flow)
+{
+    flow->script->next_frame_slot();
+}
+
+void fcsim_flow_gpu(fcsim_flow* flow, int queue)
+{
+    flow->script->gpu(queue);
+}
+
+void fcsim_flow_destroy(fcsim_flow* flow)
+{
+    delete flow;
+}
+
+void fcsim_option_init(fcsim_option* option)
+{
+    SimulationOption o;
+    *option = fcsim_option();
+    option->size = sizeof(fcsim_option);
+    option->core_count = o.CoreNum;
+    option->frame_pool_size = o.FramePoolSize;
+    option->random = o.Random;
+    option->seed = o.Seed;
+    option->vsync = o.Vsync ? 1 : 0;
+    option->vsync_period = o.VsyncPeriod;
+    option->max_frames_in_flight = o.MaxFramesInFlight;
+    option->core_speed = o.CoreSpeed;
+    option->dispatch_overhead = o.DispatchOverhead;
+    option->wakeup_latency = o.WakeupLatency;
+}
+
+fcsim_session* fcsim_session_create(const fcsim_flow* flow, const fcsim_option* option)
+{
+    auto frame_flow = flow->builtin ? flow->builtin : flow->script->build();
+    if (frame_flow->stages.empty()) {
+        return nullptr;
+    }
+
+    // Fields past the size of the caller's struct keep their default
+    SimulationOption o;
+    if (option) {
+        auto read = [&](const auto& field, auto& value) {
+            if (option->size >= (size_t)((const char*)&field - (const char*)option) + sizeof(field)) {
+                value = field;
+            }
+        };
+        read(option->core_count, o.CoreNum);
+        read(option->frame_pool_size, o.FramePoolSize);
+        read(option->random, o.Random);
+        read(option->seed, o.Seed);
+        int vsync = o.Vsync ? 1 : 0;
+        read(option->vsync, vsync);
+        o.Vsync = vsync != 0;
+        read(option->vsync_period, o.VsyncPeriod);
+        read(option->max_frames_in_flight, o.MaxFramesInFlight);
+        read(option->core_speed, o.CoreSpeed);
+        read(option->dispatch_overhead, o.DispatchOverhead);
+        read(option->wakeup_latency, o.WakeupLatency);
+    }
+
+    fcsim_session* s = new fcsim_session();
+    s->session.reset(new fcsim::Session(frame_flow, o));
+    return s;
+}
+
+void fcsim_session_destroy(fcsim_session* session)
+{
+    delete session;
+}
+
+void fcsim_session_set_frame_callback(fcsim_session* session, fcsim_frame_callback callback, void* user)
+{
+    session->callback = callback;
+    session->user = user;
+    if (!callback) {
+        session->session->set_frame_callback(nullptr);
+        return;
+    }
+    session->session->set_frame_callback([session](int frame_index, const FrameRate& rate) {
+        session->callback(session->user, frame_index, reinterpret_cast<const fcsim_frame*>(&rate));
+    });
+}
+
+void fcsim_session_set_keep_results(fcsim_session* session, int keep)
+{
+    session->session->set_keep_results(keep != 0);
+}
+
+int fcsim_session_run_frames(fcsim_session* session, int count)
+{
+    return session->session->run_frames(count);
+}
+
+int fcsim_session_run_to_steady_state(fcsim_session* session, int window_frame_count, float tolerance, int max_frame_count)
+{
+    fcsim::SteadyStateOption option;
+    option.WindowFrameCount = window_frame_count;
+    option.Tolerance = tolerance;
+    option.MaxFrameCount = max_frame_count;
+    return session->session->run_to_steady_state(option) ? 1 : 0;
+}
+
+const fcsim_frame* fcsim_session_frames(const fcsim_session* session, size_t* count)
+{
+    auto frames = session->session->frames();
+    *count = frames.size();
+    return reinterpret_cast<const fcsim_frame*>(frames.data());
+}
+
+size_t fcsim_session_timebox_count(const fcsim_session* session)
+{
+    return session->session->timeboxes().size();
+}
+
+int fcsim_session_timebox(const fcsim_session* session, size_t index, fcsim_timebox* timebox)
+{
+    auto timeboxes = session->session->timeboxes();
+    if (index >= timeboxes.size()) {
+        return 0;
+    }
+    const TimeBox& t = timeboxes[index];
+    timebox->lane = t.core_index;
+    timebox->frame = t.frame;
+    timebox->stage = t.stage;
+    timebox->type = (int)t.type;
+    timebox->start = t.raw_start();
+    timebox->end = t.raw_end();
+    timebox->name = t.name.c_str();
+    timebox->color = t.color;
+    return 1;
+}
+
+void fcsim_session_discard_results(fcsim_session* session)
+{
+    session->session->discard_results();
+}
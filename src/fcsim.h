@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "visualizer.h"
+#include "flow_script.h"
+
+// The scheduler model without the window, for tools which run it in batch:
+//
+//     auto flow = fcsim::find_flow("Realistic Jobification");
+//     fcsim::Session session(flow, SimulationOption());
+//     session.set_frame_callback([&](int frame, const FrameRate& rate) { intervals.add(rate.duration); });
+//     session.set_keep_results(false);
+//     session.run_frames(10000);
+//
+// Flows are built with FlowScript. Results are read through spans over the arrays of
+// the simulator, valid until the next run or discard. fcsim_c.h is the C ABI over it.
+namespace fcsim {
+
+// Incremented when a declaration of this header or of fcsim_c.h changes
+constexpr int ApiVersion = 1;
+
+template <class T>
+class Span
+{
+public:
+    Span() = default;
+    Span(const T* data, size_t size) : m_data(data), m_size(size) {}
+    Span(const std::vector<T>& v) : m_data(v.data()), m_size(v.size()) {}
+
+    const T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+
+private:
+    const T* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// Names of the built-in flows of the application
+std::vector<std::string> flow_names();
+// Nullptr when no flow has the name
+std::shared_ptr<FrameFlow> find_flow(const std::string& name);
+
+struct SteadyStateOption
+{
+    // Steady once the mean interval of the last window differs from the one before by less than the tolerance, relative
+    int WindowFrameCount = 30;
+    float Tolerance = 0.01f;
+    int MaxFrameCount = 10000;
+};
+
+class Session
+{
+public:
+    Session(std::shared_ptr<FrameFlow> flow, const SimulationOption& option);
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // Called with every presented frame, the index it had and its present time, interval and latency
+    void set_frame_callback(std::function<void(int frame_index, const FrameRate& rate)> callback);
+    // Without results, the boxes and frames are discarded after each step and only the callback sees the frames
+    void set_keep_results(bool keep);
+
+    // Simulate until count more frames are presented, returns the frames presented.
+    // Less than count when the flow stops presenting frames.
+    int run_frames(int count);
+    // Simulate until the frame interval is steady, returns false when it never was within MaxFrameCount frames
+    bool run_to_steady_state(const SteadyStateOption& option);
+
+    // TimeBox and Simulator are types of the application, not of this API: they change
+    // without ApiVersion changing, the C ABI copies the boxes into fcsim_timebox instead
+    Span<TimeBox> timeboxes() const { return Span<TimeBox>(m_simulator->get_timeboxes()); }
+    Span<FrameRate> frames() const { return Span<FrameRate>(m_simulator->get_framerates()); }
+    int presented_frame_count() const { return m_presented_frame_count; }
+    const FrameStatistics& statistics() const { return m_simulator->get_statistics(); }
+    void discard_results() { m_simulator->discard_results(); }
+
+    // Unstable, see timeboxes()
+    Simulator& simulator() { return *m_simulator; }
+
+private:
+    // A step after which no frame was presented for this many steps per frame is a stall
+    static constexpr int MaxStepsPerFrame = 100000;
+
+    bool step();
+
+    std::unique_ptr<Simulator> m_simulator;
+    std::function<void(int frame_index, const FrameRate& rate)> m_callback;
+    bool m_keep_results = true;
+    int m_presented_frame_count = 0;
+    // Intervals of the frames presented by run_to_steady_state, kept even when the results are not
+    bool m_steady_state_run = false;
+    std::vector<float> m_intervals;
+};
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+/* C ABI over fcsim.h. Every handle is created and destroyed by the library, structs
+ * passed in start with their size so that fields are only ever appended. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct fcsim_flow fcsim_flow;
+typedef struct fcsim_session fcsim_session;
+
+int fcsim_api_version(void);
+
+/* Flows: a builtin flow of the application, or a script like FlowScript. The
+ * script calls only apply to a flow from fcsim_flow_create. */
+fcsim_flow* fcsim_flow_find(const char* name);
+fcsim_flow* fcsim_flow_create(const char* name);
+void fcsim_flow_group(fcsim_flow* flow, const char* group);
+void fcsim_flow_stage(fcsim_flow* flow, const char* stage, float weight);
+void fcsim_flow_parallel_for(fcsim_flow* flow, int count);
+void fcsim_flow_previous_frame(fcsim_flow* flow, const char* group);
+void fcsim_flow_next_frame_slot(fcsim_flow* flow);
+void fcsim_flow_gpu(fcsim_flow* flow, int queue);
+void fcsim_flow_destroy(fcsim_flow* flow);
+
+/* Times are in the units of vsync_period */
+typedef struct fcsim_option
+{
+    size_t size;
+    int core_count;
+    int frame_pool_size;
+    float random;
+    int seed;
+    int vsync;
+    float vsync_period;
+    int max_frames_in_flight;
+    float core_speed;
+    float dispatch_overhead;
+    float wakeup_latency;
+} fcsim_option;
+
+void fcsim_option_init(fcsim_option* option);
+
+/* Same layout as the frames of the simulator, read without a copy */
+typedef struct fcsim_frame
+{
+    float present_time;
+    float interval;
+    float latency;
+} fcsim_frame;
+
+typedef struct fcsim_timebox
+{
+    int lane;
+    int frame;
+    int stage;
+    /* 0 job, 1 first job of a frame, 2 job releasing the frame, 3 frame time */
+    int type;
+    float start;
+    float end;
+    /* Owned by the session, valid until the next run or discard */
+    const char* name;
+    uint32_t color;
+} fcsim_timebox;
+
+typedef void (*fcsim_frame_callback)(void* user, int frame_index, const fcsim_frame* frame);
+
+/* Returns NULL when the flow has no stage */
+fcsim_session* fcsim_session_create(const fcsim_flow* flow, const fcsim_option* option);
+void fcsim_session_destroy(fcsim_session* session);
+
+void fcsim_session_set_frame_callback(fcsim_session* session, fcsim_frame_callback callback, void* user);
+void fcsim_session_set_keep_results(fcsim_session* session, int keep);
+
+int fcsim_session_run_frames(fcsim_session* session, int count);
+/* Returns 1 once steady, 0 when max_frame_count frames were not enough */
+int fcsim_session_run_to_steady_state(fcsim_session* session, int window_frame_count, float tolerance, int max_frame_count);
+
+const fcsim_frame* fcsim_session_frames(const fcsim_session* session, size_t* count);
+size_t fcsim_session_timebox_count(const fcsim_session* session);
+/* Returns 0 when index is out of range */
+int fcsim_session_timebox(const fcsim_session* session, size_t index, fcsim_timebox* timebox);
+void fcsim_session_discard_results(fcsim_session* session);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,124 @@
+/* Runs the C ABI of libfcsim from C99, so that fcsim_c.h stays valid C and its
+ * functions keep working. The exit code is 1 when a check fails. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "fcsim_c.h"
+
+static int g_failure_count = 0;
+
+#define CHECK(condition)                                                   \
+    do {                                                                   \
+        if (!(condition)) {                                                \
+            printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition); \
+            g_failure_count += 1;                                          \
+        }                                                                  \
+    } while (0)
+
+typedef struct frame_sum
+{
+    int count;
+    double interval;
+} frame_sum;
+
+static void on_frame(void* user, int frame_index, const fcsim_frame* frame)
+{
+    frame_sum* sum = (frame_sum*)user;
+    (void)frame_index;
+    sum->count += 1;
+    sum->interval += frame->interval;
+}
+
+static fcsim_flow* create_flow(void)
+{
+    fcsim_flow* flow = fcsim_flow_create("C ABI");
+    fcsim_flow_group(flow, "Game");
+    fcsim_flow_stage(flow, "Simulate", 1.f);
+    fcsim_flow_parallel_for(flow, 4);
+    fcsim_flow_next_frame_slot(flow);
+    fcsim_flow_group(flow, "Render");
+    fcsim_flow_stage(flow, "Prepare", 1.f);
+    fcsim_flow_parallel_for(flow, 4);
+    fcsim_flow_previous_frame(flow, "Render");
+    return flow;
+}
+
+/* Frames and boxes are kept, then streamed through the callback only */
+static void test_run(void)
+{
+    fcsim_flow* flow = create_flow();
+    fcsim_option option;
+    fcsim_option_init(&option);
+    option.core_count = 4;
+    fcsim_session* session = fcsim_session_create(flow, &option);
+    CHECK(session != NULL);
+    if (!session) {
+        fcsim_flow_destroy(flow);
+        return;
+    }
+
+    frame_sum sum = { 0, 0.0 };
+    fcsim_session_set_frame_callback(session, on_frame, &sum);
+    CHECK(fcsim_session_run_frames(session, 100) == 100);
+    CHECK(sum.count == 100);
+    CHECK(sum.interval > 0.0);
+
+    size_t frame_count = 0;
+    const fcsim_frame* frames = fcsim_session_frames(session, &frame_count);
+    CHECK(frame_count == 100);
+    CHECK(frames != NULL && frames[frame_count - 1].present_time > frames[0].present_time);
+
+    const size_t timebox_count = fcsim_session_timebox_count(session);
+    fcsim_timebox timebox;
+    CHECK(timebox_count > 0);
+    CHECK(fcsim_session_timebox(session, 0, &timebox) == 1);
+    CHECK(timebox.name != NULL && timebox.end >= timebox.start);
+    CHECK(fcsim_session_timebox(session, timebox_count, &timebox) == 0);
+
+    fcsim_session_set_keep_results(session, 0);
+    CHECK(fcsim_session_run_frames(session, 10000) == 10000);
+    CHECK(sum.count == 10100);
+    fcsim_session_frames(session, &frame_count);
+    CHECK(frame_count == 0);
+    CHECK(fcsim_session_timebox_count(session) == 0);
+
+    CHECK(fcsim_session_run_to_steady_state(session, 30, 0.01f, 10000) == 1);
+
+    fcsim_session_destroy(session);
+    fcsim_flow_destroy(flow);
+}
+
+static void test_builtin_flow(void)
+{
+    CHECK(fcsim_flow_find("no such flow") == NULL);
+
+    fcsim_flow* flow = fcsim_flow_find("Realistic Jobification");
+    CHECK(flow != NULL);
+    if (!flow) {
+        return;
+    }
+
+    /* A caller built against an older header passes a shorter struct, the other fields keep their default */
+    fcsim_option option;
+    memset(&option, 0, sizeof(option));
+    option.size = offsetof(fcsim_option, core_count) + sizeof(option.core_count);
+    option.core_count = 2;
+    fcsim_session* session = fcsim_session_create(flow, &option);
+    CHECK(session != NULL);
+    if (session) {
+        CHECK(fcsim_session_run_frames(session, 50) == 50);
+        fcsim_session_destroy(session);
+    }
+    fcsim_flow_destroy(flow);
+}
+
+int main(void)
+{
+    CHECK(fcsim_api_version() == 1);
+    test_run();
+    test_builtin_flow();
+
+    printf("%d checks failed\n", g_failure_count);
+    return g_failure_count > 0 ? 1 : 0;
+}
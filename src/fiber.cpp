@@ -0,0 +1,286 @@
+#include "fiber.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#if defined(__linux__) && defined(__x86_64__)
+
+// Callee saved registers, then the SSE and x87 control words, are pushed on the
+// stack which is left. A new fiber returns into fc_fiber_start with the function
+// in r12 and its data in r13.
+asm(R"(
+.text
+.globl fc_fiber_switch
+.type fc_fiber_switch, @function
+fc_fiber_switch:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+.size fc_fiber_switch, .-fc_fiber_switch
+
+.globl fc_fiber_start
+.type fc_fiber_start, @function
+fc_fiber_start:
+    movq %r13, %rdi
+    callq *%r12
+    ud2
+.size fc_fiber_start, .-fc_fiber_start
+)");
+
+#elif defined(__linux__) && defined(__aarch64__)
+
+// x19 to x30 then d8 to d15 are saved in a 176 bytes frame. A new fiber returns
+// into fc_fiber_start with the function in x19 and its data in x20.
+asm(R"(
+.text
+.globl fc_fiber_switch
+.type fc_fiber_switch, %function
+fc_fiber_switch:
+    sub sp, sp, #176
+    stp x19, x20, [sp, #0]
+    stp x21, x22, [sp, #16]
+    stp x23, x24, [sp, #32]
+    stp x25, x26, [sp, #48]
+    stp x27, x28, [sp, #64]
+    stp x29, x30, [sp, #80]
+    stp d8, d9, [sp, #96]
+    stp d10, d11, [sp, #112]
+    stp d12, d13, [sp, #128]
+    stp d14, d15, [sp, #144]
+    mov x2, sp
+    str x2, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0]
+    ldp x21, x22, [sp, #16]
+    ldp x23, x24, [sp, #32]
+    ldp x25, x26, [sp, #48]
+    ldp x27, x28, [sp, #64]
+    ldp x29, x30, [sp, #80]
+    ldp d8, d9, [sp, #96]
+    ldp d10, d11, [sp, #112]
+    ldp d12, d13, [sp, #128]
+    ldp d14, d15, [sp, #144]
+    add sp, sp, #176
+    ret
+.size fc_fiber_switch, .-fc_fiber_switch
+
+.globl fc_fiber_start
+.type fc_fiber_start, %function
+fc_fiber_start:
+    mov x0, x20
+    blr x19
+    brk #0
+.size fc_fiber_start, .-fc_fiber_start
+)");
+
+#endif
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+extern "C" void fc_fiber_switch(void** from, void* to);
+extern "C" void fc_fiber_start();
+#endif
+
+void switch_fiber(FiberContext& from, const FiberContext& to)
+{
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+    fc_fiber_switch(&from.stack_pointer, to.stack_pointer);
+#else
+    abort();
+#endif
+}
+
+Fiber::Fiber(size_t stack_size)
+    : m_stack(new char[stack_size])
+    , m_stack_size(stack_size)
+{
+}
+
+void Fiber::start(Function function, void* data)
+{
+    m_data = data;
+
+    // The top of the stack is aligned like the stack of a new thread
+    void** sp = reinterpret_cast<void**>(reinterpret_cast<uintptr_t>(m_stack.get() + m_stack_size) & ~uintptr_t(15));
+
+#if defined(__linux__) && defined(__x86_64__)
+    *--sp = reinterpret_cast<void*>(fc_fiber_start);
+    *--sp = nullptr; // rbp
+    *--sp = nullptr; // rbx
+    *--sp = reinterpret_cast<void*>(function); // r12
+    *--sp = data; // r13
+    *--sp = nullptr; // r14
+    *--sp = nullptr; // r15
+    // Default mxcsr and x87 control word
+    *--sp = reinterpret_cast<void*>(uintptr_t(0x1F80) | (uintptr_t(0x037F) << 32));
+#elif defined(__linux__) && defined(__aarch64__)
+    sp -= 22;
+    memset(sp, 0, 22 * sizeof(void*));
+    sp[0] = reinterpret_cast<void*>(function); // x19
+    sp[1] = data; // x20
+    sp[11] = reinterpret_cast<void*>(fc_fiber_start); // x30
+#else
+    (void)function;
+#endif
+
+    m_context.stack_pointer = sp;
+}
+
+Fiber* FiberPool::acquire()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_free.empty()) {
+        Fiber* fiber = m_free.back();
+        m_free.pop_back();
+        return fiber;
+    }
+    m_fibers.emplace_back(new Fiber(m_stack_size));
+    return m_fibers.back().get();
+}
+
+void FiberPool::release(Fiber* fiber)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(fiber);
+}
+
+size_t FiberPool::allocated_count() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_fibers.size();
+}
+
+bool WaitableCounter::add_waiter(Fiber* fiber)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count <= 0) {
+        return false;
+    }
+    m_waiters.push_back(fiber);
+    return true;
+}
+
+void WaitableCounter::release(std::vector<Fiber*>& resumed)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_count -= 1;
+    if (m_count == 0) {
+        resumed.insert(resumed.end(), m_waiters.begin(), m_waiters.end());
+        m_waiters.clear();
+    }
+}
+
+int WaitableCounter::value() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_count;
+}
+
+namespace {
+
+struct PingPong
+{
+    FiberContext caller;
+    Fiber* fiber;
+};
+
+void pong(void* data)
+{
+    PingPong& p = *static_cast<PingPong*>(data);
+    while (true) {
+        switch_fiber(p.fiber->context(), p.caller);
+    }
+}
+
+}
+
+float measure_fiber_switch_ns(int switch_count)
+{
+    if (!FibersSupported || switch_count <= 0) {
+        return -1.f;
+    }
+
+    Fiber fiber(16 * 1024);
+    PingPong p;
+    p.fiber = &fiber;
+    fiber.start(pong, &p);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < switch_count; i++) {
+        switch_fiber(p.caller, fiber.context());
+    }
+    return std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count() / switch_count;
+}
+
+namespace {
+
+struct CounterWait
+{
+    FiberContext caller;
+    Fiber* fiber;
+    WaitableCounter* counter;
+};
+
+void wait_counter(void* data)
+{
+    CounterWait& w = *static_cast<CounterWait*>(data);
+    while (true) {
+        if (w.counter->add_waiter(w.fiber)) {
+            switch_fiber(w.fiber->context(), w.caller);
+        }
+    }
+}
+
+}
+
+float measure_fiber_wait_ns(int wait_count)
+{
+    if (!FibersSupported || wait_count <= 0) {
+        return -1.f;
+    }
+
+    Fiber fiber(16 * 1024);
+    CounterWait w;
+    w.fiber = &fiber;
+    fiber.start(wait_counter, &w);
+
+    std::vector<Fiber*> resumed;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < wait_count; i++) {
+        // A counter per wait, like a job waiting on its own dependencies
+        WaitableCounter counter(1);
+        w.counter = &counter;
+        switch_fiber(w.caller, fiber.context());
+        resumed.clear();
+        counter.release(resumed);
+        assert(resumed.size() == 1);
+    }
+    const float ns = std::chrono::duration<float, std::nano>(std::chrono::steady_clock::now() - start).count() / wait_count;
+
+    // Leave the fiber on a live counter, it is not resumed again
+    WaitableCounter last(1);
+    w.counter = &last;
+    switch_fiber(w.caller, fiber.context());
+    return ns;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Context switches are written for the System V x86-64 and the AArch64 calling conventions
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+constexpr bool FibersSupported = true;
+#else
+constexpr bool FibersSupported = false;
+#endif
+
+constexpr size_t DefaultFiberStackSize = 256 * 1024;
+
+struct FiberContext
+{
+    void* stack_pointer = nullptr;
+};
+
+// Saves the running context in from then continues to. Returns when another
+// switch continues from.
+void switch_fiber(FiberContext& from, const FiberContext& to);
+
+// Stack and saved context of a function which runs until it switches away.
+// The function must never return, it switches away one last time instead.
+class Fiber
+{
+public:
+    using Function = void (*)(void* data);
+
+    explicit Fiber(size_t stack_size = DefaultFiberStackSize);
+
+    Fiber(const Fiber&) = delete;
+    Fiber& operator=(const Fiber&) = delete;
+
+    // The next switch to the fiber calls function
+    void start(Function function, void* data);
+
+    FiberContext& context() { return m_context; }
+    void* data() const { return m_data; }
+
+private:
+    std::unique_ptr<char[]> m_stack;
+    size_t m_stack_size;
+    FiberContext m_context;
+    void* m_data = nullptr;
+};
+
+// Fibers are reused so that a job does not allocate a stack
+class FiberPool
+{
+public:
+    explicit FiberPool(size_t stack_size = DefaultFiberStackSize) : m_stack_size(stack_size) {}
+
+    Fiber* acquire();
+    void release(Fiber* fiber);
+
+    size_t allocated_count() const;
+
+private:
+    const size_t m_stack_size;
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Fiber>> m_fibers;
+    std::vector<Fiber*> m_free;
+};
+
+// A count of pending dependencies with the fibers waiting for it to reach zero
+class WaitableCounter
+{
+public:
+    explicit WaitableCounter(int count = 0) : m_count(count) {}
+
+    // False when the counter is already zero, the fiber is then not added
+    bool add_waiter(Fiber* fiber);
+    // Appends the waiters to resumed when the counter reaches zero
+    void release(std::vector<Fiber*>& resumed);
+
+    int value() const;
+
+private:
+    mutable std::mutex m_mutex;
+    int m_count;
+    std::vector<Fiber*> m_waiters;
+};
+
+// Nanoseconds of a switch to a fiber and back, negative when fibers are not supported
+float measure_fiber_switch_ns(int switch_count);
+// Nanoseconds of a wait on a counter which another context releases: the fiber
+// adds itself as a waiter and suspends, the counter is released and the fiber resumed
+float measure_fiber_wait_ns(int wait_count);
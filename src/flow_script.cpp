@@ -0,0 +1,88 @@
+#include "flow_script.h"
+
+#include <assert.h>
+
+#include <algorithm>
+
+FlowScript::FlowScript(const char* name)
+    : m_name(name)
+{
+}
+
+FlowScript& FlowScript::group(const std::string& name)
+{
+    // The tag of a group is the order it was first named in
+    m_group = group_tag(name);
+    if (m_group < 0) {
+        m_group = (int)m_groups.size();
+        m_groups.push_back(name);
+    }
+    return *this;
+}
+
+FlowScript& FlowScript::stage(const std::string& name, float weight)
+{
+    if (m_group < 0) {
+        group(m_name);
+    }
+
+    Stage s;
+    s.name = name;
+    s.weight = weight;
+    s.group = m_group;
+    m_stages.push_back(s);
+    return *this;
+}
+
+FlowScript& FlowScript::parallel_for(int count)
+{
+    assert(count > 0);
+    last().split = count;
+    return *this;
+}
+
+FlowScript& FlowScript::previous_frame(const std::string& group)
+{
+    last().wait_group = group;
+    return *this;
+}
+
+FlowScript& FlowScript::next_frame_slot()
+{
+    last();
+    m_next_frame_stage = (int)m_stages.size() - 1;
+    return *this;
+}
+
+FlowScript& FlowScript::gpu(int queue)
+{
+    last().gpu = true;
+    last().gpu_queue = queue;
+    return *this;
+}
+
+std::shared_ptr<FrameFlow> FlowScript::build() const
+{
+    auto flow = std::make_shared<FrameFlow>(m_name.c_str());
+    flow->stages.clear();
+    for (const Stage& s : m_stages) {
+        const bool wait = !s.wait_group.empty();
+        const int wait_tag = wait ? group_tag(s.wait_group) : s.group;
+        assert(wait_tag >= 0 && "the awaited group has no stage");
+        flow->stages.push_back(std::make_shared<FrameStage>(s.name.c_str(), s.group, s.weight, s.split, wait, wait_tag, s.gpu, s.gpu_queue));
+    }
+    flow->start_next_frame_stage = m_next_frame_stage >= 0 ? m_next_frame_stage : (int)m_stages.size() - 1;
+    return flow;
+}
+
+int FlowScript::group_tag(const std::string& name) const
+{
+    auto it = std::find(m_groups.begin(), m_groups.end(), name);
+    return it == m_groups.end() ? -1 : (int)(it - m_groups.begin());
+}
+
+FlowScript::Stage& FlowScript::last()
+{
+    assert(!m_stages.empty() && "describe a stage first");
+    return m_stages.back();
+}
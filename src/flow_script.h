@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "node_editor.h"
+
+// Describes a frame flow as the code of one frame. Stages are grouped by name
+// instead of numeric tags, and the script is plain code so it may loop or branch
+// on its parameters. The calls after stage describe that stage:
+//
+//     FlowScript script("Frame");
+//     script.group("Game").stage("Simulate").parallel_for(6).next_frame_slot();
+//     script.group("Render").stage("Prepare").parallel_for(8).previous_frame("Render");
+//     auto flow = script.build();
+class FlowScript
+{
+public:
+    explicit FlowScript(const char* name);
+
+    // The next stages belong to the group, a later frame waits for a whole group
+    FlowScript& group(const std::string& name);
+    FlowScript& stage(const std::string& name, float weight = 1.f);
+
+    // The stage is split into count jobs
+    FlowScript& parallel_for(int count);
+    // The stage waits until the group completed in the previous frame, the group may be declared later
+    FlowScript& previous_frame(const std::string& group);
+    // The next frame starts once the stage completed, by default after the last stage
+    FlowScript& next_frame_slot();
+    FlowScript& gpu(int queue = 0);
+
+    std::shared_ptr<FrameFlow> build() const;
+
+private:
+    struct Stage
+    {
+        std::string name;
+        float weight = 1.f;
+        int split = 1;
+        int group = 0;
+        std::string wait_group;
+        bool gpu = false;
+        int gpu_queue = 0;
+    };
+
+    int group_tag(const std::string& name) const;
+    Stage& last();
+
+    std::string m_name;
+    std::vector<std::string> m_groups;
+    int m_group = -1;
+    std::vector<Stage> m_stages;
+    int m_next_frame_stage = -1;
+};
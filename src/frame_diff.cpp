@@ -0,0 +1,350 @@
+#include "frame_diff.h"
+
+#include "imgui.h"
+
+#include "trace_file.h"
+#include "visualizer.h"
+
+#include <float.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Frames are scanned by groups which the compiler can vectorize
+constexpr int LaneCount = 8;
+
+const double Unset = std::numeric_limits<double>::infinity();
+
+float max_abs(const float* values, size_t count)
+{
+    float lanes[LaneCount] = {};
+    size_t i = 0;
+    for (; i + LaneCount <= count; i += LaneCount) {
+        for (int l = 0; l < LaneCount; l++) {
+            lanes[l] = std::max(lanes[l], std::fabs(values[i + l]));
+        }
+    }
+    for (; i < count; i++) {
+        lanes[0] = std::max(lanes[0], std::fabs(values[i]));
+    }
+    return *std::max_element(lanes, lanes + LaneCount);
+}
+
+// Writes b - a to delta and raises max_delta to the absolute delta
+void subtract(const float* a, const float* b, float* delta, float* max_delta, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        delta[i] = b[i] - a[i];
+        max_delta[i] = std::max(max_delta[i], std::fabs(delta[i]));
+    }
+}
+
+void delta_text(float delta, float tolerance)
+{
+    if (std::fabs(delta) > tolerance) {
+        ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "%+.4f", delta);
+    } else {
+        ImGui::Text("%+.4f", delta);
+    }
+}
+
+void offset_text(float offset)
+{
+    if (offset < 0.f) {
+        ImGui::TextDisabled("-");
+    } else {
+        ImGui::Text("%.4f", offset);
+    }
+}
+
+}
+
+void FrameSummaryBuilder::add(int frame, const char* stage, double start, double end)
+{
+    if (frame < 0) {
+        return;
+    }
+    if (frame >= (int)m_start.size()) {
+        m_start.resize(frame + 1, Unset);
+        m_end.resize(frame + 1, -Unset);
+        for (auto& s : m_stage_start) {
+            s.resize(frame + 1, Unset);
+        }
+    }
+    m_start[frame] = std::min(m_start[frame], start);
+    m_end[frame] = std::max(m_end[frame], end);
+
+    auto& stage_start = m_stage_start[column(stage)];
+    stage_start[frame] = std::min(stage_start[frame], start);
+}
+
+FrameSummary FrameSummaryBuilder::finish(const std::string& name, size_t frame_count) const
+{
+    const size_t count = std::min(frame_count, m_start.size());
+
+    FrameSummary summary;
+    summary.name = name;
+    summary.stage_names = m_stage_names;
+    summary.interval.resize(count);
+    summary.latency.resize(count);
+    summary.stage_offset.resize(count * m_stage_names.size());
+
+    double previous_end = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        // A frame without any box keeps the timings of the previous one
+        double start = m_start[i] == Unset ? previous_end : m_start[i];
+        double end = m_end[i] == -Unset ? previous_end : m_end[i];
+        summary.interval[i] = (float)((end - previous_end) * m_scale);
+        summary.latency[i] = (float)((end - start) * m_scale);
+        for (size_t s = 0; s < m_stage_names.size(); s++) {
+            double stage_start = m_stage_start[s][i];
+            summary.stage_offset[s * count + i] = stage_start == Unset ? -1.f : (float)((stage_start - start) * m_scale);
+        }
+        previous_end = end;
+    }
+    return summary;
+}
+
+int FrameSummaryBuilder::column(const char* stage)
+{
+    for (size_t i = 0; i < m_stage_names.size(); i++) {
+        if (strcmp(m_stage_names[i].c_str(), stage) == 0) {
+            return (int)i;
+        }
+    }
+    m_stage_names.push_back(stage);
+    m_stage_start.emplace_back(m_start.size(), Unset);
+    return (int)m_stage_names.size() - 1;
+}
+
+FrameSummary summarize_frames(const Simulator& simulator, const std::string& name)
+{
+    FrameSummaryBuilder builder(simulator.get_option().VsyncPeriod);
+    for (const auto& t : simulator.get_timeboxes()) {
+        if (t.type != TimeBoxType::FrameTime) {
+            builder.add(t.frame, t.name.c_str(), t.raw_start(), t.raw_end());
+        }
+    }
+    return builder.finish(name, simulator.get_framerates().size());
+}
+
+FrameSummary summarize_frames(const TraceFile& trace, const std::string& name)
+{
+    // Frame time boxes tell how many frames are done, traces without them are complete
+    FrameSummaryBuilder builder(trace.units_per_vsync());
+    size_t done_count = 0;
+    bool has_frame_time = false;
+    for (int l = 0; l < trace.lane_count(); l++) {
+        trace.visit(l, -DBL_MAX, DBL_MAX, [&](const TraceBox& box) {
+            if (box.type == TraceBoxType::FrameTime) {
+                has_frame_time = true;
+                done_count += 1;
+            } else {
+                builder.add(box.frame, box.name, box.start, box.end);
+            }
+        });
+    }
+    return builder.finish(name, has_frame_time ? done_count : SIZE_MAX);
+}
+
+FrameDiff diff_frames(const FrameSummary& a, const FrameSummary& b)
+{
+    FrameDiff diff;
+    const int n = std::min(a.frame_count(), b.frame_count());
+    diff.frame_count = n;
+    diff.interval_delta.resize(n);
+    diff.latency_delta.resize(n);
+    diff.max_delta.assign(n, 0.f);
+
+    subtract(a.interval.data(), b.interval.data(), diff.interval_delta.data(), diff.max_delta.data(), n);
+    subtract(a.latency.data(), b.latency.data(), diff.latency_delta.data(), diff.max_delta.data(), n);
+    diff.max_interval_delta = max_abs(diff.interval_delta.data(), n);
+    diff.max_latency_delta = max_abs(diff.latency_delta.data(), n);
+
+    for (int sa = 0; sa < a.stage_count(); sa++) {
+        auto it = std::find(b.stage_names.begin(), b.stage_names.end(), a.stage_names[sa]);
+        if (it != b.stage_names.end()) {
+            diff.stage_names.push_back(a.stage_names[sa]);
+            diff.stage_a.push_back(sa);
+            diff.stage_b.push_back((int)(it - b.stage_names.begin()));
+        }
+    }
+
+    diff.stage_delta.resize((size_t)diff.stage_names.size() * n);
+    for (size_t s = 0; s < diff.stage_names.size(); s++) {
+        float* delta = diff.stage_delta.data() + s * n;
+        subtract(a.stage(diff.stage_a[s]), b.stage(diff.stage_b[s]), delta, diff.max_delta.data(), n);
+        diff.max_stage_delta = std::max(diff.max_stage_delta, max_abs(delta, n));
+    }
+
+    return diff;
+}
+
+int find_divergence(const FrameDiff& diff, float tolerance, int from)
+{
+    const float* values = diff.max_delta.data();
+    int i = std::max(0, from);
+
+    // Skip whole groups below the tolerance, then look for the frame in the group
+    for (; i + LaneCount <= diff.frame_count; i += LaneCount) {
+        float group = 0.f;
+        for (int l = 0; l < LaneCount; l++) {
+            group = std::max(group, values[i + l]);
+        }
+        if (group > tolerance) {
+            break;
+        }
+    }
+    for (; i < diff.frame_count; i++) {
+        if (values[i] > tolerance) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void draw_frame_diff_controls(FrameDiffView& view, const std::vector<FrameDiffSource>& sources)
+{
+    if (sources.size() < 2) {
+        ImGui::TextWrapped("Freeze a simulation or open a trace to compare it");
+        return;
+    }
+
+    auto combo = [&](const char* label, int& index) {
+        index = std::min(std::max(index, 0), (int)sources.size() - 1);
+        if (ImGui::BeginCombo(label, sources[index].name.c_str())) {
+            for (int i = 0; i < (int)sources.size(); i++) {
+                if (ImGui::Selectable(sources[i].name.c_str(), i == index)) {
+                    index = i;
+                }
+            }
+            ImGui::EndCombo();
+        }
+    };
+    combo("Run A", view.source_a);
+    combo("Run B", view.source_b);
+
+    if (ImGui::Button("Compare")) {
+        view.a = sources[view.source_a].summarize();
+        view.b = sources[view.source_b].summarize();
+        view.diff = diff_frames(view.a, view.b);
+        view.divergence = find_divergence(view.diff, view.tolerance);
+        view.scroll_to = view.divergence;
+        view.stage = 0;
+        view.open = true;
+    }
+}
+
+void draw_frame_diff(FrameDiffView& view)
+{
+    if (!view.open) {
+        return;
+    }
+
+    const FrameDiff& diff = view.diff;
+    ImGui::SetNextWindowSize(ImVec2(900, 600), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Frame Diff", &view.open);
+
+    ImGui::Text("A: %s (%d frames)", view.a.name.c_str(), view.a.frame_count());
+    ImGui::Text("B: %s (%d frames)", view.b.name.c_str(), view.b.frame_count());
+    ImGui::Text("Max |B - A| in vsync: interval %.4f, latency %.4f, stage start %.4f", diff.max_interval_delta, diff.max_latency_delta, diff.max_stage_delta);
+
+    if (ImGui::DragFloat("Tolerance", &view.tolerance, 0.0001f, 0.f, 1.f, "%.4f")) {
+        view.divergence = find_divergence(diff, view.tolerance);
+    }
+    if (ImGui::Button("First Divergence")) {
+        view.divergence = find_divergence(diff, view.tolerance);
+        view.scroll_to = view.divergence;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Next Divergence")) {
+        int next = find_divergence(diff, view.tolerance, std::max(view.divergence, view.first_visible) + 1);
+        if (next >= 0) {
+            view.divergence = next;
+            view.scroll_to = next;
+        }
+    }
+    ImGui::SameLine();
+    if (view.divergence >= 0) {
+        ImGui::Text("Diverges at frame %d", view.divergence);
+    } else {
+        ImGui::Text("No frame diverges");
+    }
+
+    if (!diff.stage_names.empty()) {
+        view.stage = std::min(std::max(view.stage, 0), (int)diff.stage_names.size() - 1);
+        if (ImGui::BeginCombo("Stage", diff.stage_names[view.stage].c_str())) {
+            for (int i = 0; i < (int)diff.stage_names.size(); i++) {
+                if (ImGui::Selectable(diff.stage_names[i].c_str(), i == view.stage)) {
+                    view.stage = i;
+                }
+            }
+            ImGui::EndCombo();
+        }
+    }
+
+    // Largest delta of the frames from the first visible row
+    const int plot_count = std::min(512, diff.frame_count - view.first_visible);
+    if (plot_count > 0) {
+        ImGui::PlotLines("##MaxDelta", diff.max_delta.data() + view.first_visible, plot_count, 0, "Max |B - A|", 0.f, FLT_MAX, ImVec2(ImGui::GetContentRegionAvailWidth(), 60.f));
+    }
+
+    const char* headers[] = { "Frame", "Interval A", "Interval B", "Delta", "Latency A", "Latency B", "Delta", "Stage A", "Stage B", "Delta" };
+    const int column_count = (int)(sizeof(headers) / sizeof(headers[0]));
+    ImGui::Columns(column_count, "FrameDiffHeader");
+    for (const char* h : headers) {
+        ImGui::Text("%s", h);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    ImGui::BeginChild("FrameDiffRows");
+    const float row_height = ImGui::GetTextLineHeightWithSpacing();
+    if (view.scroll_to >= 0) {
+        ImGui::SetScrollY(view.scroll_to * row_height);
+        view.scroll_to = -1;
+    }
+
+    const bool has_stage = !diff.stage_names.empty();
+    const float* stage_a = has_stage ? view.a.stage(diff.stage_a[view.stage]) : nullptr;
+    const float* stage_b = has_stage ? view.b.stage(diff.stage_b[view.stage]) : nullptr;
+    const float* stage_delta = has_stage ? diff.stage(view.stage) : nullptr;
+
+    ImGui::Columns(column_count, "FrameDiffRows", false);
+    ImGuiListClipper clipper(diff.frame_count, row_height);
+    while (clipper.Step()) {
+        view.first_visible = clipper.DisplayStart;
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            if (i == view.divergence) {
+                ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "%d", i);
+            } else {
+                ImGui::Text("%d", i);
+            }
+            ImGui::NextColumn();
+            ImGui::Text("%.4f", view.a.interval[i]); ImGui::NextColumn();
+            ImGui::Text("%.4f", view.b.interval[i]); ImGui::NextColumn();
+            delta_text(diff.interval_delta[i], view.tolerance); ImGui::NextColumn();
+            ImGui::Text("%.4f", view.a.latency[i]); ImGui::NextColumn();
+            ImGui::Text("%.4f", view.b.latency[i]); ImGui::NextColumn();
+            delta_text(diff.latency_delta[i], view.tolerance); ImGui::NextColumn();
+            if (has_stage) {
+                offset_text(stage_a[i]); ImGui::NextColumn();
+                offset_text(stage_b[i]); ImGui::NextColumn();
+                delta_text(stage_delta[i], view.tolerance); ImGui::NextColumn();
+            } else {
+                ImGui::NextColumn();
+                ImGui::NextColumn();
+                ImGui::NextColumn();
+            }
+        }
+    }
+    ImGui::Columns(1);
+    ImGui::EndChild();
+
+    ImGui::End();
+}
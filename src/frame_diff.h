@@ -0,0 +1,105 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class Simulator;
+class TraceFile;
+
+// Per frame timings of a run in vsync periods, one array per metric so that two
+// runs are compared array by array
+struct FrameSummary
+{
+    std::string name;
+    std::vector<float> interval;
+    std::vector<float> latency;
+    std::vector<std::string> stage_names;
+    // Start of each stage relative to the start of the frame, stage major, -1 when
+    // the frame has no such stage
+    std::vector<float> stage_offset;
+
+    int frame_count() const { return (int)interval.size(); }
+    int stage_count() const { return (int)stage_names.size(); }
+    const float* stage(int index) const { return stage_offset.data() + (size_t)index * frame_count(); }
+};
+
+// Collects the boxes of a run in any order, times are in the units of the run
+class FrameSummaryBuilder
+{
+public:
+    explicit FrameSummaryBuilder(double units_per_vsync) : m_scale(1.0 / units_per_vsync) {}
+
+    // The frame starts with its first box and ends with its last one, a stage starts with its first box
+    void add(int frame, const char* stage, double start, double end);
+
+    // Keeps the first frame_count frames
+    FrameSummary finish(const std::string& name, size_t frame_count) const;
+
+private:
+    int column(const char* stage);
+
+    double m_scale;
+    std::vector<double> m_start;
+    std::vector<double> m_end;
+    std::vector<std::string> m_stage_names;
+    std::vector<std::vector<double>> m_stage_start;
+};
+
+// Only the frames which are done are summarized
+FrameSummary summarize_frames(const Simulator& simulator, const std::string& name);
+FrameSummary summarize_frames(const TraceFile& trace, const std::string& name);
+
+// Deltas of b - a, for the frames and the stages found in both runs
+struct FrameDiff
+{
+    int frame_count = 0;
+    std::vector<float> interval_delta;
+    std::vector<float> latency_delta;
+    std::vector<std::string> stage_names;
+    std::vector<int> stage_a;
+    std::vector<int> stage_b;
+    // Stage major like the summaries
+    std::vector<float> stage_delta;
+    // Largest absolute delta of each frame over every metric
+    std::vector<float> max_delta;
+
+    float max_interval_delta = 0.f;
+    float max_latency_delta = 0.f;
+    float max_stage_delta = 0.f;
+
+    const float* stage(int index) const { return stage_delta.data() + (size_t)index * frame_count; }
+};
+
+FrameDiff diff_frames(const FrameSummary& a, const FrameSummary& b);
+
+// First frame at or after from with a delta larger than tolerance, -1 when there is none
+int find_divergence(const FrameDiff& diff, float tolerance, int from = 0);
+
+struct FrameDiffSource
+{
+    std::string name;
+    std::function<FrameSummary()> summarize;
+};
+
+struct FrameDiffView
+{
+    int source_a = 0;
+    int source_b = 1;
+    float tolerance = 0.001f;
+    int stage = 0;
+    int divergence = -1;
+    int first_visible = 0;
+    int scroll_to = -1;
+    bool open = false;
+
+    FrameSummary a;
+    FrameSummary b;
+    FrameDiff diff;
+};
+
+// Source selection and compare button, for an options panel
+void draw_frame_diff_controls(FrameDiffView& view, const std::vector<FrameDiffSource>& sources);
+
+// Window of the per frame deltas
+void draw_frame_diff(FrameDiffView& view);
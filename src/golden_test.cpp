@@ -0,0 +1,63 @@
+// Compares the simulations with the golden traces checked in under src/golden, without a window.
+//
+//     fcsim-golden-test [--record] [directory]
+//
+// The exit code is 1 when a trace differs or is missing, the first box which differs
+// is printed for each case. After an intended change of the simulation, --record
+// rewrites the traces, and the diff of the .golden files shows what changed.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "imgui.h"
+#include "app.h"
+#include "golden_trace.h"
+
+int main(int argc, char** argv)
+{
+    bool record = false;
+    std::string directory = CPP_SRC_DIR "src/golden";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) {
+            record = true;
+        } else if (argv[i][0] != '-') {
+            directory = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [--record] [directory]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // The app holds the flows and the presets, nothing is drawn
+    ImGui::CreateContext();
+    ImGui::GetIO().IniFilename = nullptr;
+    App::init();
+
+    const std::vector<GoldenCase> cases = golden_cases(App::get().Flows);
+    if (record) {
+        std::string error;
+        if (!save_golden_traces(cases, directory, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        printf("Recorded %d traces in %s\n", (int)cases.size(), directory.c_str());
+        return 0;
+    }
+
+    const GoldenReport report = verify_golden_traces(cases, directory);
+    for (const auto& m : report.mismatches) {
+        if (m.box_index < 0) {
+            printf("%s: %s\n", m.name.c_str(), m.expected.c_str());
+            continue;
+        }
+        printf("%s: box %d differs\n", m.name.c_str(), m.box_index);
+        printf("  expected %s\n", m.expected.c_str());
+        printf("  actual   %s\n", m.actual.c_str());
+    }
+    printf("%d of %d traces identical\n", report.passed_count, report.case_count);
+
+    return report.mismatches.empty() ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#include "golden_trace.h"
+
+#include "imgui.h"
+#include "job_system.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+namespace {
+
+// Steps simulated by a flow case, enough for the pacing to settle
+constexpr int GoldenStepCount = 2000;
+const char* const GoldenExtension = ".golden";
+
+// FNV-1a like FrameSetting::Fingerprint, over the lines of the trace
+uint64_t hash_lines(const std::vector<std::string>& lines)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto& line : lines) {
+        for (unsigned char c : line) {
+            hash = (hash ^ c) * 1099511628211ull;
+        }
+        hash = (hash ^ '\n') * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Every case only depends on its own seed, they are recorded in parallel
+std::vector<GoldenTrace> record_golden_traces(const std::vector<GoldenCase>& cases)
+{
+    std::vector<GoldenTrace> traces(cases.size());
+    parallel_for((int)cases.size(), 0, [&](int i) {
+        traces[i] = record_golden_trace(cases[i]);
+    });
+    return traces;
+}
+
+std::string golden_path(const std::string& directory, const std::string& name)
+{
+    std::string file;
+    for (char c : name) {
+        file += std::isalnum((unsigned char)c) ? c : '_';
+    }
+    const bool separator = !directory.empty() && directory.back() != '/' && directory.back() != '\\';
+    return directory + (separator ? "/" : "") + file + GoldenExtension;
+}
+
+// Times are printed with enough digits that a float round trips
+std::string box_line(int core, int frame, int stage, int type, float start, float end, const char* name)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "%d %d %d %d %.9g %.9g %s", core, frame, stage, type, start, end, name);
+    return line;
+}
+
+bool read_golden_trace(const std::string& path, GoldenTrace& trace, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file) {
+        error = "can not open " + path;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.compare(0, 7, "# hash ") == 0) {
+            trace.hash = strtoull(line.c_str() + 7, nullptr, 16);
+        } else if (!line.empty() && line[0] != '#') {
+            trace.boxes.push_back(line);
+        }
+    }
+    return true;
+}
+
+}
+
+std::vector<GoldenCase> golden_cases(const std::vector<std::shared_ptr<FrameFlow>>& flows)
+{
+    std::vector<GoldenCase> cases;
+    auto add = [&](const std::string& name, std::shared_ptr<FrameFlow> flow, SimulationOption option) {
+        GoldenCase golden;
+        golden.name = name;
+        golden.flow = flow;
+        // A trace is only reproducible with a fixed seed and without a capture of the user
+        option.AutoSeed = false;
+        option.Capture = nullptr;
+        golden.option = option;
+        cases.push_back(golden);
+    };
+
+    for (const auto& flow : flows) {
+        add(std::string("flow ") + flow->name, flow, SimulationOption());
+
+        SimulationOption noisy;
+        noisy.Random = 0.5f;
+        noisy.Seed = 3;
+        add(std::string("flow ") + flow->name + " noisy", flow, noisy);
+    }
+    if (!flows.empty()) {
+        for (int i = 0; i < get_preset_count(); i++) {
+            const Preset& preset = get_preset(i);
+            add(std::string("preset ") + preset.name(), flows[0], preset.option());
+        }
+    }
+
+    auto add_setting = [&](const std::string& name, FrameSetting setting) {
+        GoldenCase golden;
+        golden.name = "frame simulator " + name;
+        golden.setting = setting;
+        golden.setting.speculate = false;
+        cases.push_back(golden);
+    };
+    FrameSetting setting;
+    add_setting("default", setting);
+    setting.coreCount = 2;
+    setting.perturbationIndex = 20;
+    setting.perturbationDuration = 5;
+    setting.perturbationGpuRatio = 2.f;
+    add_setting("perturbation", setting);
+    setting = FrameSetting();
+    setting.pacingMode = PacingMode::JustInTime;
+    setting.limiterMode = LimiterMode::FixedInterval;
+    add_setting("pacing", setting);
+
+    return cases;
+}
+
+GoldenTrace record_golden_trace(const GoldenCase& golden)
+{
+    GoldenTrace trace;
+    trace.name = golden.name;
+
+    if (golden.flow) {
+        Simulator sim(golden.flow, golden.option);
+        sim.run_steps(GoldenStepCount);
+        for (const auto& t : sim.get_timeboxes()) {
+            trace.boxes.push_back(box_line(t.core_index, t.frame, t.stage, (int)t.type, t.raw_start(), t.raw_end(), t.name.c_str()));
+        }
+    } else {
+        auto result = FrameSimulator::Compute(golden.setting);
+        for (const auto& t : result->timeboxes) {
+            trace.boxes.push_back(box_line(t.coreIndex, t.frameIndex, -1, t.isGpuTimeBox ? 1 : 0, (float)t.startTime, (float)t.stopTime, t.name));
+        }
+    }
+
+    trace.hash = hash_lines(trace.boxes);
+    return trace;
+}
+
+bool save_golden_traces(const std::vector<GoldenCase>& cases, const std::string& directory, std::string& error)
+{
+    const std::vector<GoldenTrace> traces = record_golden_traces(cases);
+    for (size_t c = 0; c < cases.size(); c++) {
+        const GoldenTrace& trace = traces[c];
+        const std::string path = golden_path(directory, cases[c].name);
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            error = "can not write " + path;
+            return false;
+        }
+
+        char hash[32];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)trace.hash);
+        file << "# " << trace.name << "\n# hash " << hash << "\n# core frame stage type start end name\n";
+        for (const auto& line : trace.boxes) {
+            file << line << "\n";
+        }
+        if (!file) {
+            error = "can not write " + path;
+            return false;
+        }
+    }
+    return true;
+}
+
+GoldenReport verify_golden_traces(const std::vector<GoldenCase>& cases, const std::string& directory)
+{
+    GoldenReport report;
+    const std::vector<GoldenTrace> traces = record_golden_traces(cases);
+    for (size_t c = 0; c < cases.size(); c++) {
+        const GoldenCase& golden = cases[c];
+        report.case_count += 1;
+
+        GoldenMismatch mismatch;
+        mismatch.name = golden.name;
+        GoldenTrace expected;
+        if (!read_golden_trace(golden_path(directory, golden.name), expected, mismatch.expected)) {
+            report.mismatches.push_back(mismatch);
+            continue;
+        }
+
+        const GoldenTrace& actual = traces[c];
+        if (actual.hash == expected.hash && actual.boxes == expected.boxes) {
+            report.passed_count += 1;
+            continue;
+        }
+
+        // Report the first box which differs, or the end of the shorter trace
+        const size_t count = std::min(actual.boxes.size(), expected.boxes.size());
+        size_t i = 0;
+        while (i < count && actual.boxes[i] == expected.boxes[i]) {
+            i++;
+        }
+        mismatch.box_index = (int)i;
+        mismatch.expected = i < expected.boxes.size() ? expected.boxes[i] : "end of trace";
+        mismatch.actual = i < actual.boxes.size() ? actual.boxes[i] : "end of trace";
+        report.mismatches.push_back(mismatch);
+    }
+    return report;
+}
+
+void draw_golden_traces(GoldenTraceView& view, const std::vector<std::shared_ptr<FrameFlow>>& flows)
+{
+    ImGui::InputText("Directory", view.directory, sizeof(view.directory));
+
+    if (ImGui::Button("Record Golden Traces")) {
+        std::string error;
+        const auto cases = golden_cases(flows);
+        if (save_golden_traces(cases, view.directory, error)) {
+            view.status = "Recorded " + std::to_string(cases.size()) + " traces";
+        } else {
+            view.status = error;
+        }
+        view.report = nullptr;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Verify Golden Traces")) {
+        view.report = std::make_shared<GoldenReport>(verify_golden_traces(golden_cases(flows), view.directory));
+        view.status.clear();
+    }
+
+    if (!view.status.empty()) {
+        ImGui::TextUnformatted(view.status.c_str());
+    }
+    if (view.report) {
+        const GoldenReport& report = *view.report;
+        ImGui::Text("%d of %d traces identical", report.passed_count, report.case_count);
+        for (const auto& m : report.mismatches) {
+            ImGui::Separator();
+            if (m.box_index < 0) {
+                ImGui::Text("%s: %s", m.name.c_str(), m.expected.c_str());
+                continue;
+            }
+            ImGui::Text("%s: box %d differs", m.name.c_str(), m.box_index);
+            ImGui::Text("  expected %s", m.expected.c_str());
+            ImGui::Text("  actual   %s", m.actual.c_str());
+        }
+    }
+}
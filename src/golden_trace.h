@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "visualizer.h"
+#include "simulator.h"
+
+// A simulation with a fixed seed whose time boxes must not change. Flow cases run
+// the Simulator, setting cases the FrameSimulator.
+struct GoldenCase
+{
+    std::string name;
+    std::shared_ptr<FrameFlow> flow;
+    SimulationOption option;
+    FrameSetting setting;
+};
+
+// Time boxes of a case, one text line per box so that two traces diff line by line
+struct GoldenTrace
+{
+    std::string name;
+    uint64_t hash = 0;
+    std::vector<std::string> boxes;
+};
+
+struct GoldenMismatch
+{
+    std::string name;
+    // First box which differs, -1 when the golden trace could not be read
+    int box_index = -1;
+    std::string expected;
+    std::string actual;
+};
+
+struct GoldenReport
+{
+    int case_count = 0;
+    int passed_count = 0;
+    std::vector<GoldenMismatch> mismatches;
+};
+
+// Every flow with and without duration noise, every preset, and a few frame simulator settings
+std::vector<GoldenCase> golden_cases(const std::vector<std::shared_ptr<FrameFlow>>& flows);
+
+GoldenTrace record_golden_trace(const GoldenCase& golden);
+
+// One file per case in the directory, which must exist
+bool save_golden_traces(const std::vector<GoldenCase>& cases, const std::string& directory, std::string& error);
+GoldenReport verify_golden_traces(const std::vector<GoldenCase>& cases, const std::string& directory);
+
+struct GoldenTraceView
+{
+    char directory[256] = CPP_SRC_DIR "src/golden";
+    std::string status;
+    std::shared_ptr<GoldenReport> report;
+};
+
+void draw_golden_traces(GoldenTraceView& view, const std::vector<std::shared_ptr<FrameFlow>>& flows);
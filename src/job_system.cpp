@@ -0,0 +1,268 @@
+#include "job_system.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+
+#include <algorithm>
+
+namespace {
+
+struct WorkerSlot
+{
+    const JobSystem* system = nullptr;
+    int index = -1;
+};
+
+thread_local WorkerSlot g_Worker;
+
+#ifdef __linux__
+void futex(std::atomic<uint32_t>& word, int operation, uint32_t value)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), operation, value, nullptr, nullptr, 0);
+}
+#endif
+
+int default_thread_count()
+{
+    // Leave a core to the ui thread
+    return std::max(1, (int)std::thread::hardware_concurrency() - 1);
+}
+
+}
+
+void* aligned_malloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size, alignment);
+#else
+    void* memory = nullptr;
+    if (posix_memalign(&memory, std::max(alignment, sizeof(void*)), size) != 0) {
+        memory = nullptr;
+    }
+#endif
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void aligned_free(void* memory)
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+int parallel_for(int count, int thread_count, const std::function<void(int index)>& body)
+{
+    if (thread_count <= 0) {
+        thread_count = (int)std::thread::hardware_concurrency();
+    }
+    thread_count = std::max(1, std::min(thread_count, count));
+
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            body(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_count; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return thread_count;
+}
+
+uint32_t Parker::prepare()
+{
+    m_sleeper_count.fetch_add(1, std::memory_order_seq_cst);
+    return m_epoch.load(std::memory_order_seq_cst);
+}
+
+void Parker::cancel()
+{
+    m_sleeper_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Parker::park(uint32_t epoch)
+{
+#ifdef __linux__
+    while (m_epoch.load(std::memory_order_acquire) == epoch) {
+        futex(m_epoch, FUTEX_WAIT_PRIVATE, epoch);
+    }
+#else
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_condition.wait(lock, [&]() { return m_epoch.load(std::memory_order_acquire) != epoch; });
+#endif
+    m_sleeper_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Parker::wake_one()
+{
+    wake(1);
+}
+
+void Parker::wake_all()
+{
+    wake(INT32_MAX);
+}
+
+const char* Parker::implementation()
+{
+#ifdef __linux__
+    return "futex";
+#else
+    return "condition variable";
+#endif
+}
+
+void Parker::wake(int count)
+{
+    // Pairs with prepare, either the sleeper is seen or it sees the new work
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeper_count.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+
+#ifdef __linux__
+    m_epoch.fetch_add(1, std::memory_order_release);
+    futex(m_epoch, FUTEX_WAKE_PRIVATE, (uint32_t)count);
+#else
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_epoch.fetch_add(1, std::memory_order_release);
+    }
+    if (count == 1) {
+        m_condition.notify_one();
+    } else {
+        m_condition.notify_all();
+    }
+#endif
+}
+
+JobSystem::JobSystem(int thread_count)
+{
+    if (thread_count <= 0) {
+        thread_count = default_thread_count();
+    }
+    for (int i = 0; i < thread_count; i++) {
+        m_deques.emplace_back(make_aligned<WorkStealingDeque<Task*>>());
+    }
+    for (int i = 0; i < thread_count; i++) {
+        m_threads.emplace_back([this, i]() { worker(i); });
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    m_stop = true;
+    m_parker.wake_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void JobSystem::submit(Task* task)
+{
+    int index = worker_index();
+    if (index >= 0) {
+        m_deques[index]->push(task);
+    } else {
+        while (!m_injection.push(task)) {
+            std::this_thread::yield();
+        }
+    }
+    m_parker.wake_one();
+}
+
+void JobSystem::wait(const DependencyCounter& counter)
+{
+    int index = worker_index();
+    while (counter.value() > 0) {
+        if (Task* task = find_task(index)) {
+            execute(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int JobSystem::worker_index() const
+{
+    return g_Worker.system == this ? g_Worker.index : -1;
+}
+
+JobSystem::Task* JobSystem::find_task(int worker)
+{
+    if (worker >= 0) {
+        if (Task* task = m_deques[worker]->pop()) {
+            return task;
+        }
+    }
+
+    Task* task = nullptr;
+    if (m_injection.pop(task)) {
+        return task;
+    }
+
+    // Steal from the next workers first, so that thieves spread over the victims
+    const int count = (int)m_deques.size();
+    for (int i = 1; i <= count; i++) {
+        int victim = (worker + i + count) % count;
+        if (victim != worker) {
+            if (Task* stolen = m_deques[victim]->steal()) {
+                return stolen;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(Task* task)
+{
+    DependencyCounter* counter = task->counter;
+    task->function(task->data);
+    if (counter) {
+        counter->release();
+    }
+}
+
+void JobSystem::worker(int index)
+{
+    g_Worker.system = this;
+    g_Worker.index = index;
+
+    while (true) {
+        Task* task = find_task(index);
+        if (!task) {
+            uint32_t epoch = m_parker.prepare();
+            task = find_task(index);
+            if (!task) {
+                if (m_stop) {
+                    m_parker.cancel();
+                    return;
+                }
+                m_parker.park(epoch);
+                continue;
+            }
+            m_parker.cancel();
+        }
+        execute(task);
+    }
+}
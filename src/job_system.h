@@ -0,0 +1,341 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifndef __linux__
+#include <condition_variable>
+#include <mutex>
+#endif
+
+constexpr size_t CacheLineSize = 64;
+
+// new only honors the alignment of the fundamental types before C++17, the
+// types with members on their own cache line are allocated with these
+void* aligned_malloc(size_t size, size_t alignment);
+void aligned_free(void* memory);
+
+template <class T>
+struct AlignedDelete
+{
+    void operator()(T* object) const
+    {
+        object->~T();
+        aligned_free(object);
+    }
+};
+
+template <class T>
+using AlignedPtr = std::unique_ptr<T, AlignedDelete<T>>;
+
+template <class T, class... Args>
+AlignedPtr<T> make_aligned(Args&&... args)
+{
+    void* memory = aligned_malloc(sizeof(T), alignof(T));
+    return AlignedPtr<T>(new (memory) T(std::forward<Args>(args)...));
+}
+
+// Calls body with each index below count from thread_count threads, the calling thread
+// included, each thread taking the next index. A thread count of 0 uses a thread per
+// hardware thread. Returns the thread count used.
+int parallel_for(int count, int thread_count, const std::function<void(int index)>& body);
+
+// Counts the jobs a continuation waits for
+class DependencyCounter
+{
+public:
+    explicit DependencyCounter(int count = 0) : m_count(count) {}
+    DependencyCounter(const DependencyCounter& other) : m_count(other.value()) {}
+
+    void add(int count = 1) { m_count.fetch_add(count, std::memory_order_relaxed); }
+    // True for the call which completes the last dependency
+    bool release() { return m_count.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+    int value() const { return m_count.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<int> m_count;
+};
+
+// Chase-Lev deque: the owner pushes and pops at the bottom, the other threads
+// steal at the top. T is a pointer, nullptr means empty.
+template <class T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024);
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // Owner thread only
+    void push(T item);
+    T pop();
+
+    T steal();
+
+    size_t size() const;
+
+private:
+    struct Buffer
+    {
+        explicit Buffer(size_t capacity) : mask(capacity - 1), items(new std::atomic<T>[capacity]) {}
+
+        T get(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+        void put(int64_t i, T item) { items[i & mask].store(item, std::memory_order_relaxed); }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    Buffer* grow(Buffer* buffer, int64_t bottom, int64_t top);
+
+    alignas(CacheLineSize) std::atomic<int64_t> m_top{ 0 };
+    alignas(CacheLineSize) std::atomic<int64_t> m_bottom{ 0 };
+    std::atomic<Buffer*> m_buffer;
+    // Thieves may still read a smaller buffer, they are freed with the deque
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
+
+// Bounded queue for several producers and consumers, each cell carries the
+// turn it is waiting for so that no lock is taken
+template <class T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity = 4096);
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    // These fail when the queue is full or empty
+    bool push(T item);
+    bool pop(T& item);
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    const size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+    alignas(CacheLineSize) std::atomic<size_t> m_enqueue{ 0 };
+    alignas(CacheLineSize) std::atomic<size_t> m_dequeue{ 0 };
+};
+
+// Idle workers sleep on a futex word. A worker calls prepare, looks for work one
+// last time, then parks or cancels. A wake bumps the word so that a worker
+// which prepared before the work was pushed does not sleep.
+class Parker
+{
+public:
+    uint32_t prepare();
+    void cancel();
+    void park(uint32_t epoch);
+
+    void wake_one();
+    void wake_all();
+
+    static const char* implementation();
+
+private:
+    void wake(int count);
+
+    std::atomic<uint32_t> m_epoch{ 0 };
+    std::atomic<int> m_sleeper_count{ 0 };
+#ifndef __linux__
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+#endif
+};
+
+// Workers with a deque each and an injection queue for the other threads.
+// Tasks are owned by the caller and must live until they are executed.
+class JobSystem
+{
+public:
+    struct Task
+    {
+        void (*function)(void* data) = nullptr;
+        void* data = nullptr;
+        // Released once the function returned
+        DependencyCounter* counter = nullptr;
+    };
+
+    explicit JobSystem(int thread_count = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // From a worker the task goes to its own deque, otherwise to the injection queue
+    void submit(Task* task);
+    // Executes tasks until the counter reaches zero
+    void wait(const DependencyCounter& counter);
+
+    int thread_count() const { return (int)m_threads.size(); }
+    std::thread& thread(int index) { return m_threads[index]; }
+    // Index of the calling worker, -1 when it is not a worker of this system
+    int worker_index() const;
+
+private:
+    Task* find_task(int worker);
+    void execute(Task* task);
+    void worker(int index);
+
+    std::vector<AlignedPtr<WorkStealingDeque<Task*>>> m_deques;
+    MpmcQueue<Task*> m_injection;
+    Parker m_parker;
+    std::atomic<bool> m_stop{ false };
+    std::vector<std::thread> m_threads;
+};
+
+template <class T>
+WorkStealingDeque<T>::WorkStealingDeque(size_t capacity)
+{
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    m_buffers.emplace_back(new Buffer(capacity));
+    m_buffer.store(m_buffers.back().get(), std::memory_order_relaxed);
+}
+
+template <class T>
+void WorkStealingDeque<T>::push(T item)
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+    Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+    if (bottom - top > (int64_t)buffer->mask) {
+        buffer = grow(buffer, bottom, top);
+    }
+    buffer->put(bottom, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+template <class T>
+T WorkStealingDeque<T>::pop()
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = m_buffer.load(std::memory_order_relaxed);
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    T item = buffer->get(bottom);
+    if (top == bottom) {
+        // The last item, a thief may take it first
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            item = nullptr;
+        }
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template <class T>
+T WorkStealingDeque<T>::steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    Buffer* buffer = m_buffer.load(std::memory_order_acquire);
+    T item = buffer->get(top);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return item;
+}
+
+template <class T>
+size_t WorkStealingDeque<T>::size() const
+{
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+    return bottom > top ? (size_t)(bottom - top) : 0;
+}
+
+template <class T>
+typename WorkStealingDeque<T>::Buffer* WorkStealingDeque<T>::grow(Buffer* buffer, int64_t bottom, int64_t top)
+{
+    Buffer* bigger = new Buffer((buffer->mask + 1) * 2);
+    for (int64_t i = top; i < bottom; i++) {
+        bigger->put(i, buffer->get(i));
+    }
+    m_buffers.emplace_back(bigger);
+    m_buffer.store(bigger, std::memory_order_release);
+    return bigger;
+}
+
+template <class T>
+MpmcQueue<T>::MpmcQueue(size_t capacity)
+    : m_mask(capacity - 1)
+    , m_cells(new Cell[capacity])
+{
+    assert(capacity > 1 && (capacity & (capacity - 1)) == 0);
+    for (size_t i = 0; i < capacity; i++) {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <class T>
+bool MpmcQueue<T>::push(T item)
+{
+    size_t position = m_enqueue.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = m_cells[position & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t turn = (intptr_t)sequence - (intptr_t)position;
+        if (turn == 0) {
+            if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.item = item;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (turn < 0) {
+            return false;
+        } else {
+            position = m_enqueue.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <class T>
+bool MpmcQueue<T>::pop(T& item)
+{
+    size_t position = m_dequeue.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = m_cells[position & m_mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t turn = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (turn == 0) {
+            if (m_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                item = cell.item;
+                cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (turn < 0) {
+            return false;
+        } else {
+            position = m_dequeue.load(std::memory_order_relaxed);
+        }
+    }
+}
@@ -18,113 +18,8 @@
 
 #include "visualizer.h"
 #include "app.h"
-
-App* App::s_App;
-
-std::shared_ptr<JobType> create_job_type(const char* name, float duration,
-    bool is_first, bool generate_next, bool release_frame)
-{
-    auto j = std::make_shared<JobType>();
-    j->duration = duration;
-    j->is_first = is_first;
-    j->generate_next = generate_next;
-    j->release_frame = release_frame;
-    strncpy(j->name, name, 250);
-
-    return j;
-}
-
-void App::init()
-{
-    s_App = new App();
-    s_App->NodeEditorContext = ax::NodeEditor::CreateEditor();
-    ed::SetCurrentEditor(s_App->NodeEditorContext);
-
-    App::set_preset(get_default_preset());
-
-
-    {
-        auto flow = std::make_shared<FrameFlow>("Default");
-
-        s_App->Flows.push_back(flow);
-    }
-
-    {
-        auto flow = std::make_shared<FrameFlow>("Simple Frame");
-        flow->stages.clear();
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 1, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 1, false, 1));
-        flow->start_next_frame_stage = flow->stages.size() - 1;
-
-        s_App->Flows.push_back(flow);
-    }
-
-    {
-        auto flow = std::make_shared<FrameFlow>("Jobification");
-        flow->stages.clear();
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 4, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 4, false, 1));
-        flow->start_next_frame_stage = flow->stages.size() - 1;
-
-        s_App->Flows.push_back(flow);
-    }
-
-    {
-        auto flow = std::make_shared<FrameFlow>("Interleave stages");
-        flow->stages.clear();
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game", 0, 1.f, 1, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render", 1, 1.f, 1, false, 1));
-        flow->start_next_frame_stage = 0;
-
-        s_App->Flows.push_back(flow);
-    }
-
-
-    {
-        auto flow = std::make_shared<FrameFlow>("Realistic Jobification");
-        flow->stages.clear();
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game1", 0, 1.f, 5, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game2", 0, 1.f, 3, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game3", 0, 1.f, 6, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render1", 1, 1.f, 8, false, 1));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render2", 1, 1.f, 4, false, 1));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render3", 1, 1.f, 6, false, 1));
-        flow->start_next_frame_stage = flow->stages.size() - 1;
-
-        s_App->Flows.push_back(flow);
-    }
-
-
-    {
-        auto flow = std::make_shared<FrameFlow>("Realistic Jobification - Interleaved");
-        flow->stages.clear();
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game1", 0, 1.f, 5, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game2", 0, 1.f, 3, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Simulate Game3", 0, 1.f, 6, false, 0));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render1", 1, 1.f, 8, true, 1));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render2", 1, 1.f, 4, true, 1));
-        flow->stages.push_back(std::make_shared<FrameStage>("Prepare Render3", 1, 1.f, 6, true, 1));
-        flow->start_next_frame_stage = 2;
-
-        s_App->Flows.push_back(flow);
-    }
-
-    s_App->Flow = s_App->Flows[0];
-}
-
-void App::set_preset(const Preset& p)
-{
-    s_App->Pattern = p.pattern();
-    if (!s_App->OnlyFramePattern)
-    {
-        s_App->SimOption = p.option();
-    }
-    s_App->SimOption.Name = p.name();
-}
-
-App& App::get() {
-    return *s_App;
-}
+#include "profiler.h"
+#include "allocation_tracker.h"
 
 static void glfw_error_callback(int error, const char* description)
 {
@@ -203,6 +98,7 @@ int main(int, char**)
     config.SettingsFile = "Simple.json";
 
     App::init();
+    profiler::set_thread_name("Main");
 
     FrameSimulator frameSimulator;
     FrameSimulator::Setting frameSimulatorSetting;
@@ -210,6 +106,10 @@ int main(int, char**)
     // Main loop
     while (!glfwWindowShouldClose(window))
     {
+        PROFILE_FRAME();
+        PROFILE_ZONE("Frame");
+        AllocationScope allocations(AllocationTag::Ui);
+
         // Poll and handle events (inputs, window resize, etc.)
         // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants to use your inputs.
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
@@ -301,9 +201,15 @@ int main(int, char**)
 
 
 
+        draw_profiler(App::get().Profiler);
+        draw_allocations(App::get().Allocations);
+
         ImGui::PopFont();
         // Rendering
-        ImGui::Render();
+        {
+            PROFILE_ZONE("ImGui::Render");
+            ImGui::Render();
+        }
         int display_w, display_h;
         glfwMakeContextCurrent(window);
         glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -313,7 +219,10 @@ int main(int, char**)
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         glfwMakeContextCurrent(window);
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
     }
 
     // Cleanup
@@ -46,7 +46,7 @@ JobType::JobType()
     strncpy(name, "No Name", 250);
 }
 
-FrameStage::FrameStage(const char* name, int s_tag, float w, int split, bool sync, int w_tag)
+FrameStage::FrameStage(const char* name, int s_tag, float w, int split, bool sync, int w_tag, bool on_gpu, int queue)
 {
     strncpy(this->name, name, 100);
     stage_tag = s_tag;
@@ -54,6 +54,8 @@ FrameStage::FrameStage(const char* name, int s_tag, float w, int split, bool syn
     split_count = split;
     wait = sync;
     wait_tag = w_tag;
+    gpu = on_gpu;
+    gpu_queue = queue;
 }
 
 
@@ -87,8 +89,15 @@ void DrawFrameEditor(std::shared_ptr<FrameFlow> frame_flow)
     ImGui::Begin("Frame Editor");
 
     ImGui::DragFloat("Duration", &frame_flow->duration, 1.f, 10.f, 2000.f);
+    ImGui::DragFloat("Gpu Duration", &frame_flow->gpu_duration, 1.f, 10.f, 2000.f);
     ImGui::InputText("Name", frame_flow->name, 200);
 
+    const CriticalPathAnalysis* critical_path = nullptr;
+    auto& sim = App::get().CurrentSimulation;
+    if (sim && sim->get_flow() == frame_flow) {
+        critical_path = &sim->get_critical_path();
+    }
+
     ed::Begin("Frame Editor", ImVec2(0, 0));
 
     auto pos = ImVec2(0.f, 0.f);
@@ -100,6 +109,11 @@ void DrawFrameEditor(std::shared_ptr<FrameFlow> frame_flow)
 
         ed::SetNodePosition(stage.id.node, pos);
 
+        bool is_critical = critical_path && critical_path->is_critical_stage(i);
+        if (is_critical) {
+            ed::PushStyleColor(ed::StyleColor_NodeBorder, ImColor(255, 0, 255, 255));
+        }
+
         ImGui::PushID(stage.id.node);
         ed::BeginNode(stage.id.node);
 
@@ -109,6 +123,62 @@ void DrawFrameEditor(std::shared_ptr<FrameFlow> frame_flow)
         ImGui::InputInt("Split", &stage.split_count, 1, 1);
         stage.split_count = stage.split_count < 1 ? 1 : stage.split_count;
 
+        ImGui::Checkbox("Gpu", &stage.gpu);
+        if (stage.gpu)
+        {
+            const char* queues[] = { "Graphics", "Async Compute" };
+            ImGui::Combo("Queue", &stage.gpu_queue, queues, 2);
+        }
+
+        DurationDistribution& distribution = stage.distribution;
+        int distribution_type = static_cast<int>(distribution.type);
+        auto get_distribution_name = [](void*, int i, const char** name) {
+            *name = distribution_name(static_cast<DistributionType>(i));
+            return true;
+        };
+        if (ImGui::Combo("Distribution", &distribution_type, get_distribution_name, nullptr, 6))
+        {
+            distribution.type = static_cast<DistributionType>(distribution_type);
+        }
+        switch (distribution.type)
+        {
+        case DistributionType::Lognormal:
+            ImGui::DragFloat("Sigma", &distribution.sigma, 0.01f, 0.f, 2.f);
+            break;
+        case DistributionType::Gamma:
+            ImGui::DragFloat("Shape", &distribution.shape, 0.05f, 0.05f, 100.f);
+            break;
+        case DistributionType::Histogram:
+        {
+            ImGui::DragFloat("Max", &distribution.histogram_max, 0.01f, 0.1f, 10.f);
+            int bin_count = (int)distribution.histogram.size();
+            if (ImGui::InputInt("Bins", &bin_count, 1, 1))
+            {
+                distribution.histogram.resize(std::max(1, std::min(bin_count, 64)), 1.f);
+            }
+            ImGui::PlotHistogram("##histogram", distribution.histogram.data(), (int)distribution.histogram.size(), 0, nullptr, 0.f, FLT_MAX, ImVec2(130.f, 40.f));
+            for (int b = 0; b < (int)distribution.histogram.size(); b++)
+            {
+                ImGui::PushID(b);
+                ImGui::DragFloat("##bin", &distribution.histogram[b], 0.1f, 0.f, 100.f, "%.2f");
+                ImGui::PopID();
+            }
+            break;
+        }
+        case DistributionType::AutoRegressive:
+            ImGui::DragFloat("Sigma", &distribution.sigma, 0.01f, 0.f, 2.f);
+            ImGui::DragFloat("Correlation", &distribution.correlation, 0.01f, -0.99f, 0.99f);
+            break;
+        case DistributionType::Markov:
+            ImGui::DragFloat("Sigma", &distribution.sigma, 0.01f, 0.f, 2.f);
+            ImGui::DragFloat("Spike Probability", &distribution.spike_probability, 0.005f, 0.f, 1.f);
+            ImGui::DragFloat("Spike Persistence", &distribution.spike_persistence, 0.01f, 0.f, 1.f);
+            ImGui::DragFloat("Spike Ratio", &distribution.spike_ratio, 0.05f, 1.f, 20.f);
+            break;
+        default:
+            break;
+        }
+
         ImGui::Checkbox("Wait", &stage.wait);
         ImGui::InputInt("Wait Tag", &stage.wait_tag);
         ImGui::InputInt("Stage Tag", &stage.stage_tag);
@@ -135,6 +205,10 @@ void DrawFrameEditor(std::shared_ptr<FrameFlow> frame_flow)
 
         ImGui::Text(stage.name);
 
+        if (critical_path && i < (int)critical_path->stage_critical_ratio.size())
+        {
+            ImGui::Text("Slack: %.2f (critical %d%%)", critical_path->stage_mean_slack[i], (int)(critical_path->stage_critical_ratio[i] * 100.f));
+        }
 
         if (i < frame_flow->stages.size() - 1)
         {
@@ -147,7 +221,8 @@ void DrawFrameEditor(std::shared_ptr<FrameFlow> frame_flow)
 
         if (ImGui::Button("Add"))
         {
-            auto new_stage = std::make_shared<FrameStage>(stage.name, stage.stage_tag, stage.weight, stage.split_count, stage.wait, stage.wait_tag);
+            auto new_stage = std::make_shared<FrameStage>(stage.name, stage.stage_tag, stage.weight, stage.split_count, stage.wait, stage.wait_tag, stage.gpu, stage.gpu_queue);
+            new_stage->distribution = stage.distribution;
             frame_flow->stages.insert(frame_flow->stages.begin() + i, new_stage);
             ImGui::SameLine();
         }
@@ -165,6 +240,10 @@ void DrawFrameEditor(std::shared_ptr<FrameFlow> frame_flow)
 
         ImGui::PopItemWidth();
         ed::EndNode();
+
+        if (is_critical) {
+            ed::PopStyleColor();
+        }
     }
 
     ed::End();
@@ -561,35 +640,97 @@ float FrameFlow::compute_critical_path_time()
     float time = 0.f;
     for (int i = 0; i < stages.size(); i++)
     {
-        time += stage_duration(i);
+        if (!stages[i]->gpu)
+        {
+            time += stage_duration(i);
+        }
     }
 
     return time;
 }
 
+float FrameFlow::compute_total_work()
+{
+    float work = 0.f;
+    for (int i = 0; i < (int)stages.size(); i++)
+    {
+        if (!stages[i]->gpu)
+        {
+            work += stage_duration(i) * stages[i]->split_count;
+        }
+    }
+
+    return work;
+}
+
 float FrameFlow::stage_duration(int index)
 {
     float total = 0.f;
 
+    // Cpu and Gpu stages share their own duration
     for (auto s : stages)
     {
-        total += s->weight;
+        if (s->gpu == stages[index]->gpu)
+        {
+            total += s->weight;
+        }
     }
 
     total *= (float) stages[index]->split_count;
     
     float coeff = stages[index]->weight / total;
-    float val = duration * coeff;
+    float val = (stages[index]->gpu ? gpu_duration : duration) * coeff;
 
     return val;
 }
 
+int FrameFlow::gpu_queue_count()
+{
+    int count = 0;
+    for (auto s : stages)
+    {
+        if (s->gpu)
+        {
+            count = std::max(count, s->gpu_queue + 1);
+        }
+    }
+
+    return count;
+}
+
+bool FrameFlow::is_kick_stage(int index)
+{
+    return !stages[index]->gpu && index + 1 < (int)stages.size() && stages[index + 1]->gpu;
+}
+
+int FrameFlow::previous_cpu_stage(int index)
+{
+    for (int i = index - 1; i >= 0; i--)
+    {
+        if (!stages[i]->gpu)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int FrameFlow::last_cpu_stage()
+{
+    return previous_cpu_stage((int)stages.size());
+}
+
 void create_job(std::shared_ptr<FrameFlow> flow, int index, Simulator* sim, std::shared_ptr<Frame> frame)
 {
+    if (flow->stages[index]->gpu) {
+        sim->submit_gpu_stage(frame);
+    }
+
     int count = flow->stages[index]->split_count;
     if (count > 1) {
 
-        auto counter = std::make_shared<int>(count);
+        auto counter = std::make_shared<DependencyCounter>(count);
         for (int i = 0; i < count; i++) {
             sim->push_job(std::make_shared<PatternJob>(flow, index, sim, frame, counter));
         }
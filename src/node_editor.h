@@ -8,6 +8,8 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#include "distribution.h"
+
 void DrawNodeEditor(bool* opened);
 
 void OtherNodeEditor(bool *opened);
@@ -62,7 +64,7 @@ struct ID
 };
 
 struct FrameStage {
-    FrameStage::FrameStage(const char* name, int stage_tag, float w, int split, bool wait, int wait_tag);
+    FrameStage::FrameStage(const char* name, int stage_tag, float w, int split, bool wait, int wait_tag, bool gpu = false, int gpu_queue = 0);
 
     char name[101];
     float weight;
@@ -71,6 +73,9 @@ struct FrameStage {
     int wait_tag = -1;
     int stage_tag;
     bool create_has_priority = false;
+    bool gpu = false;
+    int gpu_queue = 0;
+    DurationDistribution distribution;
 
     ID id;
 };
@@ -81,13 +86,20 @@ struct FrameFlow {
     std::vector<std::shared_ptr<FrameStage>> stages;
     
     float duration = 90.f;
+    float gpu_duration = 90.f;
     int start_next_frame_stage = 0;
 
     float compute_critical_path_time();
+    float compute_total_work();
 
     float stage_duration(int index);
     int count_stage(int wait_tag);
 
+    int gpu_queue_count();
+    bool is_kick_stage(int index);
+    int previous_cpu_stage(int index);
+    int last_cpu_stage();
+
     char name[201];
 };
 
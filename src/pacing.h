@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+enum class PacingMode
+{
+    Default,
+    JustInTime,
+};
+
+enum class PacingPrediction
+{
+    LastFrame,
+    Average,
+    Conservative,
+};
+
+enum class LimiterMode
+{
+    Off,
+    FixedInterval,
+    VsyncDivisor,
+    Adaptive,
+};
+
+// Predict the next value of a series of samples ordered from the oldest to the newest.
+// A conservative prediction picks the sample which delays the frame start the least.
+template <class T>
+T predict_pacing_sample(const T* samples, int count, PacingPrediction prediction, bool delay_when_high)
+{
+    if (count <= 0) {
+        return T(0);
+    }
+
+    switch (prediction) {
+    case PacingPrediction::Average: {
+        T total = T(0);
+        for (int i = 0; i < count; i++) {
+            total += samples[i];
+        }
+        return total / count;
+    }
+    case PacingPrediction::Conservative:
+        if (delay_when_high) {
+            return *std::min_element(samples, samples + count);
+        }
+        return *std::max_element(samples, samples + count);
+    default:
+        return samples[count - 1];
+    }
+}
+
+// Frame rate limiter of both simulators, in the time unit of the simulator
+template <class T>
+struct FrameLimiter
+{
+    LimiterMode mode = LimiterMode::Off;
+    T fixed_interval = T(0);
+    T vsync_period = T(1);
+    // Divisor of VsyncDivisor, and the highest one Adaptive drops to
+    int max_divisor = 1;
+    // Frames in a row after which Adaptive changes its divisor
+    int miss_count_limit = 1;
+
+    int divisor = 1;
+    int miss_count = 0;
+    int fit_count = 0;
+
+    // Minimal interval between two presents
+    T interval() const
+    {
+        switch (mode) {
+        case LimiterMode::FixedInterval:
+            return fixed_interval;
+        case LimiterMode::VsyncDivisor:
+            return max_divisor * vsync_period;
+        case LimiterMode::Adaptive:
+            return divisor * vsync_period;
+        default:
+            return T(0);
+        }
+    }
+
+    // Drop to the next divisor when the budget is missed for N frames in a row,
+    // go back up when the previous budget is met for N frames in a row
+    void update(T unlimited_interval)
+    {
+        if (mode != LimiterMode::Adaptive) {
+            return;
+        }
+
+        bool missed = unlimited_interval > divisor * vsync_period;
+        bool fits = divisor > 1 && unlimited_interval <= (divisor - 1) * vsync_period;
+        miss_count = missed ? miss_count + 1 : 0;
+        fit_count = fits ? fit_count + 1 : 0;
+        if (miss_count >= miss_count_limit && divisor < max_divisor) {
+            divisor += 1;
+            miss_count = 0;
+        }
+        if (fit_count >= miss_count_limit) {
+            divisor -= 1;
+            fit_count = 0;
+        }
+    }
+};
+
+// The last samples of a series, in a ring of fixed capacity
+template <class T>
+class PacingSamples
+{
+public:
+    void reset(int capacity)
+    {
+        m_capacity = std::max(capacity, 1);
+        m_samples.clear();
+        m_samples.reserve(m_capacity);
+        m_next = 0;
+    }
+
+    void push(T sample)
+    {
+        if ((int)m_samples.size() < m_capacity) {
+            m_samples.push_back(sample);
+        } else {
+            m_samples[m_next] = sample;
+        }
+        m_next = (m_next + 1) % m_capacity;
+    }
+
+    int count() const { return (int)m_samples.size(); }
+    int capacity() const { return m_capacity; }
+
+    // The average and the extremes do not depend on the order, the last frame is the newest sample
+    T predict(PacingPrediction prediction, bool delay_when_high) const
+    {
+        if (m_samples.empty()) {
+            return T(0);
+        }
+        if (prediction == PacingPrediction::LastFrame) {
+            return m_samples[(m_next + count() - 1) % count()];
+        }
+        return predict_pacing_sample(m_samples.data(), count(), prediction, delay_when_high);
+    }
+
+private:
+    std::vector<T> m_samples;
+    int m_capacity = 1;
+    // Where the next sample is written once the ring is full
+    int m_next = 0;
+};
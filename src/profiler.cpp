@@ -0,0 +1,335 @@
+#include "profiler.h"
+
+#include "imgui.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Zones kept per thread, the oldest are overwritten
+constexpr uint64_t ZoneCapacity = uint64_t(1) << 16;
+constexpr uint64_t FrameCapacity = 256;
+
+const Clock::time_point g_Epoch = Clock::now();
+std::atomic<bool> g_Enabled{ false };
+
+struct ThreadBuffer
+{
+    std::string name;
+    std::vector<ProfileZone> zones = std::vector<ProfileZone>(ZoneCapacity);
+    uint64_t count = 0;
+    // Taken by the thread for each zone and by a capture, almost never contended
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    // Only touched by the thread which owns the buffer
+    int depth = 0;
+    bool in_use = false;
+
+    void acquire()
+    {
+        while (lock.test_and_set(std::memory_order_acquire)) {
+        }
+    }
+    void release() { lock.clear(std::memory_order_release); }
+};
+
+std::mutex g_BuffersMutex;
+// Buffers of exited threads are reused, threads of the ensemble come and go
+std::vector<std::unique_ptr<ThreadBuffer>> g_Buffers;
+
+std::mutex g_FramesMutex;
+int64_t g_FrameStarts[FrameCapacity];
+uint64_t g_FrameCount = 0;
+
+struct ThreadRegistration
+{
+    ThreadRegistration()
+    {
+        std::lock_guard<std::mutex> lock(g_BuffersMutex);
+        for (const auto& b : g_Buffers) {
+            if (!b->in_use) {
+                buffer = b.get();
+                break;
+            }
+        }
+        if (!buffer) {
+            g_Buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+            buffer = g_Buffers.back().get();
+            buffer->name = "Thread " + std::to_string(g_Buffers.size() - 1);
+        }
+        buffer->in_use = true;
+    }
+
+    ~ThreadRegistration()
+    {
+        std::lock_guard<std::mutex> lock(g_BuffersMutex);
+        buffer->depth = 0;
+        buffer->in_use = false;
+    }
+
+    ThreadBuffer* buffer = nullptr;
+};
+
+ThreadBuffer& thread_buffer()
+{
+    thread_local ThreadRegistration registration;
+    return *registration.buffer;
+}
+
+#ifdef FCSIM_PROFILER
+// The captures are only drawn when the zones are compiled in
+uint32_t zone_color(const char* name)
+{
+    // FNV-1a of the name, so that a zone keeps its color from frame to frame
+    uint32_t hash = 2166136261u;
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    // Light colors, the text is drawn in black
+    return 0xff000000 | (hash & 0x007f7f7f) | 0x00808080;
+}
+
+// Boxes narrower than a pixel are merged with their neighbours, a capture of the ensemble holds many thousands
+void add_box(std::vector<TraceBox>& lane, const TraceBox& box, double min_width)
+{
+    if (!lane.empty() && box.end - box.start < min_width) {
+        TraceBox& last = lane.back();
+        if (last.end - last.start < min_width && box.start - last.end < min_width) {
+            last.end = box.end;
+            last.name = "...";
+            last.color = 0xff808080;
+            return;
+        }
+    }
+    lane.push_back(box);
+}
+
+void build_lanes(ProfilerView& view)
+{
+    const ProfileCapture& capture = view.capture;
+    const double ms = 1e-6;
+    const double min_width = 1.0 / view.pixels_per_ms;
+
+    view.lane_names.clear();
+    view.lanes.clear();
+    view.frame_labels.clear();
+
+    view.lane_names.push_back("Frames");
+    view.lanes.emplace_back();
+    for (size_t i = 0; i < capture.frame_starts.size(); i++) {
+        const int64_t end = i + 1 < capture.frame_starts.size() ? capture.frame_starts[i + 1] : capture.end;
+        char label[32];
+        snprintf(label, sizeof(label), "%.2f ms", (end - capture.frame_starts[i]) * ms);
+        view.frame_labels.push_back(label);
+    }
+    for (size_t i = 0; i < capture.frame_starts.size(); i++) {
+        const int64_t end = i + 1 < capture.frame_starts.size() ? capture.frame_starts[i + 1] : capture.end;
+        view.lanes.back().push_back(TraceBox{ (capture.frame_starts[i] - capture.start) * ms, (end - capture.start) * ms, view.frame_labels[i].c_str(), (int)i, 0xff606060, TraceBoxType::Normal });
+    }
+
+    for (const ProfileThread& thread : capture.threads) {
+        int depth_count = 0;
+        for (const ProfileZone& z : thread.zones) {
+            depth_count = std::max(depth_count, z.depth + 1);
+        }
+        const size_t first = view.lanes.size();
+        for (int d = 0; d < depth_count; d++) {
+            view.lane_names.push_back(d == 0 ? thread.name : std::string());
+            view.lanes.emplace_back();
+        }
+        // Zones end in order, a parent after its children: sort by start so that each lane is sorted
+        std::vector<ProfileZone> zones = thread.zones;
+        std::sort(zones.begin(), zones.end(), [](const ProfileZone& a, const ProfileZone& b) { return a.start < b.start; });
+        for (const ProfileZone& z : zones) {
+            add_box(view.lanes[first + z.depth], TraceBox{ (z.start - capture.start) * ms, (z.end - capture.start) * ms, z.name, -1, zone_color(z.name), TraceBoxType::Normal }, min_width);
+        }
+    }
+}
+
+void draw_summary(const ProfileCapture& capture)
+{
+    struct Total
+    {
+        int count = 0;
+        int64_t duration = 0;
+    };
+    std::map<std::string, Total> totals;
+    for (const ProfileThread& thread : capture.threads) {
+        for (const ProfileZone& z : thread.zones) {
+            Total& t = totals[z.name];
+            t.count += 1;
+            t.duration += z.end - z.start;
+        }
+    }
+
+    const float frame_count = (float)std::max(1, capture.frame_count);
+    ImGui::Columns(3, "profile summary");
+    ImGui::Text("Zone");
+    ImGui::NextColumn();
+    ImGui::Text("Calls / frame");
+    ImGui::NextColumn();
+    ImGui::Text("ms / frame");
+    ImGui::NextColumn();
+    ImGui::Separator();
+    for (const auto& t : totals) {
+        ImGui::Text("%s", t.first.c_str());
+        ImGui::NextColumn();
+        ImGui::Text("%.1f", t.second.count / frame_count);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", t.second.duration * 1e-6f / frame_count);
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+}
+#endif
+
+}
+
+namespace profiler {
+
+void set_enabled(bool enabled)
+{
+    g_Enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool is_enabled()
+{
+    return g_Enabled.load(std::memory_order_relaxed);
+}
+
+void set_thread_name(const char* name)
+{
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(g_BuffersMutex);
+    buffer.name = name;
+}
+
+void begin_frame()
+{
+    const int64_t time = now();
+    std::lock_guard<std::mutex> lock(g_FramesMutex);
+    g_FrameStarts[g_FrameCount % FrameCapacity] = time;
+    g_FrameCount += 1;
+}
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - g_Epoch).count();
+}
+
+int enter()
+{
+    return thread_buffer().depth++;
+}
+
+void record(const char* name, int64_t start, int depth)
+{
+    const int64_t end = now();
+    ThreadBuffer& buffer = thread_buffer();
+    buffer.depth = depth;
+
+    buffer.acquire();
+    buffer.zones[buffer.count % ZoneCapacity] = ProfileZone{ name, start, end, depth };
+    buffer.count += 1;
+    buffer.release();
+}
+
+ProfileCapture capture(int frame_count)
+{
+    ProfileCapture capture;
+    {
+        // The last complete frames, the current one is still being recorded
+        std::lock_guard<std::mutex> lock(g_FramesMutex);
+        const uint64_t complete = g_FrameCount > 0 ? g_FrameCount - 1 : 0;
+        const uint64_t count = std::min<uint64_t>({ (uint64_t)std::max(1, frame_count), complete, FrameCapacity - 1 });
+        if (count == 0) {
+            return capture;
+        }
+        for (uint64_t i = complete - count; i < complete; i++) {
+            capture.frame_starts.push_back(g_FrameStarts[i % FrameCapacity]);
+        }
+        capture.start = capture.frame_starts.front();
+        capture.end = g_FrameStarts[complete % FrameCapacity];
+        capture.frame_count = (int)count;
+    }
+
+    std::lock_guard<std::mutex> lock(g_BuffersMutex);
+    for (const auto& b : g_Buffers) {
+        ProfileThread thread;
+        thread.name = b->name;
+
+        // Zones are stored by end time, walk back from the newest
+        b->acquire();
+        const uint64_t oldest = b->count > ZoneCapacity ? b->count - ZoneCapacity : 0;
+        for (uint64_t i = b->count; i > oldest; i--) {
+            const ProfileZone& z = b->zones[(i - 1) % ZoneCapacity];
+            if (z.end < capture.start) {
+                break;
+            }
+            if (z.start <= capture.end) {
+                thread.zones.push_back(z);
+            }
+        }
+        b->release();
+
+        if (!thread.zones.empty()) {
+            std::reverse(thread.zones.begin(), thread.zones.end());
+            capture.threads.push_back(std::move(thread));
+        }
+    }
+    return capture;
+}
+
+}
+
+void draw_profiler(ProfilerView& view)
+{
+    ImGui::SetNextWindowSize(ImVec2(1200, 400), ImGuiCond_FirstUseEver);
+    ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_HorizontalScrollbar);
+
+#ifdef FCSIM_PROFILER
+    ImGui::Checkbox("Record", &view.record);
+    profiler::set_enabled(view.record);
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &view.paused);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(150.f);
+    ImGui::SliderInt("Frames", &view.frame_count, 1, 60);
+    ImGui::SameLine();
+    ImGui::SliderFloat("Pixels / ms", &view.pixels_per_ms, 10.f, 10000.f, "%.0f", 3.f);
+    ImGui::PopItemWidth();
+
+    if (!view.paused) {
+        view.capture = profiler::capture(view.frame_count);
+        build_lanes(view);
+    }
+
+    if (ImGui::TreeNode("Summary")) {
+        draw_summary(view.capture);
+        ImGui::TreePop();
+    }
+
+    draw_trace_lanes(
+        (int)view.lanes.size(), [&](int lane) { return view.lane_names[lane].c_str(); },
+        [&](int lane, double from, double to, const std::function<void(const TraceBox&)>& draw) {
+            for (const TraceBox& box : view.lanes[lane]) {
+                if (box.end >= from && box.start <= to) {
+                    draw(box);
+                }
+            }
+        },
+        (view.capture.end - view.capture.start) * 1e-6, view.pixels_per_ms, view.lane_height);
+#else
+    (void)view;
+    ImGui::TextUnformatted("Built without FCSIM_PROFILER");
+#endif
+
+    ImGui::End();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "trace_file.h"
+
+// Scoped zones of the application itself, timed on every thread into a ring buffer
+// per thread. The macros compile to nothing unless FCSIM_PROFILER is defined, and
+// record nothing while the profiler is disabled.
+//
+//     void Simulator::step(bool autostep)
+//     {
+//         PROFILE_ZONE("Simulator::step");
+//         ...
+
+struct ProfileZone
+{
+    // Static string, zones only keep the pointer
+    const char* name;
+    // Nanoseconds since the profiler started
+    int64_t start;
+    int64_t end;
+    // Zones open on the thread when this one started
+    int depth;
+};
+
+struct ProfileThread
+{
+    std::string name;
+    std::vector<ProfileZone> zones;
+};
+
+// Zones of every thread over the last UI frames
+struct ProfileCapture
+{
+    int64_t start = 0;
+    int64_t end = 0;
+    int frame_count = 0;
+    std::vector<int64_t> frame_starts;
+    std::vector<ProfileThread> threads;
+};
+
+namespace profiler {
+
+void set_enabled(bool enabled);
+bool is_enabled();
+
+// Names the lane of the calling thread
+void set_thread_name(const char* name);
+
+// Marks the start of a UI frame, called once per loop by the main thread
+void begin_frame();
+
+// Used by ProfileScope
+int64_t now();
+int enter();
+void record(const char* name, int64_t start, int depth);
+
+ProfileCapture capture(int frame_count);
+
+}
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : m_name(profiler::is_enabled() ? name : nullptr)
+    {
+        if (m_name) {
+            m_depth = profiler::enter();
+            m_start = profiler::now();
+        }
+    }
+
+    ~ProfileScope()
+    {
+        if (m_name) {
+            profiler::record(m_name, m_start, m_depth);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    int64_t m_start = 0;
+    int m_depth = 0;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef FCSIM_PROFILER
+#define PROFILE_ZONE(name) ProfileScope PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FRAME() profiler::begin_frame()
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#endif
+
+struct ProfilerView
+{
+    bool record = true;
+    bool paused = false;
+    int frame_count = 4;
+    float pixels_per_ms = 200.f;
+    float lane_height = 20.f;
+    ProfileCapture capture;
+
+    // A lane of frames, then one lane per thread and zone depth
+    std::vector<std::string> lane_names;
+    std::vector<std::vector<TraceBox>> lanes;
+    std::vector<std::string> frame_labels;
+};
+
+// Rolling timeline of the last frames, one lane per thread and zone depth
+void draw_profiler(ProfilerView& view);
@@ -0,0 +1,135 @@
+#include "simulation_cache.h"
+
+#include <algorithm>
+
+SimulationCache::SimulationCache(size_t capacity, int thread_count)
+    : m_capacity(std::max<size_t>(1, capacity))
+{
+    // Leave a core to the ui thread
+    if (thread_count <= 0) {
+        thread_count = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        m_threads.emplace_back([this]() { worker(); });
+    }
+}
+
+std::shared_ptr<SimulationCache> SimulationCache::shared()
+{
+    static std::mutex mutex;
+    static std::weak_ptr<SimulationCache> shared;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto cache = shared.lock();
+    if (!cache) {
+        cache = std::make_shared<SimulationCache>();
+        shared = cache;
+    }
+    return cache;
+}
+
+SimulationCache::~SimulationCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_pending.clear();
+    }
+    m_condition.notify_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+std::shared_ptr<const FrameSimulator::Result> SimulationCache::get(const FrameSetting& setting)
+{
+    const uint64_t fingerprint = setting.Fingerprint();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // A worker already simulating this setting finishes sooner than a new simulation
+    m_condition.wait(lock, [&]() { return m_running.count(fingerprint) == 0; });
+
+    auto it = m_index.find(fingerprint);
+    if (it != m_index.end()) {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        Entry& entry = *it->second;
+        m_hit_count += 1;
+        if (entry.speculative) {
+            m_speculative_hit_count += 1;
+            entry.speculative = false;
+        }
+        return entry.result;
+    }
+
+    m_miss_count += 1;
+    lock.unlock();
+    auto result = FrameSimulator::Compute(setting);
+    lock.lock();
+    insert(fingerprint, result, false);
+    return result;
+}
+
+void SimulationCache::speculate(std::vector<FrameSetting> settings)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.assign(settings.begin(), settings.end());
+    }
+    m_condition.notify_all();
+}
+
+SimulationCacheStatistics SimulationCache::statistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SimulationCacheStatistics stats;
+    stats.size = m_entries.size();
+    stats.pending = m_pending.size() + m_running.size();
+    stats.hit_count = m_hit_count;
+    stats.speculative_hit_count = m_speculative_hit_count;
+    stats.miss_count = m_miss_count;
+    return stats;
+}
+
+void SimulationCache::worker()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_condition.wait(lock, [&]() { return m_stop || !m_pending.empty(); });
+        if (m_stop) {
+            return;
+        }
+
+        FrameSetting setting = std::move(m_pending.front());
+        m_pending.pop_front();
+        const uint64_t fingerprint = setting.Fingerprint();
+        if (m_index.count(fingerprint) != 0 || m_running.count(fingerprint) != 0) {
+            continue;
+        }
+
+        m_running.insert(fingerprint);
+        lock.unlock();
+        auto result = FrameSimulator::Compute(setting);
+        lock.lock();
+        m_running.erase(fingerprint);
+        insert(fingerprint, result, true);
+        m_condition.notify_all();
+    }
+}
+
+void SimulationCache::insert(uint64_t fingerprint, std::shared_ptr<const FrameSimulator::Result> result, bool speculative)
+{
+    auto it = m_index.find(fingerprint);
+    if (it != m_index.end()) {
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+
+    m_entries.push_front({ fingerprint, std::move(result), speculative });
+    m_index[fingerprint] = m_entries.begin();
+
+    while (m_entries.size() > m_capacity) {
+        m_index.erase(m_entries.back().fingerprint);
+        m_entries.pop_back();
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "simulator.h"
+
+struct SimulationCacheStatistics
+{
+    size_t size = 0;
+    size_t pending = 0;
+    int hit_count = 0;
+    int speculative_hit_count = 0;
+    int miss_count = 0;
+};
+
+// Least recently used frame simulator results keyed by the settings fingerprint.
+// Worker threads simulate the speculated settings while the cache is not asked
+// for anything, so that the next slider value is usually already simulated.
+class SimulationCache
+{
+public:
+    explicit SimulationCache(size_t capacity = 64, int thread_count = 0);
+    ~SimulationCache();
+
+    SimulationCache(const SimulationCache&) = delete;
+    SimulationCache& operator=(const SimulationCache&) = delete;
+
+    // One cache and one pool of workers for all the frame simulators alive
+    static std::shared_ptr<SimulationCache> shared();
+
+    // Simulates on the calling thread when the result is neither cached nor being simulated
+    std::shared_ptr<const FrameSimulator::Result> get(const FrameSetting& setting);
+
+    // Replaces the settings waiting to be simulated
+    void speculate(std::vector<FrameSetting> settings);
+
+    SimulationCacheStatistics statistics() const;
+
+private:
+    struct Entry
+    {
+        uint64_t fingerprint;
+        std::shared_ptr<const FrameSimulator::Result> result;
+        bool speculative;
+    };
+
+    void worker();
+    // Called with the mutex held
+    void insert(uint64_t fingerprint, std::shared_ptr<const FrameSimulator::Result> result, bool speculative);
+
+    const size_t m_capacity;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::list<Entry> m_entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+    std::deque<FrameSetting> m_pending;
+    std::unordered_set<uint64_t> m_running;
+    bool m_stop = false;
+
+    int m_hit_count = 0;
+    int m_speculative_hit_count = 0;
+    int m_miss_count = 0;
+
+    std::vector<std::thread> m_threads;
+};
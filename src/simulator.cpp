@@ -1,13 +1,22 @@
 #include "simulator.h"
+#include "simulation_cache.h"
 #include "debug.h"
+#include "profiler.h"
+#include "allocation_tracker.h"
 #include "imgui.h"
 #include "imgui_internal.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
 #include <sstream>
+#include <string>
 
 #include <assert.h>
 #include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace {
 
@@ -62,6 +71,37 @@ namespace {
         float r = static_cast<float>(static_cast<int>(f * 100.f)) / 100.f;
         f = r;
     }
+
+    // Drag widgets round their value to the precision of their "%f" format
+    float RoundLikeDrag(float f)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "%f", f);
+        return strtof(text, nullptr);
+    }
+
+    // Settings one drag step away from the current one, for the parameters tuned the most
+    std::vector<FrameSetting> NeighbourSettings(const FrameSetting& setting)
+    {
+        std::vector<FrameSetting> settings;
+        for (int direction : { 1, -1 }) {
+            FrameSetting gpu = setting;
+            gpu.GpuDuration = RoundLikeDrag(std::min(2.f, std::max(0.f, setting.GpuDuration + direction * 0.01f)));
+            gpu.CpuKickDuration = std::min(gpu.CpuKickDuration, gpu.GpuDuration);
+            settings.push_back(gpu);
+
+            FrameSetting ratio = setting;
+            ratio.CpuSimRatio = RoundLikeDrag(std::min(1.f, std::max(0.f, setting.CpuSimRatio + direction * 0.01f)));
+            ratio.CpuSimDuration = ratio.CpuSimRatio * ratio.CpuDuration;
+            ratio.CpuPrepDuration = ratio.CpuDuration - ratio.CpuSimDuration;
+            settings.push_back(ratio);
+
+            FrameSetting frames = setting;
+            frames.frameCount = std::min(16, std::max(1, setting.frameCount + direction));
+            settings.push_back(frames);
+        }
+        return settings;
+    }
 }
 
 void FrameSimulator::DrawOptions(FrameSimulator::Setting& setting)
@@ -156,7 +196,121 @@ void FrameSimulator::DrawOptions(FrameSimulator::Setting& setting)
             }
         }
         ImGui::DragScalar("Time Resolution", ImGuiDataType_S32, &setting.resolution, 1, &s32_0, &s32_100000);
-        ImGui::Checkbox("Vsync Enabled", &setting.vsyncEnabled);
+
+        const char* presentModes[] = { "FIFO", "Mailbox", "Immediate", "VRR" };
+        int presentMode = static_cast<int>(setting.presentMode);
+        if (ImGui::Combo("Present Mode", &presentMode, presentModes, array_size(presentModes))) {
+            setting.presentMode = static_cast<PresentMode>(presentMode);
+        }
+        ImGui::SliderInt("Swapchain Depth", &setting.swapchainDepth, 1, 4);
+        ImGui::DragScalar("VRR Min Period", ImGuiDataType_Float, &setting.vrrMinPeriod, 0.01f, &f32_0, &f32_1, "%f", 1.0f);
+        ImGui::DragScalar("VRR Max Period", ImGuiDataType_Float, &setting.vrrMaxPeriod, 0.01f, &f32_1, &f32_4, "%f", 1.0f);
+    }
+
+    if (ImGui::CollapsingHeader("Present Statistics", ImGuiTreeNodeFlags_DefaultOpen)) {
+        const PresentStatistics& stats = m_result->presentStatistics;
+        ImGui::Text("Presented: %d, Dropped: %d", stats.presentedCount, stats.droppedCount);
+        ImGui::Text("Duplicated: %d, Torn: %d", stats.duplicatedCount, stats.tornCount);
+        ImGui::Text("Latency: avg %.3f, min %.3f, max %.3f", stats.averageLatency, stats.minLatency, stats.maxLatency);
+        ImGui::Text("Frame Interval: avg %.3f, std dev %.3f", stats.averageInterval, std::sqrt(stats.intervalVariance));
+    }
+
+    if (ImGui::CollapsingHeader("Limiter", ImGuiTreeNodeFlags_DefaultOpen)) {
+        const char* limiterModes[] = { "Off", "Fixed Interval", "Vsync Divisor", "Adaptive" };
+        int limiterMode = static_cast<int>(setting.limiterMode);
+        if (ImGui::Combo("Limiter Mode", &limiterMode, limiterModes, array_size(limiterModes))) {
+            setting.limiterMode = static_cast<LimiterMode>(limiterMode);
+        }
+        ImGui::DragScalar("Target Interval", ImGuiDataType_Float, &setting.limiterInterval, 0.01f, &f32_0, &f32_4, "%f", 1.0f);
+        ImGui::SliderInt("Vsync Divisor", &setting.limiterDivisor, 1, 4);
+        ImGui::SliderInt("Adaptive Miss Count", &setting.limiterMissCount, 1, 16);
+    }
+
+    if (ImGui::CollapsingHeader("Pacing", ImGuiTreeNodeFlags_DefaultOpen)) {
+        const char* pacingModes[] = { "Default", "Just In Time" };
+        int pacingMode = static_cast<int>(setting.pacingMode);
+        if (ImGui::Combo("Pacing Mode", &pacingMode, pacingModes, array_size(pacingModes))) {
+            setting.pacingMode = static_cast<PacingMode>(pacingMode);
+        }
+        const char* pacingPredictions[] = { "Last Frame", "Average", "Conservative" };
+        int pacingPrediction = static_cast<int>(setting.pacingPrediction);
+        if (ImGui::Combo("Prediction", &pacingPrediction, pacingPredictions, array_size(pacingPredictions))) {
+            setting.pacingPrediction = static_cast<PacingPrediction>(pacingPrediction);
+        }
+        ImGui::DragScalar("Safety Margin", ImGuiDataType_Float, &setting.pacingMargin, 0.01f, &f32_0, &f32_1, "%f", 1.0f);
+        ImGui::DragScalar("Prediction Sample Count", ImGuiDataType_S32, &setting.pacingSampleCount, 1, &s32_1, &s32_64);
+
+        if (setting.pacingMode != PacingMode::Default) {
+            const PresentStatistics& paced = m_result->presentStatistics;
+            const PresentStatistics& unpaced = m_result->defaultPresentStatistics;
+            ImGui::Columns(3, "pacing");
+            ImGui::NextColumn();
+            ImGui::Text("Default"); ImGui::NextColumn();
+            ImGui::Text("%s", pacingModes[pacingMode]); ImGui::NextColumn();
+            ImGui::Text("Avg Latency"); ImGui::NextColumn();
+            ImGui::Text("%.3f", unpaced.averageLatency); ImGui::NextColumn();
+            ImGui::Text("%.3f", paced.averageLatency); ImGui::NextColumn();
+            ImGui::Text("Max Latency"); ImGui::NextColumn();
+            ImGui::Text("%.3f", unpaced.maxLatency); ImGui::NextColumn();
+            ImGui::Text("%.3f", paced.maxLatency); ImGui::NextColumn();
+            ImGui::Text("Avg Interval"); ImGui::NextColumn();
+            ImGui::Text("%.3f", unpaced.averageInterval); ImGui::NextColumn();
+            ImGui::Text("%.3f", paced.averageInterval); ImGui::NextColumn();
+            ImGui::Columns(1);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Statistics")) {
+        draw_frame_statistics(m_result->frameStatistics);
+    }
+
+    if (ImGui::CollapsingHeader("Speculation")) {
+        ImGui::Checkbox("Simulate Neighbour Settings", &setting.speculate);
+        ImGui::TextWrapped("Gpu Duration, CpuSim Ratio and Frame Count one step away are simulated in the background");
+        if (m_cache) {
+            SimulationCacheStatistics stats = m_cache->statistics();
+            ImGui::Text("Cached: %d, Pending: %d", (int)stats.size, (int)stats.pending);
+            ImGui::Text("Hits: %d (%d speculated), Misses: %d", stats.hit_count, stats.speculative_hit_count, stats.miss_count);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Capture")) {
+        if (draw_capture_import(m_captureImport)) {
+            setting.SetCapture(m_captureImport.capture);
+        }
+        ImGui::Checkbox("Replay Capture", &setting.replayCapture);
+        ImGui::TextWrapped("Replayed stages: CpuSim, CpuPrep, CpuKick and Gpu, in milliseconds");
+    }
+
+    if (ImGui::CollapsingHeader("Export")) {
+        if (ImGui::Button("Export Chrome Trace")) {
+            ExportTrace(setting, TraceFormat::ChromeJson, (std::string("frame_simulator") + trace_extension(TraceFormat::ChromeJson)).c_str());
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export Perfetto Trace")) {
+            ExportTrace(setting, TraceFormat::Perfetto, (std::string("frame_simulator") + trace_extension(TraceFormat::Perfetto)).c_str());
+        }
+        draw_trace_file_controls(m_traceFiles, [&](const std::string& path, std::string& error) {
+            return SaveTrace(setting, path.c_str(), error);
+        });
+    }
+
+    if (ImGui::CollapsingHeader("Compare")) {
+        if (ImGui::Button("Keep Current")) {
+            char name[128];
+            snprintf(name, sizeof(name), "Kept %d (Gpu %.2f, Frames %d)", (int)m_keptResults.size(), setting.GpuDuration, setting.frameCount);
+            m_keptResults.push_back({ name, setting.resolution, m_result });
+        }
+
+        std::vector<FrameDiffSource> sources;
+        sources.push_back({ "Current", [this, &setting]() { return Summarize(*m_result, setting.resolution, "Current"); } });
+        for (const auto& k : m_keptResults) {
+            sources.push_back({ k.name, [k]() { return Summarize(*k.result, k.resolution, k.name); } });
+        }
+        for (const auto& t : m_traceFiles.opened) {
+            sources.push_back({ t->path(), [t]() { return summarize_frames(*t, t->path()); } });
+        }
+        draw_frame_diff_controls(m_frameDiff, sources);
     }
 
     if (ImGui::CollapsingHeader("Perturbation", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -188,6 +342,84 @@ namespace {
     class CpuKickJob;
     class GpuJob;
 
+    int PredictPresentTime(const SimulationContext& context, int gpuStopTime, int previousPresentTime)
+    {
+        const FrameSetting& setting = context.setting;
+
+        int presentTime = gpuStopTime;
+        switch (setting.presentMode) {
+        case PresentMode::Fifo:
+            presentTime = std::max(setting.NextVsync(gpuStopTime), previousPresentTime + setting.resolution);
+            break;
+        case PresentMode::Mailbox:
+            presentTime = setting.NextVsync(gpuStopTime);
+            break;
+        case PresentMode::Vrr:
+            presentTime = std::max(gpuStopTime, previousPresentTime + static_cast<int>(setting.vrrMinPeriod * setting.resolution));
+            break;
+        default:
+            break;
+        }
+
+        return std::max(presentTime, previousPresentTime + context.limiter.interval());
+    }
+
+    // Start the frame so its cpu work ends when the gpu is predicted to be available.
+    // The gpu is simulated forward from the last presented frame with the predicted durations.
+    int PacedStartTime(const SimulationContext& context, int frameIndex)
+    {
+        const FrameSetting& setting = context.setting;
+
+        int last = frameIndex - 1;
+        while (last >= 0 && !context.frames[last].IsDone()) {
+            last--;
+        }
+        if (last < 0) {
+            return 0;
+        }
+
+        std::vector<int> cpuTimes;
+        std::vector<int> gpuTimes;
+        for (int k = std::max(0, last - setting.pacingSampleCount + 1); k <= last; k++) {
+            const SimulationContext::Frame& frame = context.frames[k];
+            cpuTimes.push_back(setting.CpuSimTime(k) + setting.CpuPrepTime(k));
+            gpuTimes.push_back(frame.GpuStopTime - frame.GpuStartTime);
+        }
+        int cpuTime = predict_pacing_sample(cpuTimes.data(), (int)cpuTimes.size(), setting.pacingPrediction, false);
+        int gpuTime = predict_pacing_sample(gpuTimes.data(), (int)gpuTimes.size(), setting.pacingPrediction, true);
+
+        bool blocking = setting.presentMode == PresentMode::Fifo || setting.presentMode == PresentMode::Vrr || setting.limiterMode != LimiterMode::Off;
+        int depth = std::max(setting.swapchainDepth, 1);
+        // Only the presents of the last depth frames can block the gpu, presentTimes[0] is frame first
+        int first = std::max(0, last - depth + 1);
+        std::vector<int> presentTimes;
+        for (int k = first; k <= last; k++) {
+            presentTimes.push_back(context.frames[k].GpuPresentTime);
+        }
+
+        int gpuStopTime = context.frames[last].GpuStopTime;
+        int gpuAvailableTime = gpuStopTime;
+        for (int j = last + 1; j <= frameIndex; j++) {
+            gpuAvailableTime = gpuStopTime;
+            if (blocking && j >= depth) {
+                gpuAvailableTime = std::max(gpuAvailableTime, presentTimes[j - depth - first]);
+            }
+            if (j == frameIndex) {
+                break;
+            }
+
+            const SimulationContext::Frame& frame = context.frames[j];
+            int gpuStartTime = gpuAvailableTime;
+            if (frame.CpuPrepStartTime >= 0) {
+                gpuStartTime = std::max(gpuStartTime, frame.CpuPrepStartTime + setting.CpuPrepTime(j));
+            }
+            gpuStopTime = gpuStartTime + gpuTime;
+            presentTimes.push_back(PredictPresentTime(context, gpuStopTime, presentTimes.back()));
+        }
+
+        return gpuAvailableTime - cpuTime - static_cast<int>(setting.pacingMargin * setting.resolution);
+    }
+
     class GpuJob : public FrameJob {
     public:
         GpuJob(int frameIndex)
@@ -201,16 +433,26 @@ namespace {
 
         void Run(SimulationContext& context) override
         {
+            const FrameSetting& setting = context.setting;
             SimulationContext::Frame& frame = context.frames[m_frameIndex];
 
-            int previousGpuPresentTime = 0;
+            // The gpu renders once the previous frame is rendered and, when presenting
+            // blocks, once a swapchain image has been released by the display
+            int gpuAvailableTime = 0;
+            int previousGpuPresentTime = -1;
             if (m_frameIndex > 0) {
+                gpuAvailableTime = context.frames[m_frameIndex - 1].GpuStopTime;
                 previousGpuPresentTime = context.frames[m_frameIndex - 1].GpuPresentTime;
             }
+            bool blocking = setting.presentMode == PresentMode::Fifo || setting.presentMode == PresentMode::Vrr || setting.limiterMode != LimiterMode::Off;
+            int depth = std::max(setting.swapchainDepth, 1);
+            if (blocking && m_frameIndex >= depth) {
+                gpuAvailableTime = std::max(gpuAvailableTime, context.frames[m_frameIndex - depth].GpuPresentTime);
+            }
             assert(frame.CpuPrepStartTime >= 0);
 
             int cpuPrepEndTime = frame.CpuPrepStartTime + (int)(context.setting.CpuPrepTime(m_frameIndex));
-            int requestGpuTime = std::max(cpuPrepEndTime, previousGpuPresentTime);
+            int requestGpuTime = std::max(cpuPrepEndTime, gpuAvailableTime);
             auto result = context.Schedule(requestGpuTime, (int)(context.setting.CpuKickTime(m_frameIndex)));
 
             frame.CpuKickStartTime = result.schedulingTime;
@@ -218,11 +460,49 @@ namespace {
             frame.GpuStartTime = result.schedulingTime;
             frame.GpuStopTime = frame.GpuStartTime + (int)(context.setting.GpuTime(m_frameIndex));
 
-            if (context.setting.vsyncEnabled) {
-                frame.GpuPresentTime = (((frame.GpuStopTime - 1) / context.setting.resolution) + 1) * context.setting.resolution;
-            }
-            else {
+            switch (setting.presentMode) {
+            case PresentMode::Fifo:
+                frame.GpuPresentTime = setting.NextVsync(frame.GpuStopTime);
+                if (previousGpuPresentTime >= 0) {
+                    frame.GpuPresentTime = std::max(frame.GpuPresentTime, previousGpuPresentTime + setting.resolution);
+                }
+                break;
+            case PresentMode::Mailbox:
+                // Dropped frames are known once the next frame is rendered, see FrameSimulator::Simulate
+                frame.GpuPresentTime = setting.NextVsync(frame.GpuStopTime);
+                break;
+            case PresentMode::Immediate:
                 frame.GpuPresentTime = frame.GpuStopTime;
+                frame.Torn = frame.GpuStopTime % setting.resolution != 0;
+                break;
+            case PresentMode::Vrr:
+                if (previousGpuPresentTime < 0) {
+                    frame.GpuPresentTime = frame.GpuStopTime;
+                }
+                else {
+                    int minPeriod = static_cast<int>(setting.vrrMinPeriod * setting.resolution);
+                    int maxPeriod = std::max(minPeriod, static_cast<int>(setting.vrrMaxPeriod * setting.resolution));
+                    int lastRefresh = previousGpuPresentTime;
+
+                    // The display refreshes the previous image when no frame comes within its max period
+                    while (maxPeriod > 0 && frame.GpuStopTime > lastRefresh + maxPeriod) {
+                        lastRefresh += maxPeriod;
+                        frame.DuplicateCount += 1;
+                    }
+                    frame.GpuPresentTime = std::max(frame.GpuStopTime, lastRefresh + minPeriod);
+                }
+                break;
+            }
+
+            // The limiter holds the present until its interval elapsed, on a vsync when presenting waits for one
+            if (setting.limiterMode != LimiterMode::Off && previousGpuPresentTime >= 0) {
+                context.limiter.update(frame.GpuPresentTime - previousGpuPresentTime);
+                int presentTime = previousGpuPresentTime + context.limiter.interval();
+                if (setting.presentMode == PresentMode::Fifo || setting.presentMode == PresentMode::Mailbox) {
+                    presentTime = setting.NextVsync(presentTime);
+                }
+                frame.GpuPresentTime = std::max(frame.GpuPresentTime, presentTime);
+                frame.Torn = setting.presentMode == PresentMode::Immediate && frame.GpuPresentTime % setting.resolution != 0;
             }
 
             DRGN_ASSERT(frame.GpuStopTime <= frame.GpuPresentTime);
@@ -283,6 +563,9 @@ namespace {
                     prevGpuPresentTime = prevFrame.GpuPresentTime;
                 }
                 int requestTime = std::max(endSim, prevGpuPresentTime);
+                if (context.setting.pacingMode == PacingMode::JustInTime) {
+                    requestTime = std::max(requestTime, PacedStartTime(context, m_frameIndex));
+                }
                 auto result = context.Schedule(requestTime, (int)(context.setting.CpuSimTime(m_frameIndex)));
                 frame.CpuSimStartTime = result.schedulingTime;
                 frame.CpuSimCoreIndex = result.coreIndex;
@@ -303,6 +586,12 @@ SimulationContext::SimulationContext(const FrameSetting& s)
     for (int i = 0; i < s.coreCount; i++) {
         coreTime[i] = 0;
     }
+
+    limiter.mode = s.limiterMode;
+    limiter.fixed_interval = static_cast<int>(s.limiterInterval * s.resolution);
+    limiter.vsync_period = s.resolution;
+    limiter.max_divisor = s.limiterDivisor;
+    limiter.miss_count_limit = s.limiterMissCount;
 }
 SimulationContext::SchedulingResult SimulationContext::Schedule(int requestTime, int duration)
 {
@@ -329,24 +618,166 @@ SimulationContext::SchedulingResult SimulationContext::Schedule(int requestTime,
     return result;
 }
 
-void FrameSimulator::Simulate(const FrameSimulator::Setting& setting)
-{
-    SimulationContext context(setting);
+namespace {
+    void RunJobs(SimulationContext& context)
+    {
+        const FrameSetting& setting = context.setting;
+
+        context.jobQueue.push_back(std::move(std::make_unique<CpuSimJob>(0)));
+        while (!context.jobQueue.empty()) {
+            bool doBreak = false;
+            for (auto iter = context.jobQueue.begin(); iter != context.jobQueue.end(); iter++) {
+                FrameJob* j = (*iter).get();
+                assert(j != nullptr);
+                if (j->IsReady(context)) {
+                    j->Run(context);
+                    context.jobQueue.erase(iter);
+                    doBreak = true;
+                    break;
+                }
+            }
+            assert(doBreak);
+        }
 
-    context.jobQueue.push_back(std::move(std::make_unique<CpuSimJob>(0)));
-    while (!context.jobQueue.empty()) {
-        bool doBreak = false;
-        for (auto iter = context.jobQueue.begin(); iter != context.jobQueue.end(); iter++) {
-            FrameJob* j = (*iter).get();
-            assert(j != nullptr);
-            if (j->IsReady(context)) {
-                j->Run(context);
-                context.jobQueue.erase(iter);
-                doBreak = true;
-                break;
+        // Mailbox only displays the latest frame rendered before a vsync
+        if (setting.presentMode == PresentMode::Mailbox) {
+            for (int i = 0; i + 1 < (int)context.frames.size(); i++) {
+                context.frames[i].Dropped = context.frames[i].GpuPresentTime == context.frames[i + 1].GpuPresentTime;
+            }
+        }
+
+        // On fixed refresh, count the vsyncs displaying again the previous image
+        if (setting.presentMode != PresentMode::Vrr) {
+            int previousPresentTime = -1;
+            for (auto& frame : context.frames) {
+                if (frame.Dropped) {
+                    continue;
+                }
+                if (previousPresentTime >= 0) {
+                    frame.DuplicateCount = std::max(0, frame.GpuPresentTime / setting.resolution - previousPresentTime / setting.resolution - 1);
+                }
+                previousPresentTime = frame.GpuPresentTime;
+            }
+        }
+    }
+
+    FrameSimulator::PresentStatistics ComputePresentStatistics(const SimulationContext& context)
+    {
+        const FrameSetting& setting = context.setting;
+
+        FrameSimulator::PresentStatistics stats;
+        std::vector<float> intervals;
+        int previousPresentTime = -1;
+        for (const auto& frame : context.frames) {
+            if (frame.Dropped) {
+                stats.droppedCount += 1;
+                continue;
+            }
+            float latency = float(frame.Latency()) / setting.resolution;
+            if (stats.presentedCount == 0) {
+                stats.minLatency = latency;
+                stats.maxLatency = latency;
+            }
+            else {
+                intervals.push_back(float(frame.GpuPresentTime - previousPresentTime) / setting.resolution);
             }
+            stats.minLatency = std::min(stats.minLatency, latency);
+            stats.maxLatency = std::max(stats.maxLatency, latency);
+            stats.averageLatency += latency;
+            stats.presentedCount += 1;
+            stats.duplicatedCount += frame.DuplicateCount;
+            stats.tornCount += frame.Torn ? 1 : 0;
+            previousPresentTime = frame.GpuPresentTime;
+        }
+        if (stats.presentedCount > 0) {
+            stats.averageLatency /= stats.presentedCount;
+        }
+        for (float interval : intervals) {
+            stats.averageInterval += interval / intervals.size();
+        }
+        for (float interval : intervals) {
+            stats.intervalVariance += (interval - stats.averageInterval) * (interval - stats.averageInterval) / intervals.size();
+        }
+
+        return stats;
+    }
+}
+
+uint64_t FrameSetting::Fingerprint() const
+{
+    // FNV-1a over the fields read by the simulation
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](const auto& value) {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(value); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
         }
-        assert(doBreak);
+    };
+
+    add(resolution);
+    add(coreCount);
+    add(deltaTimeSampleCount);
+    add(perturbationIndex);
+    add(perturbationDuration);
+    add(perturbationSimRatio);
+    add(perturbationPrepRatio);
+    add(perturbationGpuRatio);
+    add(presentMode);
+    add(swapchainDepth);
+    add(vrrMinPeriod);
+    add(vrrMaxPeriod);
+    add(pacingMode);
+    add(pacingPrediction);
+    add(pacingMargin);
+    add(pacingSampleCount);
+    add(limiterMode);
+    add(limiterInterval);
+    add(limiterDivisor);
+    add(limiterMissCount);
+    add(GpuDuration);
+    add(CpuKickDuration);
+    add(CpuDuration);
+    add(CpuSimRatio);
+    add(frameCount);
+    add(maxFrameIndex);
+    add(replayCapture);
+    add(capture ? capture->content_hash() : uint64_t(0));
+    return hash;
+}
+
+void FrameSimulator::Simulate(const FrameSimulator::Setting& setting)
+{
+    PROFILE_ZONE("FrameSimulator::Simulate");
+    AllocationScope allocations(AllocationTag::Simulation);
+    if (!m_cache) {
+        m_cache = SimulationCache::shared();
+    }
+    m_result = m_cache->get(setting);
+
+    // Simulate ahead the values the sliders are likely to take next
+    const uint64_t fingerprint = setting.speculate ? setting.Fingerprint() : 0;
+    if (fingerprint != m_speculatedFingerprint) {
+        m_cache->speculate(setting.speculate ? NeighbourSettings(setting) : std::vector<FrameSetting>());
+        m_speculatedFingerprint = fingerprint;
+    }
+}
+
+std::shared_ptr<const FrameSimulator::Result> FrameSimulator::Compute(const FrameSimulator::Setting& setting)
+{
+    AllocationScope allocations(AllocationTag::Simulation);
+    auto result = std::make_shared<Result>();
+    SimulationContext context(setting);
+    RunJobs(context);
+    result->presentStatistics = ComputePresentStatistics(context);
+
+    // Simulate again without pacing to compare against the default behaviour
+    result->defaultPresentStatistics = result->presentStatistics;
+    if (setting.pacingMode != PacingMode::Default) {
+        FrameSetting defaultSetting = setting;
+        defaultSetting.pacingMode = PacingMode::Default;
+        SimulationContext defaultContext(defaultSetting);
+        RunJobs(defaultContext);
+        result->defaultPresentStatistics = ComputePresentStatistics(defaultContext);
     }
 
     int stableFrameIndex = 0;
@@ -368,9 +799,9 @@ void FrameSimulator::Simulate(const FrameSimulator::Setting& setting)
         }
     }
     // Dummy simulation
-    m_timeboxes.clear();
-    m_latencyBoxes.clear();
-    m_frameRates.clear();
+    result->frameStatistics = FrameStatistics(1.f, setting.coreCount);
+    std::vector<int> coreBusyTime(setting.coreCount, 0);
+    int previousPresentTime = 0;
     for (int i = 0; i < (int)context.frames.size(); i++) {
         const SimulationContext::Frame& frame = context.frames[i];
         assert(frame.IsDone());
@@ -399,31 +830,50 @@ void FrameSimulator::Simulate(const FrameSimulator::Setting& setting)
         gpu.frameIndex = i;
         gpu.startTime = frame.GpuStartTime;
         gpu.stopTime = frame.GpuStopTime;
+        gpu.coreIndex = -1;
         gpu.isGpuTimeBox = true;
         gpu.name = "Render";
         TimeBox gpuPresent;
         gpuPresent.frameIndex = i;
         gpuPresent.startTime = frame.GpuStopTime;
         gpuPresent.stopTime = frame.GpuPresentTime;
+        gpuPresent.coreIndex = -1;
         gpuPresent.isGpuTimeBox = true;
         gpuPresent.name = "Present";
-        m_timeboxes.push_back(cpuSim);
+        result->timeboxes.push_back(cpuSim);
         if (cpuPrep.stopTime > cpuPrep.startTime) {
-            m_timeboxes.push_back(cpuPrep);
+            result->timeboxes.push_back(cpuPrep);
         }
         if (cpuKick.stopTime > cpuKick.startTime) {
-            m_timeboxes.push_back(cpuKick);
+            result->timeboxes.push_back(cpuKick);
         }
-        m_timeboxes.push_back(gpu);
+        result->timeboxes.push_back(gpu);
         if (gpuPresent.stopTime > gpuPresent.startTime) {
-            m_timeboxes.push_back(gpuPresent);
+            result->timeboxes.push_back(gpuPresent);
+        }
+
+        for (const TimeBox* box : { &cpuSim, &cpuPrep, &cpuKick }) {
+            if (box->coreIndex >= 0 && box->coreIndex < setting.coreCount) {
+                coreBusyTime[box->coreIndex] += box->stopTime - box->startTime;
+            }
         }
+        if (!frame.Dropped) {
+            // Statistics are in vsync periods
+            int interval = frame.GpuPresentTime - previousPresentTime;
+            float resolution = float(setting.resolution);
+            result->frameStatistics.add_frame(interval / resolution, (frame.GpuStopTime - frame.CpuSimStartTime) / resolution, frame.Latency() / resolution);
+            for (int c = 0; c < setting.coreCount; c++) {
+                result->frameStatistics.add_core_busy_time(c, coreBusyTime[c] / resolution, interval / resolution);
+                coreBusyTime[c] = 0;
+            }
+            previousPresentTime = frame.GpuPresentTime;
 
-        LatencyBox l;
-        l.frameIndex = i;
-        l.startTime = frame.CpuSimStartTime;
-        l.stopTime = frame.GpuPresentTime;
-        m_latencyBoxes.push_back(l);
+            LatencyBox l;
+            l.frameIndex = i;
+            l.startTime = frame.CpuSimStartTime;
+            l.stopTime = frame.GpuPresentTime;
+            result->latencyBoxes.push_back(l);
+        }
 
         FrameRate fr;
         fr.frameIndex = i;
@@ -431,6 +881,8 @@ void FrameSimulator::Simulate(const FrameSimulator::Setting& setting)
         fr.firstStable = i == stableFrameIndex;
         fr.stable = i >= stableFrameIndex;
         fr.isPerturbation = setting.isPerturbationFrame(i);
+        fr.dropped = frame.Dropped;
+        fr.duplicateCount = frame.DuplicateCount;
 
         if (i > 0) {
             fr.duration = frame.GpuPresentTime - context.frames[i - 1].GpuPresentTime;
@@ -442,19 +894,110 @@ void FrameSimulator::Simulate(const FrameSimulator::Setting& setting)
         for (int k = 0; k < setting.deltaTimeSampleCount; k++) {
             int idx = i - k - 1;
             if (idx >= 0) {
-                total += m_frameRates[idx].duration;
+                total += result->frameRates[idx].duration;
             }
             else {
                 total += setting.resolution;
             }
         }
         fr.dt_prediction = total / setting.deltaTimeSampleCount;
-        m_frameRates.push_back(fr);
+        result->frameRates.push_back(fr);
+    }
+
+    return result;
+}
+
+bool FrameSimulator::ExportTrace(const Setting& setting, TraceFormat format, const char* path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    auto writer = TraceWriter::create(format, file, 1e6 / 60.0 / setting.resolution);
+
+    // Cores, then the gpu, then the frames in flight, then the present and latency boxes which overlap
+    const int gpuTrack = setting.coreCount;
+    const int inFlightTrack = gpuTrack + 1;
+    auto presentTrack = [&](int i) { return inFlightTrack + 1 + 2 * i; };
+    auto latencyTrack = [&](int i) { return inFlightTrack + 2 + 2 * i; };
+
+    for (int i = 0; i < setting.coreCount; i++) {
+        writer->track(i, "Core " + std::to_string(i));
+    }
+    writer->track(gpuTrack, "GPU");
+    writer->counter_track(inFlightTrack, "Frames In Flight");
+
+    TrackPacker presentPacker;
+    for (const auto& t : m_result->timeboxes) {
+        int track = t.isGpuTimeBox ? gpuTrack : t.coreIndex;
+        if (t.isGpuTimeBox && strcmp(t.name, "Present") == 0) {
+            int count = presentPacker.track_count();
+            int index = presentPacker.place((float)t.startTime, (float)t.stopTime);
+            if (index == count) {
+                writer->track(presentTrack(index), "Present " + std::to_string(index));
+            }
+            track = presentTrack(index);
+        }
+        writer->slice(track, t.name, (float)t.startTime, (float)t.stopTime, (uint64_t)t.frameIndex + 1);
+    }
+
+    TrackPacker latencyPacker;
+    OverlapCounter inFlight(*writer, inFlightTrack);
+    for (const auto& l : m_result->latencyBoxes) {
+        int count = latencyPacker.track_count();
+        int index = latencyPacker.place((float)l.startTime, (float)l.stopTime);
+        if (index == count) {
+            writer->track(latencyTrack(index), "Latency " + std::to_string(index));
+        }
+        writer->slice(latencyTrack(index), "Latency", (float)l.startTime, (float)l.stopTime, 0);
+        inFlight.add((float)l.startTime, (float)l.stopTime);
     }
+
+    inFlight.finish();
+    writer->finish();
+    return (bool)file;
+}
+
+bool FrameSimulator::SaveTrace(const Setting& setting, const char* path, std::string& error) const
+{
+    // Same lanes as the timeline: the gpu, the cores, then one latency lane per frame
+    const int cpuLane = 1;
+    const int latencyLane = cpuLane + setting.coreCount;
+
+    TraceFileWriter writer(latencyLane + setting.frameCount, setting.resolution);
+    writer.set_lane_name(0, "GPU");
+    for (int i = 0; i < setting.coreCount; i++) {
+        writer.set_lane_name(cpuLane + i, "Core " + std::to_string(i));
+    }
+    for (int i = 0; i < setting.frameCount; i++) {
+        writer.set_lane_name(latencyLane + i, "Frame " + std::to_string(i));
+    }
+
+    for (const auto& t : m_result->timeboxes) {
+        int lane = t.isGpuTimeBox ? 0 : cpuLane + t.coreIndex;
+        writer.add(lane, t.startTime, t.stopTime, t.name, t.frameIndex, PickColor(t.frameIndex), TraceBoxType::Normal);
+    }
+    for (const auto& l : m_result->latencyBoxes) {
+        writer.add(latencyLane + l.frameIndex % setting.frameCount, l.startTime, l.stopTime, "Latency", l.frameIndex, PickColor(l.frameIndex), TraceBoxType::FrameTime);
+    }
+
+    return writer.write(path, error);
+}
+
+FrameSummary FrameSimulator::Summarize(const Result& result, int resolution, const std::string& name)
+{
+    FrameSummaryBuilder builder(resolution);
+    for (const auto& t : result.timeboxes) {
+        builder.add(t.frameIndex, t.name, t.startTime, t.stopTime);
+    }
+    return builder.finish(name, result.frameRates.size());
 }
 
 void FrameSimulator::Draw(const FrameSimulator::Setting& setting)
 {
+    PROFILE_ZONE("FrameSimulator::Draw");
+    AllocationScope allocations(AllocationTag::Drawing);
     // Begin Window
     ImGui::SetNextWindowSize(ImVec2(1900, 400), ImGuiCond_FirstUseEver);
     ImGui::SetNextWindowPos(ImVec2(0, 600), ImGuiCond_FirstUseEver);
@@ -490,13 +1033,13 @@ void FrameSimulator::Draw(const FrameSimulator::Setting& setting)
     }
     int timeMax = setting.ToTime(scroll + ImGui::GetWindowSize().x);
 
-    for (const auto& f : m_frameRates) {
+    for (const auto& f : m_result->frameRates) {
         if (timeMin <= f.time && f.time <= timeMax) {
             DrawFrameRate(context, f, offset);
         }
     }
     int maxTime = 0;
-    for (const auto& t : m_timeboxes) {
+    for (const auto& t : m_result->timeboxes) {
         DRGN_ASSERT(t.startTime <= t.stopTime);
         if (t.startTime <= timeMax && t.stopTime >= timeMin) {
             DrawTimeBox(context, t, offset);
@@ -506,7 +1049,7 @@ void FrameSimulator::Draw(const FrameSimulator::Setting& setting)
 
     DrawCoreLabel(context);
 
-    for (const auto& t : m_latencyBoxes) {
+    for (const auto& t : m_result->latencyBoxes) {
         DRGN_ASSERT(t.startTime <= t.stopTime);
         if (t.startTime <= timeMax && t.stopTime >= timeMin) {
             DrawLatencyBox(context, t, offset);
@@ -520,6 +1063,9 @@ void FrameSimulator::Draw(const FrameSimulator::Setting& setting)
 
     // End Window
     ImGui::End();
+
+    draw_opened_trace_files(m_traceFiles, setting.scale, setting.lineHeight);
+    draw_frame_diff(m_frameDiff);
 }
 
 void FrameSimulator::DrawCoreLine(const DrawContext& context)
@@ -654,12 +1200,21 @@ void FrameSimulator::DrawFrameRate(const DrawContext& context, const FrameRate&
     if (fr.isPerturbation) {
         color = g_Yellow;
     }
+    if (fr.dropped) {
+        color = g_Magenta;
+    }
     float duration = (float(fr.duration)) / context.setting.resolution;
     float dt_pred = (float(fr.dt_prediction)) / context.setting.resolution;
     float dt_error = (duration - dt_pred) / duration;
     context.drawlist.AddLine(p0 + offset, p1 + offset, color, 1.f);
     std::stringstream framerateText;
     framerateText << '[' << fr.frameIndex << "] " << duration;
+    if (fr.dropped) {
+        framerateText << " dropped";
+    }
+    else if (fr.duplicateCount > 0) {
+        framerateText << " x" << fr.duplicateCount + 1;
+    }
     std::string text_str = framerateText.str();
     const char* text = text_str.c_str();
     std::stringstream dtText;
@@ -6,8 +6,25 @@
 #include <vector>
 #include <list>
 #include <memory>
+#include <stdint.h>
+
+#include "pacing.h"
+#include "statistics.h"
+#include "trace_export.h"
+#include "capture.h"
+#include "trace_file.h"
+#include "frame_diff.h"
 
 struct SimulationContext;
+class SimulationCache;
+
+enum class PresentMode
+{
+    Fifo,
+    Mailbox,
+    Immediate,
+    Vrr,
+};
 
 struct FrameSetting
 {
@@ -27,7 +44,18 @@ struct FrameSetting
     float perturbationPrepRatio = 1.0f;
     float perturbationGpuRatio = 1.0f;
 
-    bool vsyncEnabled = true;
+    PresentMode presentMode = PresentMode::Fifo;
+    int swapchainDepth = 1;
+    float vrrMinPeriod = 0.5f;
+    float vrrMaxPeriod = 2.0f;
+    PacingMode pacingMode = PacingMode::Default;
+    PacingPrediction pacingPrediction = PacingPrediction::Average;
+    float pacingMargin = 0.1f;
+    int pacingSampleCount = 8;
+    LimiterMode limiterMode = LimiterMode::Off;
+    float limiterInterval = 2.0f;
+    int limiterDivisor = 2;
+    int limiterMissCount = 4;
     float GpuDuration = 1.0f;
     float CpuKickDuration = 0.0f;
     float CpuDuration = 1.0f;
@@ -36,6 +64,33 @@ struct FrameSetting
     float CpuPrepDuration = 0.5f;
     int frameCount = 3;
     int maxFrameIndex = 100;
+    bool speculate = true;
+
+    bool replayCapture = false;
+    std::shared_ptr<const FrameCapture> capture;
+    int captureSimColumn = -1;
+    int capturePrepColumn = -1;
+    int captureKickColumn = -1;
+    int captureGpuColumn = -1;
+
+    void SetCapture(std::shared_ptr<const FrameCapture> c) {
+        capture = c;
+        captureSimColumn = c ? c->find_column("CpuSim") : -1;
+        capturePrepColumn = c ? c->find_column("CpuPrep") : -1;
+        captureKickColumn = c ? c->find_column("CpuKick") : -1;
+        captureGpuColumn = c ? c->find_column("Gpu") : -1;
+    }
+
+    bool inline ReplayTime(int column, int index, float pert, int& time) const {
+        if (!replayCapture || column < 0) {
+            return false;
+        }
+        time = static_cast<int>(capture->duration(column, index) / CaptureVsyncPeriodMs * resolution * pert);
+        return true;
+    }
+
+    // Hash of the settings which change the simulation, the display ones are left out
+    uint64_t Fingerprint() const;
 
     bool inline isPerturbationFrame(int index) const {
         return perturbationIndex <= index && index < perturbationIndex + perturbationDuration;
@@ -44,21 +99,37 @@ struct FrameSetting
     int inline CpuKickTime(int index) const {
         float pert = isPerturbationFrame(index) ? perturbationSimRatio : 1.0f;
 
+        int time;
+        if (ReplayTime(captureKickColumn, index, pert, time)) {
+            return time;
+        }
         return static_cast<int>(CpuKickDuration * resolution * pert);
     }
     int inline CpuSimTime(int index) const {
         float pert = isPerturbationFrame(index) ? perturbationSimRatio : 1.0f;
 
+        int time;
+        if (ReplayTime(captureSimColumn, index, pert, time)) {
+            return time;
+        }
         return static_cast<int>(CpuSimRatio * CpuDuration * resolution * pert);
     }
     int inline CpuPrepTime(int index) const {
         float pert = isPerturbationFrame(index) ? perturbationPrepRatio : 1.0f;
 
+        int time;
+        if (ReplayTime(capturePrepColumn, index, pert, time)) {
+            return time;
+        }
         return static_cast<int>((1.0f - CpuSimRatio) * CpuDuration * resolution * pert);
     }
     int inline GpuTime(int index) const {
         float pert = isPerturbationFrame(index) ? perturbationGpuRatio : 1.0f;
 
+        int time;
+        if (ReplayTime(captureGpuColumn, index, pert, time)) {
+            return time;
+        }
         return static_cast<int>(GpuDuration * resolution * pert);
     }
     int inline ToTime(float position) const {
@@ -68,6 +139,10 @@ struct FrameSetting
     float inline ToPosition(int time) const {
         return (scale * time) / resolution + coreOffset.x;
     }
+
+    int inline NextVsync(int time) const {
+        return (((time - 1) / resolution) + 1) * resolution;
+    }
 };
 
 class FrameJob
@@ -100,6 +175,9 @@ public:
         int GpuStartTime = -1;
         int GpuStopTime = -1;
         int GpuPresentTime = -1;
+        bool Dropped = false;
+        bool Torn = false;
+        int DuplicateCount = 0;
 
         inline bool IsDone() const {
             return CpuSimStartTime >= 0 && CpuPrepStartTime >= 0 && GpuStartTime >= 0 && GpuPresentTime >= 0
@@ -132,6 +210,8 @@ public:
     std::vector<Frame> frames;
     std::list<std::unique_ptr<FrameJob>> jobQueue;
     std::vector<int> coreTime;
+
+    FrameLimiter<int> limiter;
 };
 
 class FrameSimulator
@@ -143,6 +223,25 @@ public:
     void Draw(const Setting& setting);
     void Simulate(const Setting& setting);
 
+    struct PresentStatistics
+    {
+        int presentedCount = 0;
+        int droppedCount = 0;
+        int duplicatedCount = 0;
+        int tornCount = 0;
+        float minLatency = 0.f;
+        float maxLatency = 0.f;
+        float averageLatency = 0.f;
+        float averageInterval = 0.f;
+        float intervalVariance = 0.f;
+    };
+
+    const PresentStatistics& GetPresentStatistics() const { return m_result->presentStatistics; }
+    const FrameStatistics& GetFrameStatistics() const { return m_result->frameStatistics; }
+
+    bool ExportTrace(const Setting& setting, TraceFormat format, const char* path) const;
+    bool SaveTrace(const Setting& setting, const char* path, std::string& error) const;
+
 private:
     struct TimeBox
     {
@@ -169,10 +268,31 @@ private:
         bool firstStable = false;
         bool stable = false;
         bool missed = false;
+        bool dropped = false;
+        int duplicateCount = 0;
         bool isPerturbation = false;
         int dt_prediction = -1;
     };
 
+public:
+    // Everything a simulation produces, never modified once computed so that it is shared with the cache
+    struct Result
+    {
+        std::vector<TimeBox> timeboxes;
+        std::vector<LatencyBox> latencyBoxes;
+        std::vector<FrameRate> frameRates;
+        PresentStatistics presentStatistics;
+        PresentStatistics defaultPresentStatistics;
+        FrameStatistics frameStatistics;
+    };
+
+    // Only reads the setting, it may run on any thread
+    static std::shared_ptr<const Result> Compute(const Setting& setting);
+
+    // Every simulated frame, times in vsync periods
+    static FrameSummary Summarize(const Result& result, int resolution, const std::string& name);
+
+private:
     struct DrawContext
     {
         DrawContext(const Setting& set, ImDrawList& dl, const ImVec2& cursor, const ImVec2& winPos, const ImVec2& winSize)
@@ -205,9 +325,20 @@ private:
     void DrawFrameRate(const DrawContext& context, const FrameRate& fr, const ImVec2& offset);
 
 private:
-    std::vector<TimeBox> m_timeboxes;
-    std::vector<LatencyBox> m_latencyBoxes;
-    std::vector<FrameRate> m_frameRates;
+    std::shared_ptr<const Result> m_result = std::make_shared<Result>();
+    std::shared_ptr<SimulationCache> m_cache;
+    uint64_t m_speculatedFingerprint = 0;
+    CaptureImport m_captureImport;
+    TraceFiles m_traceFiles;
+
+    struct KeptResult
+    {
+        std::string name;
+        int resolution;
+        std::shared_ptr<const Result> result;
+    };
+    std::vector<KeptResult> m_keptResults;
+    FrameDiffView m_frameDiff;
 
     int m_previousTimeMin = -1;
 };
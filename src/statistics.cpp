@@ -0,0 +1,302 @@
+#include "statistics.h"
+
+#include "imgui.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Smallest value distinguished from zero
+constexpr float MinSketchValue = 1e-6f;
+
+}
+
+QuantileSketch::QuantileSketch(float relative_accuracy, int max_bucket_count)
+    : m_gamma((1.f + relative_accuracy) / (1.f - relative_accuracy))
+    , m_log_gamma(std::log(m_gamma))
+    , m_max_bucket_count(max_bucket_count)
+{
+    assert(relative_accuracy > 0.f && relative_accuracy < 1.f);
+    assert(max_bucket_count > 0);
+}
+
+int QuantileSketch::bucket_index(float value) const
+{
+    return (int)std::ceil(std::log(value) / m_log_gamma);
+}
+
+float QuantileSketch::bucket_value(int index) const
+{
+    return 2.f * std::pow(m_gamma, (float)index) / (m_gamma + 1.f);
+}
+
+void QuantileSketch::extend(int low, int high)
+{
+    if (m_buckets.empty()) {
+        m_offset = std::max(low, high - m_max_bucket_count + 1);
+        m_buckets.assign(high - m_offset + 1, 0);
+        return;
+    }
+
+    const int current_high = m_offset + (int)m_buckets.size() - 1;
+    const int new_high = std::max(high, current_high);
+    const int new_low = std::max(std::min(low, m_offset), new_high - m_max_bucket_count + 1);
+    if (new_low == m_offset && new_high == current_high) {
+        return;
+    }
+
+    // Buckets falling below the new range are collapsed into the lowest one
+    std::vector<uint64_t> buckets(new_high - new_low + 1, 0);
+    for (int i = 0; i < (int)m_buckets.size(); i++) {
+        buckets[std::max(m_offset + i, new_low) - new_low] += m_buckets[i];
+    }
+    m_buckets.swap(buckets);
+    m_offset = new_low;
+}
+
+void QuantileSketch::add(float value)
+{
+    m_count += 1;
+    if (!(value > MinSketchValue)) {
+        m_zero_count += 1;
+        return;
+    }
+
+    int index = bucket_index(value);
+    extend(index, index);
+    m_buckets[std::max(index, m_offset) - m_offset] += 1;
+}
+
+void QuantileSketch::merge(const QuantileSketch& other)
+{
+    assert(m_gamma == other.m_gamma);
+
+    m_count += other.m_count;
+    m_zero_count += other.m_zero_count;
+    if (other.m_buckets.empty()) {
+        return;
+    }
+
+    extend(other.m_offset, other.m_offset + (int)other.m_buckets.size() - 1);
+    for (int i = 0; i < (int)other.m_buckets.size(); i++) {
+        m_buckets[std::max(other.m_offset + i, m_offset) - m_offset] += other.m_buckets[i];
+    }
+}
+
+void QuantileSketch::clear()
+{
+    m_offset = 0;
+    m_buckets.clear();
+    m_zero_count = 0;
+    m_count = 0;
+}
+
+float QuantileSketch::quantile(float q) const
+{
+    if (m_count == 0) {
+        return 0.f;
+    }
+
+    uint64_t rank = (uint64_t)(std::min(std::max(q, 0.f), 1.f) * (m_count - 1));
+    if (rank < m_zero_count) {
+        return 0.f;
+    }
+
+    uint64_t total = m_zero_count;
+    for (int i = 0; i < (int)m_buckets.size(); i++) {
+        total += m_buckets[i];
+        if (rank < total) {
+            return bucket_value(m_offset + i);
+        }
+    }
+    return bucket_value(m_offset + (int)m_buckets.size() - 1);
+}
+
+Histogram::Histogram(float min, float max, int bin_count)
+    : m_min(min)
+    , m_max(max)
+    , m_bins(bin_count, 0)
+{
+    assert(min < max);
+    assert(bin_count > 0);
+}
+
+void Histogram::add(float value)
+{
+    if (value < m_min) {
+        m_underflow += 1;
+    } else if (value >= m_max) {
+        m_overflow += 1;
+    } else {
+        size_t bin = (size_t)((value - m_min) / (m_max - m_min) * m_bins.size());
+        m_bins[std::min(bin, m_bins.size() - 1)] += 1;
+    }
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    assert(m_min == other.m_min && m_max == other.m_max && m_bins.size() == other.m_bins.size());
+
+    for (size_t i = 0; i < m_bins.size(); i++) {
+        m_bins[i] += other.m_bins[i];
+    }
+    m_underflow += other.m_underflow;
+    m_overflow += other.m_overflow;
+}
+
+void Histogram::clear()
+{
+    std::fill(m_bins.begin(), m_bins.end(), 0);
+    m_underflow = 0;
+    m_overflow = 0;
+}
+
+StreamingStatistics::StreamingStatistics(float histogram_min, float histogram_max)
+    : histogram(histogram_min, histogram_max)
+{
+}
+
+void StreamingStatistics::add(float value)
+{
+    min = count == 0 ? value : std::min(min, value);
+    max = count == 0 ? value : std::max(max, value);
+    count += 1;
+    sum += value;
+    sketch.add(value);
+    histogram.add(value);
+}
+
+void StreamingStatistics::merge(const StreamingStatistics& other)
+{
+    if (other.count == 0) {
+        return;
+    }
+    min = count == 0 ? other.min : std::min(min, other.min);
+    max = count == 0 ? other.max : std::max(max, other.max);
+    count += other.count;
+    sum += other.sum;
+    sketch.merge(other.sketch);
+    histogram.merge(other.histogram);
+}
+
+void StreamingStatistics::clear()
+{
+    count = 0;
+    sum = 0.0;
+    min = 0.f;
+    max = 0.f;
+    sketch.clear();
+    histogram.clear();
+}
+
+float StreamingStatistics::quantile(float q) const
+{
+    // The sketch error is relative, the exact extremes are known
+    return std::min(std::max(sketch.quantile(q), min), max);
+}
+
+FrameStatistics::FrameStatistics(float period, int core_count)
+    : interval(0.f, 4.f * period)
+    , frame_time(0.f, 8.f * period)
+    , latency(0.f, 8.f * period)
+    , utilization(0.f, 1.f + 1e-6f)
+    , core_busy_time(core_count, 0.0)
+{
+}
+
+void FrameStatistics::add_frame(float frame_interval, float frame_time_value, float latency_value)
+{
+    interval.add(frame_interval);
+    frame_time.add(frame_time_value);
+    latency.add(latency_value);
+    elapsed_time += frame_interval;
+}
+
+void FrameStatistics::add_core_busy_time(int core, float busy_time, float frame_interval)
+{
+    assert(core >= 0 && core < (int)core_busy_time.size());
+
+    core_busy_time[core] += busy_time;
+    if (frame_interval > 0.f) {
+        utilization.add(std::min(1.f, busy_time / frame_interval));
+    }
+}
+
+void FrameStatistics::merge(const FrameStatistics& other)
+{
+    interval.merge(other.interval);
+    frame_time.merge(other.frame_time);
+    latency.merge(other.latency);
+    utilization.merge(other.utilization);
+    core_busy_time.resize(std::max(core_busy_time.size(), other.core_busy_time.size()), 0.0);
+    for (size_t i = 0; i < other.core_busy_time.size(); i++) {
+        core_busy_time[i] += other.core_busy_time[i];
+    }
+    elapsed_time += other.elapsed_time;
+}
+
+void FrameStatistics::clear()
+{
+    interval.clear();
+    frame_time.clear();
+    latency.clear();
+    utilization.clear();
+    std::fill(core_busy_time.begin(), core_busy_time.end(), 0.0);
+    elapsed_time = 0.0;
+}
+
+float FrameStatistics::core_utilization(int core) const
+{
+    return elapsed_time > 0.0 ? float(core_busy_time[core] / elapsed_time) : 0.f;
+}
+
+void draw_frame_statistics(const FrameStatistics& stats)
+{
+    ImGui::Text("%llu frames", (unsigned long long)stats.interval.count);
+
+    auto show_metric = [](const char* name, const StreamingStatistics& s) {
+        ImGui::Text("%s", name); ImGui::NextColumn();
+        ImGui::Text("%.3f", s.mean()); ImGui::NextColumn();
+        ImGui::Text("%.3f", s.quantile(0.5f)); ImGui::NextColumn();
+        ImGui::Text("%.3f", s.quantile(0.9f)); ImGui::NextColumn();
+        ImGui::Text("%.3f", s.quantile(0.99f)); ImGui::NextColumn();
+        ImGui::Text("%.3f", s.quantile(0.999f)); ImGui::NextColumn();
+        ImGui::Text("%.3f", s.max); ImGui::NextColumn();
+    };
+    ImGui::Columns(7, "statistics");
+    ImGui::NextColumn();
+    ImGui::Text("Mean"); ImGui::NextColumn();
+    ImGui::Text("p50"); ImGui::NextColumn();
+    ImGui::Text("p90"); ImGui::NextColumn();
+    ImGui::Text("p99"); ImGui::NextColumn();
+    ImGui::Text("p99.9"); ImGui::NextColumn();
+    ImGui::Text("Max"); ImGui::NextColumn();
+    show_metric("Interval", stats.interval);
+    show_metric("Frame Time", stats.frame_time);
+    show_metric("Latency", stats.latency);
+    show_metric("Utilization", stats.utilization);
+    ImGui::Columns(1);
+
+    auto show_histogram = [](const char* name, const StreamingStatistics& s) {
+        const auto& bins = s.histogram.bins();
+        std::vector<float> values(bins.begin(), bins.end());
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "[%.2f, %.2f] +%llu", s.histogram.min(), s.histogram.max(), (unsigned long long)s.histogram.overflow());
+        ImGui::PlotHistogram(name, values.data(), (int)values.size(), 0, overlay, 0.f, FLT_MAX, ImVec2(0.f, 60.f));
+    };
+    show_histogram("Interval", stats.interval);
+    show_histogram("Frame Time", stats.frame_time);
+    show_histogram("Latency", stats.latency);
+    show_histogram("Utilization", stats.utilization);
+
+    for (int i = 0; i < (int)stats.core_busy_time.size(); i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Core %d: %.0f%%", i, stats.core_utilization(i) * 100.f);
+        ImGui::ProgressBar(stats.core_utilization(i), ImVec2(-1.f, 0.f), label);
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// Mergeable quantile sketch with logarithmic buckets (DDSketch).
+// Quantiles are within relative_accuracy of the exact value as long as the values
+// span less than max_bucket_count buckets, the lowest buckets are merged beyond.
+class QuantileSketch
+{
+public:
+    explicit QuantileSketch(float relative_accuracy = 0.01f, int max_bucket_count = 1024);
+
+    void add(float value);
+    void merge(const QuantileSketch& other);
+    void clear();
+
+    float quantile(float q) const;
+    uint64_t count() const { return m_count; }
+
+private:
+    int bucket_index(float value) const;
+    float bucket_value(int index) const;
+    void extend(int low, int high);
+
+    float m_gamma;
+    float m_log_gamma;
+    int m_max_bucket_count;
+
+    // Index of the first bucket
+    int m_offset = 0;
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_zero_count = 0;
+    uint64_t m_count = 0;
+};
+
+// Fixed bins over [min, max], values outside are only counted
+class Histogram
+{
+public:
+    Histogram(float min = 0.f, float max = 1.f, int bin_count = 64);
+
+    void add(float value);
+    void merge(const Histogram& other);
+    void clear();
+
+    float min() const { return m_min; }
+    float max() const { return m_max; }
+    const std::vector<uint64_t>& bins() const { return m_bins; }
+    uint64_t underflow() const { return m_underflow; }
+    uint64_t overflow() const { return m_overflow; }
+
+private:
+    float m_min;
+    float m_max;
+    std::vector<uint64_t> m_bins;
+    uint64_t m_underflow = 0;
+    uint64_t m_overflow = 0;
+};
+
+struct StreamingStatistics
+{
+    StreamingStatistics(float histogram_min = 0.f, float histogram_max = 1.f);
+
+    QuantileSketch sketch;
+    Histogram histogram;
+    uint64_t count = 0;
+    double sum = 0.0;
+    float min = 0.f;
+    float max = 0.f;
+
+    void add(float value);
+    void merge(const StreamingStatistics& other);
+    void clear();
+
+    float mean() const { return count > 0 ? float(sum / count) : 0.f; }
+    float quantile(float q) const;
+};
+
+// Frame metrics fed as frames complete, in constant memory whatever the length of the run.
+// Histogram ranges are relative to the vsync period.
+struct FrameStatistics
+{
+    explicit FrameStatistics(float period = 1.f, int core_count = 0);
+
+    StreamingStatistics interval;
+    StreamingStatistics frame_time;
+    StreamingStatistics latency;
+    // Busy ratio of each core during each frame interval
+    StreamingStatistics utilization;
+
+    std::vector<double> core_busy_time;
+    double elapsed_time = 0.0;
+
+    void add_frame(float frame_interval, float frame_time, float latency);
+    void add_core_busy_time(int core, float busy_time, float frame_interval);
+    void merge(const FrameStatistics& other);
+    void clear();
+
+    float core_utilization(int core) const;
+};
+
+// Draw histograms and percentiles in the current window
+void draw_frame_statistics(const FrameStatistics& stats);
@@ -0,0 +1,393 @@
+#include "trace_export.h"
+
+#include "visualizer.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+
+// Flows of frames which are not continued anymore are forgotten
+constexpr size_t MaxPendingFlowCount = 256;
+
+class ChromeTraceWriter : public TraceWriter
+{
+public:
+    ChromeTraceWriter(std::ostream& out, double us_per_unit)
+        : m_out(out)
+        , m_us_per_unit(us_per_unit)
+    {
+        m_out << "{\"traceEvents\":[";
+    }
+
+    void track(int track, const std::string& name) override
+    {
+        begin_event();
+        m_out << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        write_string(name.c_str());
+        m_out << "}}";
+        begin_event();
+        m_out << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":" << track << "}}";
+    }
+
+    void counter_track(int track, const std::string& name) override
+    {
+        m_counter_names[track] = name;
+    }
+
+    void slice(int track, const char* name, float start, float end, uint64_t flow_id) override
+    {
+        char buffer[128];
+        begin_event();
+        m_out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << track << ",\"name\":";
+        write_string(name);
+        snprintf(buffer, sizeof(buffer), ",\"ts\":%.3f,\"dur\":%.3f}", to_us(start), to_us(end) - to_us(start));
+        m_out << buffer;
+
+        if (flow_id == 0) {
+            return;
+        }
+
+        // Arrow from the previous slice of the flow, each end binds to its enclosing slice
+        auto previous = m_flows.find(flow_id);
+        if (previous != m_flows.end()) {
+            m_arrow_count += 1;
+            begin_event();
+            snprintf(buffer, sizeof(buffer), "{\"ph\":\"s\",\"pid\":1,\"tid\":%d,\"name\":\"flow\",\"cat\":\"flow\",\"id\":%llu,\"ts\":%.3f}",
+                previous->second.first, (unsigned long long)m_arrow_count, to_us(previous->second.second));
+            m_out << buffer;
+            begin_event();
+            snprintf(buffer, sizeof(buffer), "{\"ph\":\"f\",\"bp\":\"e\",\"pid\":1,\"tid\":%d,\"name\":\"flow\",\"cat\":\"flow\",\"id\":%llu,\"ts\":%.3f}",
+                track, (unsigned long long)m_arrow_count, to_us(start));
+            m_out << buffer;
+        }
+        m_flows[flow_id] = std::make_pair(track, start);
+        if (m_flows.size() > MaxPendingFlowCount) {
+            m_flows.erase(m_flows.begin());
+        }
+    }
+
+    void counter(int track, float time, double value) override
+    {
+        char buffer[64];
+        begin_event();
+        m_out << "{\"ph\":\"C\",\"pid\":1,\"name\":";
+        write_string(m_counter_names[track].c_str());
+        snprintf(buffer, sizeof(buffer), ",\"ts\":%.3f,\"args\":{\"value\":%g}}", to_us(time), value);
+        m_out << buffer;
+    }
+
+    void finish() override
+    {
+        m_out << "\n]}\n";
+        m_out.flush();
+    }
+
+private:
+    double to_us(float time) const
+    {
+        return time * m_us_per_unit;
+    }
+
+    void begin_event()
+    {
+        m_out << (m_first_event ? "\n" : ",\n");
+        m_first_event = false;
+    }
+
+    void write_string(const char* s)
+    {
+        m_out << '"';
+        for (; *s; s++) {
+            if (*s == '"' || *s == '\\') {
+                m_out << '\\' << *s;
+            } else if ((unsigned char)*s < 0x20) {
+                m_out << ' ';
+            } else {
+                m_out << *s;
+            }
+        }
+        m_out << '"';
+    }
+
+    std::ostream& m_out;
+    double m_us_per_unit;
+    bool m_first_event = true;
+    uint64_t m_arrow_count = 0;
+    std::map<int, std::string> m_counter_names;
+    std::map<uint64_t, std::pair<int, float>> m_flows;
+};
+
+// Protobuf encoding of the perfetto Trace message, each packet is written as soon as it is encoded
+class PerfettoTraceWriter : public TraceWriter
+{
+public:
+    PerfettoTraceWriter(std::ostream& out, double us_per_unit)
+        : m_out(out)
+        , m_us_per_unit(us_per_unit)
+    {
+    }
+
+    void track(int track, const std::string& name) override
+    {
+        std::string descriptor;
+        put_varint_field(descriptor, TrackDescriptorUuid, uuid(track));
+        put_bytes_field(descriptor, TrackDescriptorName, name);
+
+        begin_packet();
+        put_bytes_field(m_packet, TracePacketTrackDescriptor, descriptor);
+        end_packet();
+    }
+
+    void counter_track(int track, const std::string& name) override
+    {
+        std::string descriptor;
+        put_varint_field(descriptor, TrackDescriptorUuid, uuid(track));
+        put_bytes_field(descriptor, TrackDescriptorName, name);
+        put_bytes_field(descriptor, TrackDescriptorCounter, std::string());
+
+        begin_packet();
+        put_bytes_field(m_packet, TracePacketTrackDescriptor, descriptor);
+        end_packet();
+    }
+
+    void slice(int track, const char* name, float start, float end, uint64_t flow_id) override
+    {
+        m_event.clear();
+        put_varint_field(m_event, TrackEventType, SliceBegin);
+        put_varint_field(m_event, TrackEventTrackUuid, uuid(track));
+        put_bytes_field(m_event, TrackEventName, name);
+        if (flow_id != 0) {
+            put_tag(m_event, TrackEventFlowIds, 1);
+            put_fixed64(m_event, flow_id);
+        }
+        write_event(start);
+
+        m_event.clear();
+        put_varint_field(m_event, TrackEventType, SliceEnd);
+        put_varint_field(m_event, TrackEventTrackUuid, uuid(track));
+        write_event(end);
+    }
+
+    void counter(int track, float time, double value) override
+    {
+        uint64_t bits;
+        static_assert(sizeof(bits) == sizeof(value), "double is not 64 bits");
+        memcpy(&bits, &value, sizeof(bits));
+
+        m_event.clear();
+        put_varint_field(m_event, TrackEventType, Counter);
+        put_varint_field(m_event, TrackEventTrackUuid, uuid(track));
+        put_tag(m_event, TrackEventDoubleCounterValue, 1);
+        put_fixed64(m_event, bits);
+        write_event(time);
+    }
+
+    void finish() override
+    {
+        m_out.flush();
+    }
+
+private:
+    // Field numbers of perfetto/trace/trace_packet.proto and its track event messages
+    enum Field
+    {
+        TracePacket = 1,
+        TracePacketTimestamp = 8,
+        TracePacketSequenceId = 10,
+        TracePacketTrackEvent = 11,
+        TracePacketSequenceFlags = 13,
+        TracePacketTrackDescriptor = 60,
+        TrackDescriptorUuid = 1,
+        TrackDescriptorName = 2,
+        TrackDescriptorCounter = 8,
+        TrackEventType = 9,
+        TrackEventTrackUuid = 11,
+        TrackEventName = 23,
+        TrackEventDoubleCounterValue = 44,
+        TrackEventFlowIds = 47,
+    };
+
+    enum EventType
+    {
+        SliceBegin = 1,
+        SliceEnd = 2,
+        Counter = 4,
+    };
+
+    static uint64_t uuid(int track)
+    {
+        assert(track >= 0);
+        return (uint64_t)track + 1;
+    }
+
+    static void put_varint(std::string& out, uint64_t value)
+    {
+        while (value >= 0x80) {
+            out.push_back((char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char)value);
+    }
+
+    static void put_tag(std::string& out, int field, int wire_type)
+    {
+        put_varint(out, ((uint64_t)field << 3) | wire_type);
+    }
+
+    static void put_fixed64(std::string& out, uint64_t value)
+    {
+        for (int i = 0; i < 8; i++) {
+            out.push_back((char)(value >> (8 * i)));
+        }
+    }
+
+    static void put_varint_field(std::string& out, int field, uint64_t value)
+    {
+        put_tag(out, field, 0);
+        put_varint(out, value);
+    }
+
+    static void put_bytes_field(std::string& out, int field, const std::string& bytes)
+    {
+        put_tag(out, field, 2);
+        put_varint(out, bytes.size());
+        out += bytes;
+    }
+
+    void begin_packet()
+    {
+        m_packet.clear();
+        put_varint_field(m_packet, TracePacketSequenceId, 1);
+        if (m_first_packet) {
+            // SEQ_INCREMENTAL_STATE_CLEARED
+            put_varint_field(m_packet, TracePacketSequenceFlags, 1);
+            m_first_packet = false;
+        }
+    }
+
+    void end_packet()
+    {
+        m_header.clear();
+        put_tag(m_header, TracePacket, 2);
+        put_varint(m_header, m_packet.size());
+        m_out.write(m_header.data(), m_header.size());
+        m_out.write(m_packet.data(), m_packet.size());
+    }
+
+    void write_event(float time)
+    {
+        begin_packet();
+        put_varint_field(m_packet, TracePacketTimestamp, (uint64_t)std::llround(std::max(0.0, time * m_us_per_unit * 1000.0)));
+        put_bytes_field(m_packet, TracePacketTrackEvent, m_event);
+        end_packet();
+    }
+
+    std::ostream& m_out;
+    double m_us_per_unit;
+    bool m_first_packet = true;
+    std::string m_header;
+    std::string m_packet;
+    std::string m_event;
+};
+
+}
+
+const char* trace_extension(TraceFormat format)
+{
+    switch (format) {
+    case TraceFormat::ChromeJson: return ".json";
+    case TraceFormat::Perfetto: return ".perfetto-trace";
+    }
+    return "";
+}
+
+std::unique_ptr<TraceWriter> TraceWriter::create(TraceFormat format, std::ostream& out, double us_per_unit)
+{
+    switch (format) {
+    case TraceFormat::ChromeJson: return std::make_unique<ChromeTraceWriter>(out, us_per_unit);
+    case TraceFormat::Perfetto: return std::make_unique<PerfettoTraceWriter>(out, us_per_unit);
+    }
+    return nullptr;
+}
+
+int TrackPacker::place(float start, float end)
+{
+    for (int i = 0; i < (int)m_track_end.size(); i++) {
+        if (m_track_end[i] <= start) {
+            m_track_end[i] = end;
+            return i;
+        }
+    }
+    m_track_end.push_back(end);
+    return (int)m_track_end.size() - 1;
+}
+
+void OverlapCounter::add(float start, float end)
+{
+    flush(start);
+    m_changes.emplace(start, 1);
+    m_changes.emplace(end, -1);
+}
+
+void OverlapCounter::finish()
+{
+    flush(std::numeric_limits<float>::infinity());
+}
+
+void OverlapCounter::flush(float time)
+{
+    // Changes at the given time are kept to be grouped with the ones added next
+    while (!m_changes.empty() && m_changes.top().first < time) {
+        float t = m_changes.top().first;
+        while (!m_changes.empty() && m_changes.top().first == t) {
+            m_value += m_changes.top().second;
+            m_changes.pop();
+        }
+        m_writer.counter(m_track, t, m_value);
+    }
+}
+
+bool export_trace(const Simulator& simulator, TraceFormat format, const std::string& path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    const SimulationOption& option = simulator.get_option();
+    auto writer = TraceWriter::create(format, file, 1e6 / 60.0 / option.VsyncPeriod);
+
+    const int gpu_queue_count = simulator.get_flow()->gpu_queue_count();
+    const int lane_count = simulator.core_count() + gpu_queue_count + (gpu_queue_count > 0 ? 1 : 0);
+
+    const int in_flight_track = lane_count + 2 + option.FramePoolSize;
+    writer->counter_track(in_flight_track, "Frames In Flight");
+    OverlapCounter in_flight(*writer, in_flight_track);
+
+    std::vector<bool> declared;
+    for (const auto& t : simulator.get_timeboxes()) {
+        if (t.core_index >= (int)declared.size()) {
+            declared.resize(t.core_index + 1, false);
+        }
+        if (!declared[t.core_index]) {
+            writer->track(t.core_index, simulator.lane_name(t.core_index));
+            declared[t.core_index] = true;
+        }
+
+        writer->slice(t.core_index, t.name.c_str(), t.raw_start(), t.raw_end(), t.frame >= 0 ? (uint64_t)t.frame + 1 : 0);
+        if (t.type == TimeBoxType::FrameTime) {
+            in_flight.add(t.raw_start(), t.raw_end());
+        }
+    }
+
+    in_flight.finish();
+    writer->finish();
+    return (bool)file;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <queue>
+#include <string>
+#include <vector>
+
+class Simulator;
+
+enum class TraceFormat
+{
+    ChromeJson,
+    Perfetto,
+};
+
+const char* trace_extension(TraceFormat format);
+
+// Streams trace events to a file as they are written, nothing but the track
+// names and the pending flows is kept in memory.
+class TraceWriter
+{
+public:
+    static std::unique_ptr<TraceWriter> create(TraceFormat format, std::ostream& out, double us_per_unit);
+
+    virtual ~TraceWriter() = default;
+
+    virtual void track(int track, const std::string& name) = 0;
+    virtual void counter_track(int track, const std::string& name) = 0;
+    // Slices sharing a flow id are linked by arrows in the order they are written, 0 means no flow
+    virtual void slice(int track, const char* name, float start, float end, uint64_t flow_id) = 0;
+    virtual void counter(int track, float time, double value) = 0;
+    virtual void finish() = 0;
+};
+
+// Places overlapping slices on the first free sub track
+class TrackPacker
+{
+public:
+    int place(float start, float end);
+    int track_count() const { return (int)m_track_end.size(); }
+
+private:
+    std::vector<float> m_track_end;
+};
+
+// Counts the intervals overlapping each point in time. Intervals are added by
+// increasing start time, changes are written once no earlier start can come.
+class OverlapCounter
+{
+public:
+    OverlapCounter(TraceWriter& writer, int track) : m_writer(writer), m_track(track) {}
+
+    void add(float start, float end);
+    void finish();
+
+private:
+    void flush(float time);
+
+    TraceWriter& m_writer;
+    int m_track;
+    int m_value = 0;
+    std::priority_queue<std::pair<float, int>, std::vector<std::pair<float, int>>, std::greater<std::pair<float, int>>> m_changes;
+};
+
+// Time units are converted so that a vsync period lasts 1/60 s
+bool export_trace(const Simulator& simulator, TraceFormat format, const std::string& path);
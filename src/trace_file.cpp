@@ -0,0 +1,434 @@
+#include "trace_file.h"
+
+#include "imgui.h"
+#include "imgui_internal.h"
+
+#include "visualizer.h"
+#include "allocation_tracker.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+struct TraceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t lane_count;
+    uint32_t string_count;
+    double units_per_vsync;
+    double end_time;
+    uint64_t string_offsets;
+    uint64_t strings;
+    uint64_t strings_size;
+    uint64_t lanes;
+};
+
+struct LaneHeader
+{
+    uint32_t name;
+    uint32_t box_count;
+    uint32_t block_count;
+    uint32_t padding;
+    uint64_t block_start;
+    uint64_t block_end;
+    uint64_t start_delta;
+    uint64_t duration;
+    uint64_t frame;
+    uint64_t box_name;
+    uint64_t color;
+    uint64_t type;
+};
+
+constexpr uint32_t TraceVersion = 1;
+
+// Appends the arrays of the file, every array starts on 8 bytes
+class TraceBuffer
+{
+public:
+    template <class T>
+    uint64_t append(const T* data, size_t count)
+    {
+        m_data.resize((m_data.size() + 7) & ~size_t(7), 0);
+        uint64_t offset = m_data.size();
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        m_data.insert(m_data.end(), bytes, bytes + sizeof(T) * count);
+        return offset;
+    }
+
+    template <class T>
+    uint64_t append(const std::vector<T>& data)
+    {
+        return append(data.data(), data.size());
+    }
+
+    template <class T>
+    T& at(uint64_t offset)
+    {
+        return *reinterpret_cast<T*>(m_data.data() + offset);
+    }
+
+    const std::vector<uint8_t>& data() const { return m_data; }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+const char* g_Empty = "";
+
+TimeBoxType time_box_type(TraceBoxType type)
+{
+    switch (type) {
+    case TraceBoxType::In: return TimeBoxType::In;
+    case TraceBoxType::Out: return TimeBoxType::Out;
+    case TraceBoxType::FrameTime: return TimeBoxType::FrameTime;
+    default: return TimeBoxType::Normal;
+    }
+}
+
+}
+
+TraceFileWriter::TraceFileWriter(int lane_count, double units_per_vsync)
+    : m_units_per_vsync(units_per_vsync)
+    , m_lanes(lane_count)
+{
+    intern("");
+}
+
+uint32_t TraceFileWriter::intern(const char* s)
+{
+    auto it = m_string_indices.find(s);
+    if (it != m_string_indices.end()) {
+        return it->second;
+    }
+    uint32_t index = (uint32_t)m_strings.size();
+    m_strings.push_back(s);
+    m_string_indices.emplace(s, index);
+    return index;
+}
+
+void TraceFileWriter::set_lane_name(int lane, const std::string& name)
+{
+    assert(lane >= 0 && lane < (int)m_lanes.size());
+    m_lanes[lane].name = intern(name.c_str());
+}
+
+void TraceFileWriter::add(int lane, double start, double end, const char* name, int frame, uint32_t color, TraceBoxType type)
+{
+    assert(lane >= 0 && lane < (int)m_lanes.size());
+    m_lanes[lane].boxes.push_back({ start, std::max(start, end), nullptr, frame, color, type });
+    m_lanes[lane].names.push_back(intern(name));
+}
+
+bool TraceFileWriter::write(const std::string& path, std::string& error)
+{
+    TraceBuffer buffer;
+    TraceHeader header = {};
+    memcpy(header.magic, "FCTR", 4);
+    header.version = TraceVersion;
+    header.lane_count = (uint32_t)m_lanes.size();
+    header.string_count = (uint32_t)m_strings.size();
+    header.units_per_vsync = m_units_per_vsync;
+    buffer.append(&header, 1);
+
+    std::vector<uint32_t> string_offsets;
+    std::vector<char> strings;
+    for (const auto& s : m_strings) {
+        string_offsets.push_back((uint32_t)strings.size());
+        strings.insert(strings.end(), s.c_str(), s.c_str() + s.size() + 1);
+    }
+    // Appending may move the buffer, offsets are stored once they are known
+    const uint64_t string_offsets_offset = buffer.append(string_offsets);
+    const uint64_t strings_offset = buffer.append(strings);
+    const uint64_t lanes_offset = buffer.append(std::vector<LaneHeader>(m_lanes.size()));
+    buffer.at<TraceHeader>(0).string_offsets = string_offsets_offset;
+    buffer.at<TraceHeader>(0).strings = strings_offset;
+    buffer.at<TraceHeader>(0).strings_size = strings.size();
+    buffer.at<TraceHeader>(0).lanes = lanes_offset;
+
+    double end_time = 0.0;
+    for (size_t l = 0; l < m_lanes.size(); l++) {
+        const Lane& lane = m_lanes[l];
+
+        std::vector<uint32_t> order(lane.boxes.size());
+        for (uint32_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return lane.boxes[a].start < lane.boxes[b].start; });
+
+        const uint32_t block_count = (uint32_t)(order.size() + TraceFile::BlockSize - 1) / TraceFile::BlockSize;
+        std::vector<double> block_start(block_count);
+        std::vector<double> block_end(block_count);
+        std::vector<float> start_delta(order.size());
+        std::vector<float> duration(order.size());
+        std::vector<int32_t> frame(order.size());
+        std::vector<uint32_t> box_name(order.size());
+        std::vector<uint32_t> color(order.size());
+        std::vector<uint8_t> type(order.size());
+
+        double previous = 0.0;
+        double max_end = 0.0;
+        for (size_t i = 0; i < order.size(); i++) {
+            const TraceBox& box = lane.boxes[order[i]];
+            size_t block = i / TraceFile::BlockSize;
+            if (i % TraceFile::BlockSize == 0) {
+                block_start[block] = box.start;
+                previous = box.start;
+            }
+            start_delta[i] = (float)(box.start - previous);
+            // Decode as the reader will so that rounding errors do not pile up along the block
+            previous += start_delta[i];
+            duration[i] = (float)(box.end - previous);
+            frame[i] = box.frame;
+            box_name[i] = lane.names[order[i]];
+            color[i] = box.color;
+            type[i] = static_cast<uint8_t>(box.type);
+
+            max_end = std::max(max_end, previous + duration[i]);
+            block_end[block] = max_end;
+        }
+        end_time = std::max(end_time, max_end);
+
+        LaneHeader lane_header = {};
+        lane_header.name = lane.name;
+        lane_header.box_count = (uint32_t)order.size();
+        lane_header.block_count = block_count;
+        lane_header.block_start = buffer.append(block_start);
+        lane_header.block_end = buffer.append(block_end);
+        lane_header.start_delta = buffer.append(start_delta);
+        lane_header.duration = buffer.append(duration);
+        lane_header.frame = buffer.append(frame);
+        lane_header.box_name = buffer.append(box_name);
+        lane_header.color = buffer.append(color);
+        lane_header.type = buffer.append(type);
+        buffer.at<LaneHeader>(lanes_offset + l * sizeof(LaneHeader)) = lane_header;
+    }
+    buffer.at<TraceHeader>(0).end_time = end_time;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        error = "can not write " + path;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(buffer.data().data()), buffer.data().size());
+    if (!file) {
+        error = "can not write " + path;
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<TraceFile> TraceFile::open(const std::string& path, std::string& error)
+{
+    auto trace = std::make_shared<TraceFile>();
+    if (!trace->m_file.open(path)) {
+        error = "can not open " + path;
+        return nullptr;
+    }
+
+    const uint8_t* data = trace->m_file.data();
+    const size_t size = trace->m_file.size();
+    auto in_file = [&](uint64_t offset, uint64_t count, size_t element_size) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / element_size;
+    };
+
+    if (size < sizeof(TraceHeader) || memcmp(data, "FCTR", 4) != 0) {
+        error = path + " is not a trace file";
+        return nullptr;
+    }
+    const TraceHeader& header = *reinterpret_cast<const TraceHeader*>(data);
+    if (header.version != TraceVersion) {
+        error = path + " has an unsupported trace version";
+        return nullptr;
+    }
+    if (header.string_count == 0
+        || !in_file(header.string_offsets, header.string_count, sizeof(uint32_t))
+        || !in_file(header.strings, header.strings_size, 1)
+        || header.strings_size == 0 || data[header.strings + header.strings_size - 1] != 0
+        || !in_file(header.lanes, header.lane_count, sizeof(LaneHeader))) {
+        error = path + " is corrupted";
+        return nullptr;
+    }
+
+    trace->m_path = path;
+    trace->m_units_per_vsync = header.units_per_vsync;
+    trace->m_end_time = header.end_time;
+    trace->m_string_count = header.string_count;
+    trace->m_string_offsets = reinterpret_cast<const uint32_t*>(data + header.string_offsets);
+    trace->m_strings = reinterpret_cast<const char*>(data + header.strings);
+    for (uint32_t i = 0; i < header.string_count; i++) {
+        if (trace->m_string_offsets[i] >= header.strings_size) {
+            error = path + " is corrupted";
+            return nullptr;
+        }
+    }
+
+    const LaneHeader* lanes = reinterpret_cast<const LaneHeader*>(data + header.lanes);
+    for (uint32_t l = 0; l < header.lane_count; l++) {
+        const LaneHeader& h = lanes[l];
+        const uint32_t block_count = (h.box_count + BlockSize - 1) / BlockSize;
+        if (h.block_count != block_count
+            || !in_file(h.block_start, block_count, sizeof(double))
+            || !in_file(h.block_end, block_count, sizeof(double))
+            || !in_file(h.start_delta, h.box_count, sizeof(float))
+            || !in_file(h.duration, h.box_count, sizeof(float))
+            || !in_file(h.frame, h.box_count, sizeof(int32_t))
+            || !in_file(h.box_name, h.box_count, sizeof(uint32_t))
+            || !in_file(h.color, h.box_count, sizeof(uint32_t))
+            || !in_file(h.type, h.box_count, sizeof(uint8_t))) {
+            error = path + " is corrupted";
+            return nullptr;
+        }
+
+        Lane lane = {};
+        lane.name = h.name;
+        lane.box_count = h.box_count;
+        lane.block_count = h.block_count;
+        lane.block_start = reinterpret_cast<const double*>(data + h.block_start);
+        lane.block_end = reinterpret_cast<const double*>(data + h.block_end);
+        lane.start_delta = reinterpret_cast<const float*>(data + h.start_delta);
+        lane.duration = reinterpret_cast<const float*>(data + h.duration);
+        lane.frame = reinterpret_cast<const int32_t*>(data + h.frame);
+        lane.box_name = reinterpret_cast<const uint32_t*>(data + h.box_name);
+        lane.color = reinterpret_cast<const uint32_t*>(data + h.color);
+        lane.type = reinterpret_cast<const uint8_t*>(data + h.type);
+        trace->m_lanes.push_back(lane);
+        trace->m_total_box_count += h.box_count;
+    }
+
+    return trace;
+}
+
+const char* TraceFile::string(uint32_t index) const
+{
+    // Names are only checked when they are read, so that opening does not touch the boxes
+    return index < m_string_count ? m_strings + m_string_offsets[index] : g_Empty;
+}
+
+bool save_trace_file(const Simulator& simulator, const std::string& path, std::string& error)
+{
+    const auto& timeboxes = simulator.get_timeboxes();
+    int lane_count = 0;
+    for (const auto& t : timeboxes) {
+        lane_count = std::max(lane_count, t.core_index + 1);
+    }
+
+    TraceFileWriter writer(lane_count, simulator.get_option().VsyncPeriod);
+    for (int i = 0; i < lane_count; i++) {
+        writer.set_lane_name(i, simulator.lane_name(i));
+    }
+
+    for (const auto& t : timeboxes) {
+        TraceBoxType type = TraceBoxType::Normal;
+        if (t.type == TimeBoxType::In) {
+            type = TraceBoxType::In;
+        } else if (t.type == TimeBoxType::Out) {
+            type = TraceBoxType::Out;
+        } else if (t.type == TimeBoxType::FrameTime) {
+            type = TraceBoxType::FrameTime;
+        }
+        writer.add(t.core_index, t.raw_start(), t.raw_end(), t.name.c_str(), t.frame, t.color, type);
+    }
+
+    return writer.write(path, error);
+}
+
+void draw_trace_lanes(int lane_count, const std::function<const char*(int lane)>& lane_name, const TraceLaneVisit& visit, double end_time, float scale, float lane_height)
+{
+    AllocationScope allocations(AllocationTag::Drawing);
+    const auto laneOffset = ImVec2(50.f, 30.f);
+    const auto winPos = ImGui::GetWindowPos();
+    const auto winSize = ImGui::GetWindowSize();
+    const auto origin = winPos + ImGui::GetCursorPos() - ImVec2(ImGui::GetScrollX(), ImGui::GetScrollY()) + laneOffset;
+    const auto laneOrigin = winPos + ImGui::GetCursorPos() + laneOffset;
+    auto drawList = ImGui::GetWindowDrawList();
+
+    for (int i = 0; i < lane_count; i++) {
+        auto p1 = laneOrigin + ImVec2(0.f, i * lane_height);
+        drawList->AddRectFilled(p1, p1 + ImVec2(winSize.x, lane_height), i % 2 == 0 ? 0xff0c0c0c : 0xff111111);
+    }
+
+    // Only the visible boxes are decoded
+    const double windowMin = ImGui::GetScrollX() / scale;
+    const double windowMax = (ImGui::GetScrollX() + winSize.x) / scale;
+    char frameText[16];
+    for (int i = 0; i < lane_count; i++) {
+        visit(i, windowMin, windowMax, [&](const TraceBox& box) {
+            auto p0 = origin + ImVec2((float)box.start * scale, i * lane_height);
+            auto p1 = origin + ImVec2((float)box.end * scale, (i + 1) * lane_height);
+            if (box.type == TraceBoxType::FrameTime) {
+                p1.y -= lane_height * 0.5f;
+            }
+
+            frameText[0] = 0;
+            if (box.frame >= 0) {
+                snprintf(frameText, sizeof(frameText), "%d", box.frame);
+            }
+            DrawBox(drawList, p0, p1, box.color, time_box_type(box.type), frameText, box.name);
+        });
+    }
+
+    for (int i = 0; i < lane_count; i++) {
+        auto p1 = winPos + ImGui::GetCursorPos() + ImVec2(0.f, laneOffset.y + i * lane_height);
+        drawList->AddRectFilled(p1, p1 + ImVec2(laneOffset.x, lane_height), 0xff000000);
+        drawList->AddText(p1, 0xffffffff, lane_name(i));
+    }
+
+    // Scroll up to the end of the trace
+    ImGui::SetCursorPos(ImGui::GetCursorPos() + laneOffset + ImVec2((float)end_time * scale, lane_count * lane_height));
+}
+
+void draw_trace_file(const TraceFile& trace, float pixels_per_vsync, float lane_height, bool* open)
+{
+    // The same file may be opened several times
+    char id[32];
+    snprintf(id, sizeof(id), "##%p", (const void*)&trace);
+    std::string title = trace.path() + " (" + std::to_string(trace.total_box_count()) + " boxes)" + id;
+    ImGui::SetNextWindowSize(ImVec2(1900, 400), ImGuiCond_FirstUseEver);
+    ImGui::Begin(title.c_str(), open, ImGuiWindowFlags_HorizontalScrollbar);
+
+    draw_trace_lanes(
+        trace.lane_count(), [&](int lane) { return trace.lane_name(lane); },
+        [&](int lane, double from, double to, const std::function<void(const TraceBox&)>& draw) { trace.visit(lane, from, to, draw); },
+        trace.end_time(), pixels_per_vsync / (float)trace.units_per_vsync(), lane_height);
+
+    ImGui::End();
+}
+
+void draw_trace_file_controls(TraceFiles& files, const std::function<bool(const std::string&, std::string&)>& save)
+{
+    std::string error;
+    ImGui::InputText("Trace File", files.path, sizeof(files.path));
+
+    if (ImGui::Button("Save Binary Trace")) {
+        files.status = save(files.path, error) ? std::string("Saved ") + files.path : error;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Open Binary Trace")) {
+        auto trace = TraceFile::open(files.path, error);
+        if (trace) {
+            files.opened.push_back(trace);
+            files.status = std::string("Opened ") + files.path;
+        } else {
+            files.status = error;
+        }
+    }
+
+    if (!files.status.empty()) {
+        ImGui::TextWrapped("%s", files.status.c_str());
+    }
+}
+
+void draw_opened_trace_files(TraceFiles& files, float pixels_per_vsync, float lane_height)
+{
+    for (auto it = files.opened.begin(); it != files.opened.end();) {
+        bool open = true;
+        draw_trace_file(**it, pixels_per_vsync, lane_height, &open);
+        it = open ? it + 1 : files.opened.erase(it);
+    }
+}
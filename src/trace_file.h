@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+class Simulator;
+
+enum class TraceBoxType : uint8_t
+{
+    Normal,
+    In,
+    Out,
+    FrameTime,
+};
+
+struct TraceBox
+{
+    double start;
+    double end;
+    const char* name;
+    int frame;
+    uint32_t color;
+    TraceBoxType type;
+};
+
+// Builds a .fctrace file: every lane is a set of columns sorted by start time.
+// Start times are stored as deltas from the previous box, with an absolute time
+// at the start of each block of boxes so that any time range can be reached directly.
+class TraceFileWriter
+{
+public:
+    TraceFileWriter(int lane_count, double units_per_vsync);
+
+    void set_lane_name(int lane, const std::string& name);
+    void add(int lane, double start, double end, const char* name, int frame, uint32_t color, TraceBoxType type);
+
+    bool write(const std::string& path, std::string& error);
+
+private:
+    struct Lane
+    {
+        uint32_t name = 0;
+        std::vector<TraceBox> boxes;
+        std::vector<uint32_t> names;
+    };
+
+    uint32_t intern(const char* s);
+
+    double m_units_per_vsync;
+    std::vector<Lane> m_lanes;
+    std::vector<std::string> m_strings;
+    std::unordered_map<std::string, uint32_t> m_string_indices;
+};
+
+// A .fctrace file read in place from its mapping, boxes are decoded while they are visited
+class TraceFile
+{
+public:
+    static constexpr int BlockSize = 64;
+
+    static std::shared_ptr<TraceFile> open(const std::string& path, std::string& error);
+
+    const std::string& path() const { return m_path; }
+    int lane_count() const { return (int)m_lanes.size(); }
+    const char* lane_name(int lane) const { return string(m_lanes[lane].name); }
+    uint32_t box_count(int lane) const { return m_lanes[lane].box_count; }
+    uint64_t total_box_count() const { return m_total_box_count; }
+    double units_per_vsync() const { return m_units_per_vsync; }
+    double end_time() const { return m_end_time; }
+
+    // Call f with every box of the lane overlapping [from, to]
+    template <class F>
+    void visit(int lane, double from, double to, F&& f) const;
+
+private:
+    struct Lane
+    {
+        uint32_t name;
+        uint32_t box_count;
+        uint32_t block_count;
+        const double* block_start;
+        // Max end of the boxes of all the blocks up to this one
+        const double* block_end;
+        const float* start_delta;
+        const float* duration;
+        const int32_t* frame;
+        const uint32_t* box_name;
+        const uint32_t* color;
+        const uint8_t* type;
+    };
+
+    const char* string(uint32_t index) const;
+
+    MappedFile m_file;
+    std::string m_path;
+    double m_units_per_vsync = 1.0;
+    double m_end_time = 0.0;
+    uint64_t m_total_box_count = 0;
+    uint32_t m_string_count = 0;
+    const uint32_t* m_string_offsets = nullptr;
+    const char* m_strings = nullptr;
+    std::vector<Lane> m_lanes;
+};
+
+template <class F>
+void TraceFile::visit(int lane, double from, double to, F&& f) const
+{
+    const Lane& l = m_lanes[lane];
+
+    // First block holding a box which ends after from
+    uint32_t low = 0;
+    uint32_t high = l.block_count;
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+        if (l.block_end[middle] < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (uint32_t b = low; b < l.block_count && l.block_start[b] <= to; b++) {
+        double start = l.block_start[b];
+        uint32_t last = std::min(l.box_count, (b + 1) * (uint32_t)BlockSize);
+        for (uint32_t i = b * BlockSize; i < last; i++) {
+            start += l.start_delta[i];
+            if (start > to) {
+                return;
+            }
+            double end = start + l.duration[i];
+            if (end >= from) {
+                f(TraceBox{ start, end, string(l.box_name[i]), l.frame[i], l.color[i], static_cast<TraceBoxType>(l.type[i]) });
+            }
+        }
+    }
+}
+
+bool save_trace_file(const Simulator& simulator, const std::string& path, std::string& error);
+
+// Calls draw with every box of the lane overlapping [from, to]
+using TraceLaneVisit = std::function<void(int lane, double from, double to, const std::function<void(const TraceBox&)>& draw)>;
+
+// Lanes of boxes drawn in the current window like the simulation timeline, scale is in pixels per time unit
+void draw_trace_lanes(int lane_count, const std::function<const char*(int lane)>& lane_name, const TraceLaneVisit& visit, double end_time, float scale, float lane_height);
+
+// Timeline window of a trace, pixels_per_vsync sets the zoom
+void draw_trace_file(const TraceFile& trace, float pixels_per_vsync, float lane_height, bool* open);
+
+struct TraceFiles
+{
+    char path[256] = "timeline.fctrace";
+    std::string status;
+    std::vector<std::shared_ptr<TraceFile>> opened;
+};
+
+// Save and open controls, save writes the current simulation to the given path
+void draw_trace_file_controls(TraceFiles& files, const std::function<bool(const std::string&, std::string&)>& save);
+
+// Windows of the opened traces, closing a window unmaps its file
+void draw_opened_trace_files(TraceFiles& files, float pixels_per_vsync, float lane_height);
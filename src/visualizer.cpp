@@ -4,9 +4,16 @@
 #include "imgui_internal.h"
 
 #include "app.h"
+#include "frame_diff.h"
+#include "trace_export.h"
+#include "profiler.h"
+#include "allocation_tracker.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <chrono>
+#include <cmath>
+#include <fstream>
 #include <memory>
 #include <random>
 
@@ -291,7 +298,20 @@ ImU32 GetConstrastColor(ImU32 color)
     }
 }
 
-void DrawTimeBox(ImVec2 origin, const TimeBox& timebox)
+ImU32 IdleCauseColor(IdleCause cause)
+{
+    switch (cause) {
+    case IdleCause::NoReadyJob: return g_Grey;
+    case IdleCause::WaitTag: return g_Yellow;
+    case IdleCause::FramePool: return g_Cyan;
+    case IdleCause::FramesInFlight: return g_Red;
+    case IdleCause::Pacing: return g_Green;
+    case IdleCause::Dispatch: return g_Magenta;
+    }
+    return g_White;
+}
+
+void DrawTimeBox(ImVec2 origin, const TimeBox& timebox, bool critical = false)
 {
     bool is_frame_time = timebox.type == TimeBoxType::FrameTime;
     bool is_frame_rate = timebox.type == TimeBoxType::FrameRate;
@@ -318,46 +338,54 @@ void DrawTimeBox(ImVec2 origin, const TimeBox& timebox)
         p1.y += (20.f - App::get().DisplayOption.Height * 0.7f);
     }
 
-    if (is_frame_rate) {
+    DrawBox(drawList, p0, p1, timebox.color, timebox.type, timebox.frame_index.c_str(), timebox.name.c_str(), critical);
+}
+}
+
+void DrawBox(ImDrawList* drawList, ImVec2 p0, ImVec2 p1, ImU32 color, TimeBoxType type, const char* frameIndex, const char* name, bool critical)
+{
+    if (type == TimeBoxType::FrameRate) {
         drawList->AddRect(p0, p1, 0xffffffff, 3.5f, ImDrawCornerFlags_All);
     } else {
-        drawList->AddRectFilled(p0, p1, timebox.color, 3.5f, ImDrawCornerFlags_All);
+        drawList->AddRectFilled(p0, p1, color, 3.5f, ImDrawCornerFlags_All);
+    }
+    if (critical) {
+        drawList->AddRect(p0, p1, g_Magenta, 3.5f, ImDrawCornerFlags_All, 2.f);
     }
-    if (timebox.type == TimeBoxType::In) {
+    if (type == TimeBoxType::In) {
         auto p2 = p1;
         p2.x = p0.x + (p1.x - p0.x) * 0.1f;
-        auto newCol = g_White; //GetConstrastColor(GetConstrastColor(timebox.color));
-        drawList->AddRectFilledMultiColor(p0, p2, newCol, timebox.color, timebox.color, newCol);
-    } else if (timebox.type == TimeBoxType::Out) {
+        auto newCol = g_White; //GetConstrastColor(GetConstrastColor(color));
+        drawList->AddRectFilledMultiColor(p0, p2, newCol, color, color, newCol);
+    } else if (type == TimeBoxType::Out) {
         auto p2 = p0;
         p2.x = p1.x - (p1.x - p0.x) * 0.1f;
-        auto newCol = g_Black; //GetConstrastColor(GetConstrastColor(timebox.color));
-        drawList->AddRectFilledMultiColor(p2, p1, timebox.color, newCol, newCol, timebox.color);
+        auto newCol = g_Black; //GetConstrastColor(GetConstrastColor(color));
+        drawList->AddRectFilledMultiColor(p2, p1, color, newCol, newCol, color);
     }
 
     ImVec2 size = p1 - p0;
-    ImU32 c = GetConstrastColor(~timebox.color);
+    ImU32 c = GetConstrastColor(~color);
 
-    ImVec2 textFrameSize = ImGui::CalcTextSize(timebox.frame_index.c_str());
+    ImVec2 textFrameSize = ImGui::CalcTextSize(frameIndex);
     ImVec2 offsetFrame = (size - textFrameSize) * 0.5f;
     offsetFrame.x = 2.f;
-    drawList->AddText(p0 + offsetFrame, c, timebox.frame_index.c_str());
+    drawList->AddText(p0 + offsetFrame, c, frameIndex);
 
-    ImVec2 textNameSize = ImGui::CalcTextSize(timebox.name.c_str());
+    ImVec2 textNameSize = ImGui::CalcTextSize(name);
     ImVec2 offsetName = (size - textFrameSize) * 0.5f;
     offsetName.x = size.x - textNameSize.x - 2.f;
     auto clip = ImVec4(p0.x + textFrameSize.x + 2, p0.y, p1.x, p1.y);
-    drawList->AddText(nullptr, 0.f, p0 + offsetName, c, timebox.name.c_str(), nullptr, 0.f, &clip);
-}
+    drawList->AddText(nullptr, 0.f, p0 + offsetName, c, name, nullptr, 0.f, &clip);
 }
 
-PatternJob::PatternJob(std::shared_ptr<FrameFlow> flow, int stage_index, Simulator* sim, std::shared_ptr<Frame> f, std::shared_ptr<int> counter)
+PatternJob::PatternJob(std::shared_ptr<FrameFlow> flow, int stage_index, Simulator* sim, std::shared_ptr<Frame> f, std::shared_ptr<DependencyCounter> counter)
     : Job(sim, f)
     , m_flow(flow)
-    , m_counter(counter)
     , m_stage_index(stage_index)
+    , m_counter(counter)
 {
-    m_duration = m_flow->stage_duration(m_stage_index) * m_simulator->generate();
+    m_duration = m_simulator->job_duration(m_stage_index, m_frame->frame_index);
 }
 
 float PatternJob::duration() const
@@ -368,6 +396,18 @@ const char* PatternJob::name() const
 {
     return m_flow->stages[m_stage_index]->name;
 }
+int PatternJob::stage_index() const
+{
+    return m_stage_index;
+}
+Lane PatternJob::lane() const
+{
+    return m_flow->stages[m_stage_index]->gpu ? Lane::Gpu : Lane::Cpu;
+}
+int PatternJob::queue() const
+{
+    return m_flow->stages[m_stage_index]->gpu_queue;
+}
 bool PatternJob::is_first() const
 {
     return m_stage_index == 0;
@@ -379,6 +419,9 @@ bool PatternJob::is_release() const
 
 void PatternJob::before_schedule(float time)
 {
+    if (lane() == Lane::Gpu && queue() == 0) {
+        m_frame->gpu_time += m_duration;
+    }
     if (is_first()) {
         if (m_frame->start_time < 0)
         {
@@ -410,18 +453,26 @@ bool PatternJob::is_ready() const
 bool PatternJob::try_exec(float time)
 {
     const FrameStage& stage = *m_flow->stages[m_stage_index];
+    const int frame_index = m_frame->frame_index;
     bool generate_next = m_flow->start_next_frame_stage == m_stage_index;
     bool generation_priority = stage.create_has_priority;
-    bool is_last = m_flow->stages.size() == m_stage_index + 1;
+    bool is_last = m_flow->last_cpu_stage() == m_stage_index;
+    bool is_kick = m_flow->is_kick_stage(m_stage_index);
+
+    if (is_kick && m_frame->kick_ready_time < 0.f) {
+        m_frame->kick_ready_time = time;
+    }
 
     // TODO: Change how is done generation
     bool can_generate_next = !generate_next || generate_next && !m_simulator->frame_pool_empty();
+    // A frame already in flight submits its next gpu stages without waiting for itself
+    bool can_submit = !is_kick || m_frame->gpu_submitted || !m_simulator->gpu_queue_full();
 
-    bool cond = can_generate_next;
+    bool cond = can_generate_next && can_submit;
     if (cond) {
-        if (m_counter && *m_counter > 1) {
-            (*m_counter) -= 1;
-            assert(*m_counter >= 1);
+        // Only the last job of a split continues the frame
+        if (m_counter && !m_counter->release()) {
+            assert(m_counter->value() >= 1);
         } else {
             auto gen_next = [&]() {
                 if (generate_next) {
@@ -433,7 +484,22 @@ bool PatternJob::try_exec(float time)
                 gen_next();
             }
 
-            if (!is_last) {
+            if (!stage.gpu) {
+                int next = m_stage_index + 1;
+
+                // The kick submits the following gpu stages, the cpu continues with the next cpu stage
+                if (is_kick) {
+                    for (; next < (int)m_flow->stages.size() && m_flow->stages[next]->gpu; next++) {
+                        create_job(m_flow, next, m_simulator, m_frame);
+                    }
+                }
+
+                if (next < (int)m_flow->stages.size()) {
+                    create_job(m_flow, next, m_simulator, m_frame);
+                }
+            } else if (m_flow->previous_cpu_stage(m_stage_index) < 0 && m_stage_index + 1 < (int)m_flow->stages.size() && !m_flow->stages[m_stage_index + 1]->gpu) {
+                // The gpu stages before the first cpu stage were submitted with the frame,
+                // the last of them starts the cpu chain
                 create_job(m_flow, m_stage_index + 1, m_simulator, m_frame);
             }
 
@@ -441,21 +507,17 @@ bool PatternJob::try_exec(float time)
                 gen_next();
             }
 
-            if (is_last) {
+            if (stage.gpu) {
+                m_simulator->finish_gpu_stage(m_frame);
+            } else if (is_last && m_frame->gpu_submitted) {
+                m_simulator->finish_cpu(m_frame);
+            } else if (is_last) {
                 m_frame->end_time = time;
                 m_simulator->push_frame(m_frame);
             }
 
             // TODO: change node id, with stage tag
-
-            if (m_frame->finished_stage.find(stage.stage_tag) == m_frame->finished_stage.end())
-            {
-                m_frame->finished_stage.emplace(stage.stage_tag, 1);
-            }
-            else
-            {
-                m_frame->finished_stage[stage.stage_tag] += 1;
-            }
+            m_simulator->finish_stage(m_frame, frame_index, stage.stage_tag);
         }
 
         return true;
@@ -473,21 +535,163 @@ bool Core::try_exec()
     return false;
 }
 
+bool Core::accept(const Job& job) const
+{
+    return job.lane() == lane && (lane != Lane::Gpu || job.queue() == queue);
+}
+
+PresentJob::PresentJob(Simulator* sim, std::shared_ptr<Frame> f)
+    : Job(sim, f)
+{
+}
+
+ImU32 PresentJob::color() const
+{
+    return g_Colors[frame_index() % array_size(g_Colors)];
+}
+float PresentJob::duration() const
+{
+    return m_duration;
+}
+const char* PresentJob::name() const
+{
+    return "Present";
+}
+int PresentJob::stage_index() const
+{
+    return -1;
+}
+Lane PresentJob::lane() const
+{
+    return Lane::Display;
+}
+int PresentJob::queue() const
+{
+    return 0;
+}
+bool PresentJob::is_first() const
+{
+    return false;
+}
+bool PresentJob::is_release() const
+{
+    return true;
+}
+bool PresentJob::is_ready() const
+{
+    return true;
+}
+
+void PresentJob::before_schedule(float time)
+{
+    // Wait on the display lane until the frame can be flipped
+    m_frame->ready_time = time;
+    m_simulator->update_limiter(time);
+    m_duration = m_simulator->next_present_time(time) - time;
+}
+
+bool PresentJob::try_exec(float time)
+{
+    m_simulator->present_frame(m_frame, time);
+    return true;
+}
+
+std::shared_ptr<Job> PresentJob::clone(JobCloneContext& context) const
+{
+    auto job = std::make_shared<PresentJob>(*this);
+    job->m_frame = context.frame(m_frame);
+    return job;
+}
+
+std::shared_ptr<Job> PatternJob::clone(JobCloneContext& context) const
+{
+    auto job = std::make_shared<PatternJob>(*this);
+    job->m_frame = context.frame(m_frame);
+    job->m_counter = context.counter(m_counter);
+    return job;
+}
+
+std::shared_ptr<Frame> JobCloneContext::frame(const std::shared_ptr<Frame>& f)
+{
+    auto& copy = frames[f.get()];
+    if (!copy) {
+        copy = std::make_shared<Frame>(*f);
+    }
+    return copy;
+}
+
+std::shared_ptr<DependencyCounter> JobCloneContext::counter(const std::shared_ptr<DependencyCounter>& c)
+{
+    if (!c) {
+        return nullptr;
+    }
+    auto& copy = counters[c.get()];
+    if (!copy) {
+        copy = std::make_shared<DependencyCounter>(*c);
+    }
+    return copy;
+}
+
+std::shared_ptr<Job> JobCloneContext::job(const std::shared_ptr<Job>& j)
+{
+    if (!j) {
+        return nullptr;
+    }
+    auto& copy = jobs[j.get()];
+    if (!copy) {
+        copy = j->clone(*this);
+    }
+    return copy;
+}
+
+Core JobCloneContext::core(const Core& c)
+{
+    Core copy = c;
+    copy.current_job = job(c.current_job);
+    return copy;
+}
+
 Simulator::Simulator(std::shared_ptr<FrameFlow> flow, const SimulationOption& option)
     : m_core_count(option.CoreNum)
-    , m_critical_path_time(flow->compute_critical_path_time())
+    , m_gpu_queue_count(flow->gpu_queue_count())
+    , m_lane_count(option.CoreNum + flow->gpu_queue_count() + (flow->gpu_queue_count() > 0 ? 1 : 0))
     , m_frame_pool_size(option.FramePoolSize)
     , m_frame_count(0)
+    , m_core_busy_time(option.CoreNum, 0.f)
+    , m_statistics(option.VsyncPeriod, option.CoreNum)
+    , m_utilization(option.CoreNum + flow->gpu_queue_count())
+    , m_flow(flow)
+    , m_critical_path_time(flow->compute_critical_path_time())
+    , m_lower_bound(compute_lower_bound(*flow, option.CoreNum))
+    , m_option(option)
     , m_generator(option.Seed)
     , m_distribution(0.0001f, 1.f)
-    , m_option(option)
-    , m_flow(flow)
+    , m_uniform_samples(DurationSampler::BlockSize)
+    , m_next_uniform_sample(DurationSampler::BlockSize)
 {
-    for (int i = 0; i < m_core_count; i++) {
+    m_limiter.mode = option.Limiter;
+    m_limiter.fixed_interval = option.LimiterInterval;
+    m_limiter.vsync_period = option.VsyncPeriod;
+    m_limiter.max_divisor = option.LimiterDivisor;
+    m_limiter.miss_count_limit = option.LimiterMissCount;
+    m_pacing_cpu_samples.reset(option.PacingSampleCount);
+    m_pacing_gpu_samples.reset(option.PacingSampleCount);
+    for (int i = 0; i < m_lane_count; i++) {
         m_cores.emplace_back();
     }
-    for (int i = 0; i < m_core_count; i++) {
+    for (int i = 0; i < m_lane_count; i++) {
         m_cores[i].index = i;
+        if (i >= m_core_count + m_gpu_queue_count) {
+            m_cores[i].lane = Lane::Display;
+        } else if (i >= m_core_count) {
+            m_cores[i].lane = Lane::Gpu;
+            m_cores[i].queue = i - m_core_count;
+        }
+    }
+
+    for (int i = 0; i < (int)flow->stages.size(); i++) {
+        m_samplers.emplace_back(flow->stages[i]->distribution, (uint32_t)option.Seed * 0x9e3779b9u + i + 1);
+        m_capture_columns.push_back(option.Replay && option.Capture ? option.Capture->find_column(flow->stages[i]->name) : -1);
     }
 
     for (int i = 0; i < m_frame_pool_size; i++) {
@@ -503,12 +707,14 @@ Simulator::Simulator(std::shared_ptr<FrameFlow> flow, const SimulationOption& op
 
 void Simulator::draw()
 {
+    PROFILE_ZONE("Simulator::draw");
+    AllocationScope allocations(AllocationTag::Drawing);
     bool yes = true;
     ImGui::SetNextWindowSize(ImVec2(1900, 400), ImGuiCond_FirstUseEver);
     ImGui::SetNextWindowPos(ImVec2(0, 600), ImGuiCond_FirstUseEver);
 
     std::stringstream s;
-    s << m_name << "(critical path time = " << m_critical_path_time << ")";
+    s << m_name << "(critical path time = " << m_critical_path_time << ", lower bound = " << m_lower_bound << ")";
     ImGui::Begin(s.str().c_str(), &yes, ImGuiWindowFlags_HorizontalScrollbar);
 
     auto coreOffset = ImVec2(50.f, 30.f);
@@ -529,7 +735,7 @@ void Simulator::draw()
     }
 
     auto corelineOrigin = ImGui::GetCursorPos() + winPos;
-    for (int i = 0; i < m_core_count; i++) {
+    for (int i = 0; i < m_lane_count; i++) {
         auto p1 = corelineOrigin + coreOffset;
         p1.y += i * App::get().DisplayOption.Height;
         auto p2 = p1 + ImVec2(winSize.x, App::get().DisplayOption.Height);
@@ -562,34 +768,43 @@ void Simulator::draw()
         }
     }
 
-    // display critical path time
+    // display critical path time, the analysis is a pass over the whole timeline which
+    // is only redone when nothing was stepped since the previous draw
+    if (m_step_count == m_drawn_step_count) {
+        update_critical_path();
+    }
+    m_drawn_step_count = m_step_count;
+    const CriticalPathAnalysis& critical_path = get_critical_path();
 
     m_diplayed_timebox = 0;
     for (const auto& t : get_timeboxes()) {
         if (t.start() <= windowMax && t.end() >= windowMin) {
-            DrawTimeBox(timelineOrigin, t);
+            DrawTimeBox(timelineOrigin, t, critical_path.is_critical(t.frame, t.stage));
             m_diplayed_timebox += 1;
         }
     }
 
+    if (App::get().DisplayOption.ShowIdleGaps) {
+        DrawIdleGaps(timelineOrigin);
+    }
+
     if (App::get().DisplayOption.ShowCoreTime) {
         DrawCore(timelineOrigin);
     }
 
-    for (int i = 0; i < m_core_count; i++) {
+    for (int i = 0; i < m_lane_count; i++) {
         auto p1 = corelineOrigin + ImVec2(0.f, coreOffset.y);
         p1.y += i * App::get().DisplayOption.Height;
         auto p2 = p1 + ImVec2(coreOffset.x, App::get().DisplayOption.Height);
 
         drawlist->AddRectFilled(p1, p2, 0xff000000);
-        std::stringstream s;
-        s << "Core " << i;
-        drawlist->AddText(p1, 0xffffffff, s.str().c_str());
+        drawlist->AddText(p1, 0xffffffff, lane_name(i).c_str());
     }
 
     // Add an offset to scroll a bit more than the max of the timeline
     auto cursor = get_max();
-    cursor.x;
+    cursor.x *= App::get().DisplayOption.Scale;
+    cursor.y *= App::get().DisplayOption.Height;
     ImGui::SetCursorPos(cursor);
 
     ImGui::End();
@@ -597,21 +812,51 @@ void Simulator::draw()
 
 void Simulator::step(bool autostep)
 {
-    if (m_step_count >= App::get().ControlOption.MaxAutoStep && autostep) {
+    PROFILE_ZONE("Simulator::step");
+    if (autostep && m_step_count >= App::get().ControlOption.MaxAutoStep) {
         return;
     }
     if (m_frozen) {
         return;
     }
 
-    m_step_count += 1;
+    AllocationStepScope allocations;
+    advance();
+}
 
-    if (m_request_start_count > 0 && !frame_pool_empty())
-    {
-        auto f = start_frame(0.f);
-        create_job(m_flow, 0, this, f);
-        m_request_start_count -= 1;
+int Simulator::run_frames(int count, int max_steps_per_frame, bool discard)
+{
+    int presented = 0;
+    const int max_step_count = count * max_steps_per_frame;
+    for (int i = 0; i < max_step_count && presented < count && !m_stalled; i++) {
+        const size_t framerate_count = m_framerate.size();
+        step(false);
+        presented += (int)(m_framerate.size() - framerate_count);
+        if (discard) {
+            discard_results();
+        }
+    }
+    return presented;
+}
+
+void Simulator::run_steps(int count)
+{
+    for (int i = 0; i < count && !m_stalled; i++) {
+        step(false);
+    }
+}
+
+void Simulator::advance()
+{
+    // Steps simulated again after a restore already have their checkpoint
+    if (m_checkpoint_interval > 0 && m_step_count % m_checkpoint_interval == 0
+        && (m_checkpoints.empty() || m_checkpoints.back().step_count < m_step_count)) {
+        save_checkpoint();
+    }
+
+    m_step_count += 1;
 
+    if (start_requested_frame()) {
         return;
     }
 
@@ -619,16 +864,16 @@ void Simulator::step(bool autostep)
         return a.time < b.time || (a.time == b.time && a.index < b.index);
     });
 
-    // Find the first core available
+    // Find the first core available with a job it can execute
     Core* latest_available_core = nullptr;
     for (int i = 0; i < m_cores.size(); i++) {
-        if (!m_cores[i].current_job) {
+        if (!m_cores[i].current_job && has_ready_job(m_cores[i])) {
             latest_available_core = &m_cores[i];
             break;
         }
     }
 
-    if (latest_available_core == nullptr || !has_ready_job()) {
+    if (latest_available_core == nullptr) {
         std::sort(m_cores.begin(), m_cores.end(), [](auto& a, auto& b) -> bool {
             return a.time < b.time || (a.time == b.time && a.index < b.index);
         });
@@ -641,35 +886,100 @@ void Simulator::step(bool autostep)
             }
         }
 
-        assert(latest_busy_core != nullptr);
+        // No core can execute or complete a job, the flow can not make progress
+        if (latest_busy_core == nullptr) {
+            m_stalled = true;
+            return;
+        }
 
         // Advance the time of all the core which has no job to execute
         // to be equal to min_core.time
         for (int i = 0; latest_busy_core != &m_cores[i]; i++) {
+            add_idle_gap(m_cores[i], latest_busy_core->time, idle_cause(m_cores[i]));
+            m_cores[i].idle |= m_cores[i].time < latest_busy_core->time;
             m_cores[i].time = latest_busy_core->time;
         }
     } else {
         assert(latest_available_core != nullptr);
 
-        std::shared_ptr<Job> j = pop_job();
-
-        j->before_schedule(latest_available_core->time);
+        std::shared_ptr<Job> j = pop_job(*latest_available_core);
 
-        auto timebox_color = j->color();
-        auto type = TimeBoxType::Normal;
-        if (j->is_first()) {
-            type = TimeBoxType::In;
+        if (j->is_first() && j->frame_index() != m_last_paced_frame) {
+            float paced_time = paced_start_time(j->frame_index(), latest_available_core->time);
+            add_idle_gap(*latest_available_core, paced_time, IdleCause::Pacing);
+            latest_available_core->time = paced_time;
+            m_last_paced_frame = j->frame_index();
         }
-        if (j->is_release()) {
-            type = TimeBoxType::Out;
+
+        if (latest_available_core->lane == Lane::Cpu) {
+            const float dispatch_time = latest_available_core->time + m_option.DispatchOverhead + (latest_available_core->idle ? m_option.WakeupLatency : 0.f);
+            add_idle_gap(*latest_available_core, dispatch_time, IdleCause::Dispatch);
+            latest_available_core->time = dispatch_time;
+            latest_available_core->idle = false;
         }
-        m_timeboxes.emplace_back(latest_available_core->index, j->frame_index(), latest_available_core->time, latest_available_core->time + j->duration(), j->name(), timebox_color, type);
-        m_max = ImMax(m_max, TimeBoxP1(m_timeboxes.back()));
+
+        j->before_schedule(latest_available_core->time);
+
+        record_timebox(*latest_available_core, *j, latest_available_core->time, j->duration());
         latest_available_core->time += j->duration();
         latest_available_core->current_job = j;
     }
 }
 
+void Simulator::finish_stage(std::shared_ptr<Frame> f, int frame_index, int stage_tag)
+{
+    if (f->finished_stage.find(stage_tag) == f->finished_stage.end())
+    {
+        f->finished_stage.emplace(stage_tag, 1);
+    }
+    else
+    {
+        f->finished_stage[stage_tag] += 1;
+    }
+
+    if (m_stage_listener) {
+        m_stage_listener(frame_index, stage_tag);
+    }
+}
+
+bool Simulator::start_requested_frame()
+{
+    // A frame starting on the gpu is submitted like a kick
+    const bool starts_on_gpu = m_flow->stages[0]->gpu;
+    if (m_request_start_count <= 0 || frame_pool_empty() || (starts_on_gpu && gpu_queue_full())) {
+        return false;
+    }
+
+    auto f = start_frame(0.f);
+    f->cpu_done = m_flow->last_cpu_stage() < 0;
+    create_job(m_flow, 0, this, f);
+    for (int i = 1; starts_on_gpu && i < (int)m_flow->stages.size() && m_flow->stages[i]->gpu; i++) {
+        create_job(m_flow, i, this, f);
+    }
+    m_request_start_count -= 1;
+    return true;
+}
+
+void Simulator::record_timebox(const Core& core, const Job& job, float start, float duration)
+{
+    AllocationScope allocations(AllocationTag::Timeline);
+    auto type = TimeBoxType::Normal;
+    if (job.is_first()) {
+        type = TimeBoxType::In;
+    }
+    if (job.is_release()) {
+        type = TimeBoxType::Out;
+    }
+    m_timeboxes.emplace_back(core.index, job.frame_index(), start, start + duration, job.name(), job.color(), type, job.stage_index());
+    m_max = ImMax(m_max, ImVec2(start + duration, (float)(core.index + 1)));
+    if (core.lane == Lane::Cpu) {
+        m_core_busy_time[core.index] += duration;
+    }
+    if (core.index < (int)m_utilization.size()) {
+        m_utilization[core.index].busy_time += duration;
+    }
+}
+
 float Simulator::generate()
 {
     float Min = 0.1f;
@@ -677,7 +987,14 @@ float Simulator::generate()
     float max = 1.f + m_option.Random * (m_option.MaxRandom - 1.f);
     float min = 1.f - (1.f - Min) * m_option.Random;
 
-    float r = m_distribution(m_generator);
+    // Draw the uniform samples in bulk, in the same order as one at a time
+    if (m_next_uniform_sample == m_uniform_samples.size()) {
+        for (auto& u : m_uniform_samples) {
+            u = m_distribution(m_generator);
+        }
+        m_next_uniform_sample = 0;
+    }
+    float r = m_uniform_samples[m_next_uniform_sample++];
     float A = 1.f - min;
     float B = m_option.MaxRandom - 1.f;
 
@@ -697,6 +1014,14 @@ float Simulator::generate()
     return result;
 }
 
+float Simulator::sample(int stage_index, int frame_index)
+{
+    if ((size_t)stage_index >= m_samplers.size() || m_samplers[stage_index].type() == DistributionType::Default) {
+        return generate();
+    }
+    return m_samplers[stage_index].next(frame_index);
+}
+
 std::shared_ptr<Frame> Simulator::get_frame(int index)
 {
     for (auto f : m_frames) {
@@ -719,6 +1044,243 @@ std::shared_ptr<Frame> Simulator::start_frame(float time)
     return f;
 }
 
+const char* idle_cause_name(IdleCause cause)
+{
+    switch (cause) {
+    case IdleCause::NoReadyJob: return "No Ready Job";
+    case IdleCause::WaitTag: return "Wait Tag";
+    case IdleCause::FramePool: return "Frame Pool";
+    case IdleCause::FramesInFlight: return "Frames In Flight";
+    case IdleCause::Pacing: return "Pacing";
+    case IdleCause::Dispatch: return "Dispatch";
+    }
+    return "";
+}
+
+float CoreUtilization::total_time() const
+{
+    float total = busy_time;
+    for (float t : idle_time) {
+        total += t;
+    }
+    return total;
+}
+
+IdleCause Simulator::idle_cause(const Core& core) const
+{
+    // The core holds a job which can not complete yet
+    if (core.current_job) {
+        return frame_pool_empty() ? IdleCause::FramePool : IdleCause::FramesInFlight;
+    }
+
+    for (const auto& j : m_job_queue) {
+        if (core.accept(*j) && !j->is_ready()) {
+            return IdleCause::WaitTag;
+        }
+    }
+
+    if (frame_pool_empty()) {
+        return IdleCause::FramePool;
+    }
+    if (gpu_queue_full()) {
+        return IdleCause::FramesInFlight;
+    }
+    return IdleCause::NoReadyJob;
+}
+
+void Simulator::add_idle_gap(const Core& core, float end, IdleCause cause)
+{
+    if (end <= core.time || core.index >= (int)m_utilization.size()) {
+        return;
+    }
+
+    m_utilization[core.index].idle_time[static_cast<int>(cause)] += end - core.time;
+
+    // Extend the previous gap of the core when it continues it
+    for (auto it = m_idle_gaps.rbegin(); it != m_idle_gaps.rend() && it - m_idle_gaps.rbegin() < m_lane_count; ++it) {
+        if (it->core_index == core.index) {
+            if (it->cause == cause && it->end == core.time) {
+                it->end = end;
+                return;
+            }
+            break;
+        }
+    }
+    m_idle_gaps.push_back({ core.index, core.time, end, cause });
+}
+
+void Simulator::save_checkpoint()
+{
+    JobCloneContext context;
+    Checkpoint c;
+    c.step_count = m_step_count;
+    c.frame_count = m_frame_count;
+    c.request_start_count = m_request_start_count;
+    c.frames_in_flight = m_frames_in_flight;
+    c.last_present_time = m_last_present_time;
+    c.last_paced_frame = m_last_paced_frame;
+    c.limiter = m_limiter;
+    c.last_push_time = m_last_push_time;
+    c.max = m_max;
+
+    for (const auto& core : m_cores) {
+        c.cores.push_back(context.core(core));
+    }
+    for (const auto& f : m_frames) {
+        c.frames.push_back(context.frame(f));
+    }
+    for (const auto& j : m_job_queue) {
+        c.job_queue.push_back(context.job(j));
+    }
+    for (const auto& f : m_frame_available) {
+        c.frame_available.push_back(context.frame(f));
+    }
+
+    c.generator = m_generator;
+    c.distribution = m_distribution;
+    c.uniform_samples = m_uniform_samples;
+    c.next_uniform_sample = m_next_uniform_sample;
+    c.samplers = m_samplers;
+
+    c.core_busy_time = m_core_busy_time;
+    c.statistics = m_statistics;
+    c.utilization = m_utilization;
+    c.pacing_cpu_samples = m_pacing_cpu_samples;
+    c.pacing_gpu_samples = m_pacing_gpu_samples;
+
+    c.timebox_count = m_timeboxes.size();
+    c.framerate_count = m_framerate.size();
+    c.idle_gap_count = m_idle_gaps.size();
+    size_t tail = std::min(m_idle_gaps.size(), (size_t)m_lane_count);
+    c.idle_gap_tail.assign(m_idle_gaps.end() - tail, m_idle_gaps.end());
+
+    m_checkpoints.push_back(std::move(c));
+}
+
+void Simulator::restore_checkpoint(const Checkpoint& c)
+{
+    // Restore copies so that the checkpoint can be restored again
+    JobCloneContext context;
+    m_step_count = c.step_count;
+    m_frame_count = c.frame_count;
+    m_request_start_count = c.request_start_count;
+    m_frames_in_flight = c.frames_in_flight;
+    m_last_present_time = c.last_present_time;
+    m_last_paced_frame = c.last_paced_frame;
+    m_limiter = c.limiter;
+    m_last_push_time = c.last_push_time;
+    m_max = c.max;
+
+    m_cores.clear();
+    for (const auto& core : c.cores) {
+        m_cores.push_back(context.core(core));
+    }
+    m_frames.clear();
+    for (const auto& f : c.frames) {
+        m_frames.push_back(context.frame(f));
+    }
+    m_job_queue.clear();
+    for (const auto& j : c.job_queue) {
+        m_job_queue.push_back(context.job(j));
+    }
+    m_frame_available.clear();
+    for (const auto& f : c.frame_available) {
+        m_frame_available.push_back(context.frame(f));
+    }
+
+    m_generator = c.generator;
+    m_distribution = c.distribution;
+    m_uniform_samples = c.uniform_samples;
+    m_next_uniform_sample = c.next_uniform_sample;
+    m_samplers = c.samplers;
+
+    m_core_busy_time = c.core_busy_time;
+    m_statistics = c.statistics;
+    m_utilization = c.utilization;
+    m_pacing_cpu_samples = c.pacing_cpu_samples;
+    m_pacing_gpu_samples = c.pacing_gpu_samples;
+
+    m_timeboxes.erase(m_timeboxes.begin() + c.timebox_count, m_timeboxes.end());
+    m_framerate.resize(c.framerate_count);
+    m_idle_gaps.resize(c.idle_gap_count - c.idle_gap_tail.size());
+    m_idle_gaps.insert(m_idle_gaps.end(), c.idle_gap_tail.begin(), c.idle_gap_tail.end());
+
+    m_critical_path = CriticalPathAnalysis();
+    m_critical_path_timebox_count = 0;
+    m_stalled = false;
+}
+
+bool Simulator::step_back(int count)
+{
+    return jump_to_step(std::max(0, m_step_count - count));
+}
+
+bool Simulator::jump_to_step(int step)
+{
+    if (step < m_step_count) {
+        auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), step, [](int s, const Checkpoint& c) {
+            return s < c.step_count;
+        });
+        if (it == m_checkpoints.begin()) {
+            return false;
+        }
+        restore_checkpoint(*(it - 1));
+    }
+
+    while (m_step_count < step) {
+        advance();
+    }
+    return true;
+}
+
+bool Simulator::jump_to_frame(int frame_index)
+{
+    if (frame_index < m_frame_count) {
+        auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), frame_index, [](int f, const Checkpoint& c) {
+            return f < c.frame_count;
+        });
+        if (it == m_checkpoints.begin()) {
+            return false;
+        }
+        restore_checkpoint(*(it - 1));
+    }
+
+    while (m_frame_count <= frame_index) {
+        advance();
+    }
+    return true;
+}
+
+std::string Simulator::lane_name(int lane) const
+{
+    // Frame time boxes are placed two lanes after the last core
+    if (lane < m_core_count) {
+        return "Core " + std::to_string(lane);
+    } else if (lane < m_core_count + m_gpu_queue_count) {
+        // A lane per queue up to the highest queue of the flow, used or not
+        const int queue = lane - m_core_count;
+        return queue == 0 ? std::string("GPU") : "Async " + std::to_string(queue);
+    } else if (lane < m_lane_count) {
+        return std::string("Display");
+    } else if (lane < m_lane_count + 2) {
+        return std::string();
+    }
+    return "Frame " + std::to_string(lane - m_lane_count - 2);
+}
+
+float Simulator::job_duration(int stage_index, int frame_index)
+{
+    // Replayed stages take the measured duration of the frame, shared by the jobs of the stage
+    int column = m_capture_columns[stage_index];
+    if (column >= 0) {
+        float duration = m_option.Capture->duration(column, frame_index) * m_option.VsyncPeriod / CaptureVsyncPeriodMs;
+        return duration / m_flow->stages[stage_index]->split_count;
+    }
+
+    const float duration = m_flow->stage_duration(stage_index) * sample(stage_index, frame_index);
+    return m_flow->stages[stage_index]->gpu ? duration : duration / m_option.CoreSpeed;
+}
+
 void Simulator::push_job(std::shared_ptr<Job> j)
 {
     m_job_queue.push_back(j);
@@ -726,9 +1288,21 @@ void Simulator::push_job(std::shared_ptr<Job> j)
 
 void Simulator::push_frame(std::shared_ptr<Frame> f)
 {
-    int frame_time_core_index = m_core_count + 2 + f->frame_index % m_frame_pool_size;
+    int frame_time_core_index = m_lane_count + 2 + f->frame_index % m_frame_pool_size;
 
-    m_framerate.push_back({ f->end_time, f->end_time - m_last_push_time });
+    m_framerate.push_back({ f->end_time, f->end_time - m_last_push_time, f->end_time - f->start_time });
+    if (m_frame_listener) {
+        m_frame_listener(f->frame_index, m_framerate.back());
+    }
+
+    // Frame time stops when the work is done, latency when it is displayed
+    float ready_time = f->ready_time >= 0.f ? f->ready_time : f->end_time;
+    float interval = f->end_time - m_last_push_time;
+    m_statistics.add_frame(interval, ready_time - f->start_time, f->end_time - f->start_time);
+    for (int i = 0; i < m_core_count; i++) {
+        m_statistics.add_core_busy_time(i, m_core_busy_time[i], interval);
+        m_core_busy_time[i] = 0.f;
+    }
 
     std::stringstream s;
     s << f->end_time - f->start_time;
@@ -739,12 +1313,156 @@ void Simulator::push_frame(std::shared_ptr<Frame> f)
 
     f->frame_index = -1;
     f->start_time = -1.f;
+    f->pending_gpu_stage = 0;
+    f->gpu_submitted = false;
+    f->cpu_done = false;
+    f->kick_ready_time = -1.f;
+    f->ready_time = -1.f;
+    f->gpu_time = 0.f;
     f->finished_stage.clear();
 }
 
-std::shared_ptr<Job> Simulator::pop_job()
+void Simulator::submit_gpu_stage(std::shared_ptr<Frame> f)
+{
+    if (!f->gpu_submitted) {
+        f->gpu_submitted = true;
+        m_frames_in_flight += 1;
+    }
+    f->pending_gpu_stage += 1;
+}
+
+void Simulator::finish_gpu_stage(std::shared_ptr<Frame> f)
+{
+    f->pending_gpu_stage -= 1;
+    assert(f->pending_gpu_stage >= 0);
+    if (f->pending_gpu_stage == 0 && f->cpu_done) {
+        push_job(std::make_shared<PresentJob>(this, f));
+    }
+}
+
+void Simulator::finish_cpu(std::shared_ptr<Frame> f)
+{
+    f->cpu_done = true;
+    if (f->pending_gpu_stage == 0) {
+        push_job(std::make_shared<PresentJob>(this, f));
+    }
+}
+
+void Simulator::present_frame(std::shared_ptr<Frame> f, float time)
+{
+    if (f->kick_ready_time >= 0.f) {
+        m_pacing_cpu_samples.push(f->kick_ready_time - f->start_time);
+        m_pacing_gpu_samples.push(f->gpu_time);
+    }
+
+    m_last_present_time = time;
+    m_frames_in_flight -= 1;
+    f->end_time = time;
+    push_frame(f);
+}
+
+float Simulator::next_present_time(float time) const
+{
+    // The limiter holds the present until its interval elapsed
+    if (m_option.Limiter != LimiterMode::Off && m_last_present_time >= 0.f) {
+        time = std::max(time, m_last_present_time + m_limiter.interval());
+    }
+
+    if (!m_option.Vsync) {
+        return time;
+    }
+
+    float period = m_option.VsyncPeriod;
+    float present = std::ceil(time / period) * period;
+    if (m_last_present_time >= 0.f) {
+        present = std::max(present, m_last_present_time + period);
+    }
+    return present;
+}
+
+void Simulator::update_limiter(float ready_time)
+{
+    if (m_last_present_time >= 0.f) {
+        m_limiter.update(ready_time - m_last_present_time);
+    }
+}
+
+float Simulator::paced_start_time(int frame_index, float time) const
+{
+    if (m_option.Pacing != PacingMode::JustInTime || m_pacing_cpu_samples.count() <= 0) {
+        return time;
+    }
+
+    float cpu_time = m_pacing_cpu_samples.predict(m_option.Prediction, false);
+    float gpu_time = m_pacing_gpu_samples.predict(m_option.Prediction, true);
+
+    // The graphics queue first executes the work already submitted
+    float gpu_available_time = time;
+    for (const auto& c : m_cores) {
+        if (c.lane == Lane::Gpu && c.queue == 0) {
+            gpu_available_time = std::max(gpu_available_time, c.time);
+        }
+    }
+    for (const auto& j : m_job_queue) {
+        if (j->lane() == Lane::Gpu && j->queue() == 0) {
+            gpu_available_time += j->duration();
+        }
+    }
+
+    // Then the frames started before this one
+    int ahead = 0;
+    for (const auto& f : m_frames) {
+        if (f->frame_index >= 0 && f->frame_index < frame_index && !f->gpu_submitted) {
+            ahead += 1;
+        }
+    }
+    gpu_available_time += ahead * gpu_time;
+
+    // The kick also waits for enough frames in flight to be presented
+    int present_count = m_frames_in_flight + ahead + 1 - m_option.MaxFramesInFlight;
+    if (m_option.Vsync && present_count > 0 && m_last_present_time >= 0.f) {
+        gpu_available_time = std::max(gpu_available_time, m_last_present_time + present_count * m_option.VsyncPeriod);
+    }
+
+    return std::max(time, gpu_available_time - cpu_time - m_option.PacingMargin);
+}
+
+PacingStatistics Simulator::compute_pacing_statistics() const
 {
-    assert(has_ready_job());
+    PacingStatistics stats;
+
+    // The first frame has no previous frame to measure an interval
+    for (size_t i = 1; i < m_framerate.size(); i++) {
+        stats.mean_latency += m_framerate[i].latency;
+        stats.max_latency = std::max(stats.max_latency, m_framerate[i].latency);
+        stats.mean_interval += m_framerate[i].duration;
+        stats.frame_count += 1;
+    }
+    if (stats.frame_count > 0) {
+        stats.mean_latency /= stats.frame_count;
+        stats.mean_interval /= stats.frame_count;
+    }
+    for (size_t i = 1; i < m_framerate.size(); i++) {
+        float delta = m_framerate[i].duration - stats.mean_interval;
+        stats.interval_variance += delta * delta / stats.frame_count;
+    }
+
+    return stats;
+}
+
+bool Simulator::has_job(const Core& core) const
+{
+    for (const auto& j : m_job_queue) {
+        if (core.accept(*j)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<Job> Simulator::pop_job(const Core& core, bool ready_only)
+{
+    assert(ready_only ? has_ready_job(core) : has_job(core));
 
     if (m_option.PriorityQueue) {
         std::stable_sort(m_job_queue.begin(), m_job_queue.end(), [](auto a, auto b) {
@@ -756,7 +1474,7 @@ std::shared_ptr<Job> Simulator::pop_job()
     int pos = -1;
     for (int i = 0; i < m_job_queue.size(); i++) {
         auto j = m_job_queue.at(i);
-        if (j->is_ready()) {
+        if (core.accept(*j) && (!ready_only || j->is_ready())) {
             job = j;
             pos = i;
             break;
@@ -789,6 +1507,25 @@ void PopDisabled(bool disabled)
 
 static int g_FreezeCount = 0;
 
+void Simulator::discard_results()
+{
+    m_timeboxes.clear();
+    m_framerate.clear();
+    m_idle_gaps.clear();
+    // The utilization adds up the discarded boxes and gaps
+    for (auto& u : m_utilization) {
+        u = CoreUtilization();
+    }
+    // Checkpoints hold the sizes of the results and a copy of the sampling state each
+    m_checkpoints.clear();
+    m_critical_path = CriticalPathAnalysis();
+    m_critical_path_timebox_count = 0;
+
+    // The state the run carries on with does not grow: a block of samples per sampler and a ring of pacing samples
+    assert(m_uniform_samples.size() == DurationSampler::BlockSize);
+    assert(m_pacing_cpu_samples.count() <= m_pacing_cpu_samples.capacity() && m_pacing_gpu_samples.count() <= m_pacing_gpu_samples.capacity());
+}
+
 void Simulator::freeze(const std::string& name)
 {
     m_frozen = true;
@@ -800,6 +1537,8 @@ void Simulator::freeze(const std::string& name)
 
 void DrawVisualizer()
 {
+    PROFILE_ZONE("DrawVisualizer");
+    AllocationScope allocations(AllocationTag::Ui);
     auto& app = App::get();
 
     if (App::get().ControlOption.Restart) {
@@ -813,15 +1552,31 @@ void DrawVisualizer()
             App::get().SimOption.Seed = (int)std::chrono::system_clock::now().time_since_epoch().count();
         }
         App::get().CurrentSimulation = std::make_shared<Simulator>(app.Flow, App::get().SimOption);
+        App::get().CurrentSimulation->set_checkpoint_interval(app.ControlOption.CheckpointInterval);
+
+        // Run the same simulation without pacing to compare against
+        App::get().PacingBaseline = nullptr;
+        if (App::get().SimOption.Pacing != PacingMode::Default) {
+            SimulationOption option = App::get().SimOption;
+            option.Pacing = PacingMode::Default;
+            App::get().PacingBaseline = std::make_shared<Simulator>(app.Flow, option);
+            App::get().PacingBaseline->set_checkpoint_interval(app.ControlOption.CheckpointInterval);
+        }
     }
 
     if (App::get().CurrentSimulation && App::get().ControlOption.Step || App::get().ControlOption.AutoStep) {
         if (app.ControlOption.AutoStep) {
             for (int i = 0; i <= App::get().ControlOption.MaxAutoStep; i++) {
                 app.CurrentSimulation->step(!App::get().ControlOption.Step);
+                if (app.PacingBaseline) {
+                    app.PacingBaseline->step(!App::get().ControlOption.Step);
+                }
             }
         } else {
             App::get().CurrentSimulation->step(!App::get().ControlOption.Step);
+            if (app.PacingBaseline) {
+                app.PacingBaseline->step(!App::get().ControlOption.Step);
+            }
         }
     }
 
@@ -831,6 +1586,9 @@ void DrawVisualizer()
         s->draw();
     }
 
+    draw_opened_trace_files(app.TraceFiles, app.DisplayOption.Scale * app.SimOption.VsyncPeriod, app.DisplayOption.Height);
+    draw_frame_diff(app.FrameDiff);
+
     ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_FirstUseEver);
     ImGui::SetNextWindowSize(ImVec2(300, 600), ImGuiCond_FirstUseEver);
     ImGui::Begin("Options");
@@ -868,6 +1626,317 @@ void DrawVisualizer()
         PopDisabled(!App::get().SimOption.AutoSeed);
         ImGui::Checkbox("Random Seed", &App::get().SimOption.AutoSeed);
         ImGui::Checkbox("Priority Queue", &App::get().SimOption.PriorityQueue);
+        ImGui::Checkbox("Vsync", &App::get().SimOption.Vsync);
+        ImGui::SliderFloat("Vsync Period", &App::get().SimOption.VsyncPeriod, 10.f, 500.f);
+        ImGui::SliderInt("Max Frames In Flight", &App::get().SimOption.MaxFramesInFlight, 1, 8);
+        ImGui::SliderFloat("Core Speed", &App::get().SimOption.CoreSpeed, 0.25f, 4.f);
+        ImGui::SliderFloat("Dispatch Overhead", &App::get().SimOption.DispatchOverhead, 0.f, 20.f);
+        ImGui::SliderFloat("Wakeup Latency", &App::get().SimOption.WakeupLatency, 0.f, 50.f);
+    }
+
+    if (ImGui::CollapsingHeader("Pacing")) {
+        const char* modes[] = { "Default", "Just In Time" };
+        int mode = static_cast<int>(App::get().SimOption.Pacing);
+        if (ImGui::Combo("Pacing Mode", &mode, modes, (int)array_size(modes))) {
+            App::get().SimOption.Pacing = static_cast<PacingMode>(mode);
+        }
+        const char* predictions[] = { "Last Frame", "Average", "Conservative" };
+        int prediction = static_cast<int>(App::get().SimOption.Prediction);
+        if (ImGui::Combo("Prediction", &prediction, predictions, (int)array_size(predictions))) {
+            App::get().SimOption.Prediction = static_cast<PacingPrediction>(prediction);
+        }
+        ImGui::SliderFloat("Safety Margin", &App::get().SimOption.PacingMargin, 0.f, 100.f);
+        ImGui::SliderInt("Prediction Sample Count", &App::get().SimOption.PacingSampleCount, 1, 64);
+
+        if (app.PacingBaseline) {
+            PacingStatistics paced = app.CurrentSimulation->compute_pacing_statistics();
+            PacingStatistics unpaced = app.PacingBaseline->compute_pacing_statistics();
+            ImGui::Columns(3, "pacing");
+            ImGui::NextColumn();
+            ImGui::Text("Default"); ImGui::NextColumn();
+            ImGui::Text("Paced"); ImGui::NextColumn();
+            ImGui::Text("Frames"); ImGui::NextColumn();
+            ImGui::Text("%d", unpaced.frame_count); ImGui::NextColumn();
+            ImGui::Text("%d", paced.frame_count); ImGui::NextColumn();
+            ImGui::Text("Mean Latency"); ImGui::NextColumn();
+            ImGui::Text("%.2f", unpaced.mean_latency); ImGui::NextColumn();
+            ImGui::Text("%.2f", paced.mean_latency); ImGui::NextColumn();
+            ImGui::Text("Max Latency"); ImGui::NextColumn();
+            ImGui::Text("%.2f", unpaced.max_latency); ImGui::NextColumn();
+            ImGui::Text("%.2f", paced.max_latency); ImGui::NextColumn();
+            ImGui::Text("Mean Interval"); ImGui::NextColumn();
+            ImGui::Text("%.2f", unpaced.mean_interval); ImGui::NextColumn();
+            ImGui::Text("%.2f", paced.mean_interval); ImGui::NextColumn();
+            ImGui::Columns(1);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Limiter")) {
+        const char* modes[] = { "Off", "Fixed Interval", "Vsync Divisor", "Adaptive" };
+        int mode = static_cast<int>(App::get().SimOption.Limiter);
+        if (ImGui::Combo("Limiter Mode", &mode, modes, (int)array_size(modes))) {
+            App::get().SimOption.Limiter = static_cast<LimiterMode>(mode);
+        }
+        ImGui::SliderFloat("Target Interval", &App::get().SimOption.LimiterInterval, 10.f, 500.f);
+        ImGui::SliderInt("Vsync Divisor", &App::get().SimOption.LimiterDivisor, 1, 4);
+        ImGui::SliderInt("Adaptive Miss Count", &App::get().SimOption.LimiterMissCount, 1, 16);
+
+        PacingStatistics stats = app.CurrentSimulation->compute_pacing_statistics();
+        ImGui::Text("Mean Latency: %.2f", stats.mean_latency);
+        ImGui::Text("Frame Interval: %.2f (std dev %.2f)", stats.mean_interval, std::sqrt(stats.interval_variance));
+    }
+
+    if (ImGui::CollapsingHeader("Statistics")) {
+        draw_frame_statistics(app.CurrentSimulation->get_statistics());
+    }
+
+    if (ImGui::CollapsingHeader("Utilization")) {
+        const auto& utilization = app.CurrentSimulation->get_utilization();
+        const int core_count = app.CurrentSimulation->core_count();
+
+        ImGui::Columns(2 + IdleCauseCount, "utilization");
+        ImGui::NextColumn();
+        ImGui::Text("Busy"); ImGui::NextColumn();
+        for (int c = 0; c < IdleCauseCount; c++) {
+            ImGui::TextColored(ImColor(IdleCauseColor(static_cast<IdleCause>(c))), "%s", idle_cause_name(static_cast<IdleCause>(c))); ImGui::NextColumn();
+        }
+        float cpu_idle_time[IdleCauseCount] = {};
+        for (int i = 0; i < (int)utilization.size(); i++) {
+            const CoreUtilization& u = utilization[i];
+            float total = std::max(u.total_time(), 1e-6f);
+            ImGui::Text("%s", app.CurrentSimulation->lane_name(i).c_str()); ImGui::NextColumn();
+            ImGui::Text("%d%%", (int)(u.busy_time / total * 100.f)); ImGui::NextColumn();
+            for (int c = 0; c < IdleCauseCount; c++) {
+                ImGui::Text("%d%%", (int)(u.idle_time[c] / total * 100.f)); ImGui::NextColumn();
+                if (i < core_count) {
+                    cpu_idle_time[c] += u.idle_time[c];
+                }
+            }
+        }
+        ImGui::Columns(1);
+
+        // One strip per core, split between busy time and each idle cause
+        auto drawlist = ImGui::GetWindowDrawList();
+        const float width = ImGui::GetContentRegionAvailWidth();
+        const float height = 8.f;
+        for (const auto& u : utilization) {
+            ImVec2 p = ImGui::GetCursorScreenPos();
+            float total = std::max(u.total_time(), 1e-6f);
+            float x = p.x + u.busy_time / total * width;
+            drawlist->AddRectFilled(p, ImVec2(x, p.y + height), g_Blue);
+            for (int c = 0; c < IdleCauseCount; c++) {
+                float next = x + u.idle_time[c] / total * width;
+                drawlist->AddRectFilled(ImVec2(x, p.y), ImVec2(next, p.y + height), IdleCauseColor(static_cast<IdleCause>(c)));
+                x = next;
+            }
+            ImGui::Dummy(ImVec2(width, height + 2.f));
+        }
+
+        // Suggest a change of the flow from the main cause of cpu idle time
+        int main_cause = 0;
+        for (int c = 1; c < IdleCauseCount; c++) {
+            if (cpu_idle_time[c] > cpu_idle_time[main_cause]) {
+                main_cause = c;
+            }
+        }
+        const char* advices[] = {
+            "split the stages to expose more parallelism",
+            "cut the waits between frames",
+            "increase the frame pool size",
+            "increase the max frames in flight",
+            "reduce the pacing safety margin",
+            "merge the shortest jobs so that fewer are dispatched",
+        };
+        if (cpu_idle_time[main_cause] > 0.f) {
+            ImGui::TextWrapped("Cpu mostly idles on %s: %s.", idle_cause_name(static_cast<IdleCause>(main_cause)), advices[main_cause]);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Capture")) {
+        if (draw_capture_import(app.CaptureImport)) {
+            App::get().SimOption.Capture = app.CaptureImport.capture;
+        }
+        ImGui::Checkbox("Replay Capture", &App::get().SimOption.Replay);
+        if (app.CaptureImport.capture) {
+            const auto& stages = app.Flow->stages;
+            for (const auto& s : stages) {
+                bool replayed = app.CaptureImport.capture->find_column(s->name) >= 0;
+                ImGui::Text("%s: %s", s->name, replayed ? "replayed" : "simulated");
+            }
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Export")) {
+        if (ImGui::Button("Export Chrome Trace")) {
+            export_trace(*app.CurrentSimulation, TraceFormat::ChromeJson, std::string("timeline") + trace_extension(TraceFormat::ChromeJson));
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export Perfetto Trace")) {
+            export_trace(*app.CurrentSimulation, TraceFormat::Perfetto, std::string("timeline") + trace_extension(TraceFormat::Perfetto));
+        }
+        draw_trace_file_controls(app.TraceFiles, [&](const std::string& path, std::string& error) {
+            return save_trace_file(*app.CurrentSimulation, path, error);
+        });
+    }
+
+    if (ImGui::CollapsingHeader("Compare")) {
+        std::vector<FrameDiffSource> sources;
+        auto current = app.CurrentSimulation;
+        sources.push_back({ "Current", [current]() { return summarize_frames(*current, "Current"); } });
+        for (const auto& s : app.FrozenSimulations) {
+            sources.push_back({ s->get_name(), [s]() { return summarize_frames(*s, s->get_name()); } });
+        }
+        for (const auto& t : app.TraceFiles.opened) {
+            sources.push_back({ t->path(), [t]() { return summarize_frames(*t, t->path()); } });
+        }
+        draw_frame_diff_controls(app.FrameDiff, sources);
+    }
+
+    if (ImGui::CollapsingHeader("Golden Traces")) {
+        draw_golden_traces(app.GoldenTraces, app.Flows);
+    }
+
+    if (ImGui::CollapsingHeader("Ensemble")) {
+        EnsembleOption& ensemble = App::get().EnsembleOption;
+        ImGui::SliderInt("Run Count", &ensemble.RunCount, 1, 1024);
+        ImGui::SliderInt("Thread Count (0 = auto)", &ensemble.ThreadCount, 0, 64);
+        ImGui::SliderInt("Frames Per Run", &ensemble.FrameCount, 10, 5000);
+        ImGui::SliderInt("Warmup Frames", &ensemble.WarmupFrameCount, 0, 100);
+
+        if (app.EnsembleRun.valid()) {
+            if (app.EnsembleRun.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                app.Ensemble = std::make_shared<EnsembleReport>(app.EnsembleRun.get());
+            } else {
+                ImGui::Text("Running %d runs...", ensemble.RunCount);
+            }
+        } else if (ImGui::Button("Run Ensemble")) {
+            app.EnsembleRun = start_ensemble(app.Flow, App::get().SimOption, ensemble);
+        }
+
+        if (app.Ensemble) {
+            const EnsembleReport& report = *app.Ensemble;
+            ImGui::SameLine();
+            if (ImGui::Button("Copy Report")) {
+                ImGui::SetClipboardText(report.to_json().c_str());
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Save Report")) {
+                std::ofstream file("ensemble_report.json");
+                file << report.to_json();
+            }
+
+            ImGui::Text("%s: %d runs, %d frames (%.0f ms on %d threads)", report.flow_name.c_str(), report.run_count, report.frame_count, report.duration_ms, report.thread_count);
+            if (report.has_missed_vsync) {
+                ImGui::Text("Missed Vsync: %.2f%% [%.2f, %.2f]", report.missed_vsync_rate.value * 100.f, report.missed_vsync_rate.low * 100.f, report.missed_vsync_rate.high * 100.f);
+            }
+
+            auto show_estimate = [](const PercentileEstimate& e) {
+                ImGui::Text("%.1f [%.1f, %.1f]", e.value, e.low, e.high); ImGui::NextColumn();
+            };
+            auto show_metric = [&](const char* name, const EnsembleMetric& m) {
+                ImGui::Text("%s", name); ImGui::NextColumn();
+                ImGui::Text("%.1f", m.mean); ImGui::NextColumn();
+                show_estimate(m.p50);
+                show_estimate(m.p90);
+                show_estimate(m.p99);
+                show_estimate(m.p999);
+            };
+            ImGui::Columns(6, "ensemble");
+            ImGui::NextColumn();
+            ImGui::Text("Mean"); ImGui::NextColumn();
+            ImGui::Text("p50"); ImGui::NextColumn();
+            ImGui::Text("p90"); ImGui::NextColumn();
+            ImGui::Text("p99"); ImGui::NextColumn();
+            ImGui::Text("p99.9"); ImGui::NextColumn();
+            show_metric("Frame Time", report.frame_time);
+            show_metric("Latency", report.latency);
+            ImGui::Columns(1);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Execution")) {
+        ExecutionOption& execution = App::get().ExecutionOption;
+        ImGui::SliderInt("Frames", &execution.FrameCount, 1, 1000);
+        ImGui::DragFloat("Vsync (ms)", &execution.VsyncMs, 0.1f, 1.f, 100.f);
+        ImGui::Checkbox("Pin Threads", &execution.PinThreads);
+        const char* wait_modes[] = { wait_mode_name(WaitMode::Queue), wait_mode_name(WaitMode::Block), wait_mode_name(WaitMode::Fiber) };
+        int wait_mode = static_cast<int>(execution.Wait);
+        if (ImGui::Combo("Wait", &wait_mode, wait_modes, 3)) {
+            execution.Wait = static_cast<WaitMode>(wait_mode);
+        }
+        ImGui::TextWrapped("Runs the flow on real threads, the ui waits until it is done");
+
+        if (ImGui::Button("Run On Threads")) {
+            app.Execution = std::make_shared<ExecutionReport>(run_execution(app.Flow, App::get().SimOption, execution));
+            app.ExecutionByWait[app.Execution->wait] = app.Execution;
+            app.FrozenSimulations.insert(app.Execution->timeline);
+        }
+
+        if (app.Execution) {
+            const ExecutionReport& report = *app.Execution;
+            ImGui::Text("%d frames in %.0f ms on %d threads (%d pinned)%s", report.frame_count, report.duration_ms, report.thread_count, report.pinned_thread_count, report.timed_out ? ", timed out" : "");
+            ImGui::Text("Kernel: %.0f iterations/us", report.iterations_per_us);
+            ImGui::Text("Job overrun: mean %.2f, max %.2f", report.mean_overrun, report.max_overrun);
+            ImGui::Text("%s wait, cores busy %.0f%% of the run", wait_mode_name(report.wait), report.cpu_utilization * 100.f);
+            if (report.wait == WaitMode::Fiber) {
+                // What one wait costs a job of the smallest size worth jobifying
+                ImGui::Text("Wait on a counter: %.0f ns, %.2f%% of a 10 us job", report.fiber_wait_ns, report.fiber_wait_ns / 100.f);
+            }
+            if (!report.stall.empty()) {
+                ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "Stalled:\n%s", report.stall.c_str());
+            }
+
+            // Fit the machine model of the simulation to the measured run
+            CalibrationOption& calibration = App::get().CalibrationOption;
+            ImGui::SliderInt("Calibration Rounds", &calibration.RoundCount, 1, 10);
+            ImGui::SliderInt("Candidates", &calibration.CandidateCount, 3, 33);
+            ImGui::SliderInt("Seeds", &calibration.SeedCount, 1, 32);
+            if (ImGui::Button("Calibrate")) {
+                FrameSummary measured = summarize_frames(*report.timeline, report.timeline->get_name());
+                app.Calibration = std::make_shared<CalibrationReport>(run_calibration(app.Flow, App::get().SimOption, measured, calibration));
+            }
+        }
+
+        if (app.Calibration) {
+            const CalibrationReport& report = *app.Calibration;
+            ImGui::Text("%s against %s", report.flow_name.c_str(), report.measured_name.c_str());
+            ImGui::Text("Error per frame: %.3f -> %.3f vsync, %d simulations in %.0f ms", report.initial_error, report.error, report.evaluation_count, report.duration_ms);
+            for (const auto& p : report.parameters) {
+                ImGui::BulletText("%s: %.3f -> %.3f", p.name.c_str(), p.initial, p.value);
+            }
+            if (ImGui::Button("Apply Calibration")) {
+                App::get().SimOption = report.option;
+            }
+        }
+
+        // Last run of each wait mode, to compare them on the same flow
+        if (app.ExecutionByWait.size() > 1) {
+            const char* headers[] = { "Wait", "Core Use", "ms/Frame", "Overrun", "Fibers", "Switch ns", "Wait ns" };
+            ImGui::Columns(7, "ExecutionByWait");
+            for (const char* h : headers) {
+                ImGui::Text("%s", h);
+                ImGui::NextColumn();
+            }
+            ImGui::Separator();
+            for (const auto& run : app.ExecutionByWait) {
+                const ExecutionReport& report = *run.second;
+                ImGui::Text("%s", wait_mode_name(run.first));
+                ImGui::NextColumn();
+                ImGui::Text("%.0f%%", report.cpu_utilization * 100.f);
+                ImGui::NextColumn();
+                ImGui::Text("%.2f", report.frame_count > 0 ? report.duration_ms / report.frame_count : 0.f);
+                ImGui::NextColumn();
+                ImGui::Text("%.2f", report.mean_overrun);
+                ImGui::NextColumn();
+                ImGui::Text("%d", report.fiber_count);
+                ImGui::NextColumn();
+                ImGui::Text(report.wait == WaitMode::Fiber ? "%.0f" : "-", report.fiber_switch_ns);
+                ImGui::NextColumn();
+                ImGui::Text(report.wait == WaitMode::Fiber ? "%.0f" : "-", report.fiber_wait_ns);
+                ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+        }
     }
 
     if (ImGui::CollapsingHeader("Control", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -894,6 +1963,46 @@ void DrawVisualizer()
         ImGui::SameLine();
         ImGui::Checkbox("Auto Step", &App::get().ControlOption.AutoStep);
         ImGui::InputInt("Max Auto Step", &App::get().ControlOption.MaxAutoStep);
+
+        ControlOption& control = App::get().ControlOption;
+        if (ImGui::InputInt("Checkpoint Interval", &control.CheckpointInterval)) {
+            control.CheckpointInterval = std::max(0, control.CheckpointInterval);
+            app.CurrentSimulation->set_checkpoint_interval(control.CheckpointInterval);
+            if (app.PacingBaseline) {
+                app.PacingBaseline->set_checkpoint_interval(control.CheckpointInterval);
+            }
+        }
+
+        // Moving in time stops the auto step, which would run the simulation up to the max again
+        auto rewind = [&](auto move) {
+            control.AutoStep = false;
+            bool moved = move(*app.CurrentSimulation);
+            if (app.PacingBaseline) {
+                move(*app.PacingBaseline);
+            }
+            return moved;
+        };
+
+        static bool s_rewindFailed = false;
+        ImGui::InputInt("Step Count", &control.StepBackCount);
+        ImGui::SameLine();
+        if (ImGui::Button("Step Back")) {
+            s_rewindFailed = !rewind([&](Simulator& s) { return s.step_back(std::max(0, control.StepBackCount)); });
+        }
+        ImGui::InputInt("Step", &control.TargetStep);
+        ImGui::SameLine();
+        if (ImGui::Button("Jump To Step")) {
+            s_rewindFailed = !rewind([&](Simulator& s) { return s.jump_to_step(std::max(0, control.TargetStep)); });
+        }
+        ImGui::InputInt("Frame", &control.TargetFrame);
+        ImGui::SameLine();
+        if (ImGui::Button("Jump To Frame")) {
+            s_rewindFailed = !rewind([&](Simulator& s) { return s.jump_to_frame(std::max(0, control.TargetFrame)); });
+        }
+        ImGui::Text("Step %d, %d checkpoints", app.CurrentSimulation->step_count(), (int)app.CurrentSimulation->checkpoint_count());
+        if (s_rewindFailed) {
+            ImGui::TextWrapped("No checkpoint before the target, enable checkpoints and restart");
+        }
     }
 
     if (ImGui::CollapsingHeader("Display")) {
@@ -901,6 +2010,7 @@ void DrawVisualizer()
         ImGui::Checkbox("Show Frame Time", &App::get().DisplayOption.ShowFrameTime);
         ImGui::Checkbox("Show Core Time", &App::get().DisplayOption.ShowCoreTime);
         ImGui::Checkbox("Show Frame Pool", &App::get().DisplayOption.ShowFramePool);
+        ImGui::Checkbox("Show Idle Gaps", &App::get().DisplayOption.ShowIdleGaps);
         ImGui::SliderFloat("Height", &App::get().DisplayOption.Height, 5.f, 40.f);
 
         float scale = App::get().DisplayOption.Scale / ConstantScale;
@@ -908,8 +2018,41 @@ void DrawVisualizer()
         App::get().DisplayOption.Scale = scale * ConstantScale;
     }
 
+    if (ImGui::CollapsingHeader("Critical Path")) {
+        if (ImGui::Button("Analyze Now")) {
+            app.CurrentSimulation->update_critical_path();
+        }
+        ImGui::SameLine();
+        ImGui::Text("Analyzed at step %d, updated when the simulation pauses", app.CurrentSimulation->critical_path_step_count());
+        const CriticalPathAnalysis& cp = App::get().CurrentSimulation->get_critical_path();
+        ImGui::Text("Span: %.2f, Work: %.2f", cp.span, cp.work);
+        ImGui::Text("Frame Time Bounds: [%.2f, %.2f]", cp.lower_bound, cp.upper_bound);
+        ImGui::Text("Frame Interval Bound: %.2f", cp.interval_bound);
+        ImGui::Text("Mean Frame Time: %.2f (%d frames)", cp.mean_frame_time, cp.frame_count);
+        ImGui::Text("Critical Path: %d stages, %.2f", (int)cp.critical_path.size(), cp.critical_path_work);
+        ImGui::Columns(4, "slack");
+        ImGui::Text("Stage"); ImGui::NextColumn();
+        ImGui::Text("Min Slack"); ImGui::NextColumn();
+        ImGui::Text("Mean Slack"); ImGui::NextColumn();
+        ImGui::Text("Critical"); ImGui::NextColumn();
+        const auto& stages = app.CurrentSimulation->get_flow()->stages;
+        for (size_t i = 0; i < cp.stage_critical_ratio.size() && i < stages.size(); i++) {
+            ImU32 color = cp.is_critical_stage((int)i) ? g_Magenta : ImGui::GetColorU32(ImGuiCol_Text);
+            ImGui::PushStyleColor(ImGuiCol_Text, color);
+            ImGui::Text("%s", stages[i]->name); ImGui::NextColumn();
+            ImGui::Text("%.2f", cp.stage_min_slack[i]); ImGui::NextColumn();
+            ImGui::Text("%.2f", cp.stage_mean_slack[i]); ImGui::NextColumn();
+            ImGui::Text("%d%%", (int)(cp.stage_critical_ratio[i] * 100.f)); ImGui::NextColumn();
+            ImGui::PopStyleColor();
+        }
+        ImGui::Columns(1);
+    }
+
     ImGui::Separator();
     ImGui::Text("Step #%d", App::get().CurrentSimulation->step_count());
+    if (App::get().CurrentSimulation->is_stalled()) {
+        ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "Stalled: no core can execute or complete a job");
+    }
     ImGui::Text("Rendered Count %d", App::get().CurrentSimulation->visible_timebox_count());
     ImGui::Text("Job Queue:");
     for (auto& j : App::get().CurrentSimulation->get_queue()) {
@@ -919,6 +2062,25 @@ void DrawVisualizer()
     ImGui::End();
 }
 
+void Simulator::DrawIdleGaps(ImVec2 origin)
+{
+    auto drawList = ImGui::GetWindowDrawList();
+    auto win = ImGui::GetWindowPos();
+    const float scale = App::get().DisplayOption.Scale;
+    const float height = App::get().DisplayOption.Height;
+    const float windowMin = ImGui::GetScrollX();
+    const float windowMax = windowMin + ImGui::GetWindowSize().x;
+
+    for (const auto& gap : m_idle_gaps) {
+        if (gap.start * scale > windowMax || gap.end * scale < windowMin) {
+            continue;
+        }
+        auto p0 = win + origin + ImVec2(gap.start * scale, (gap.core_index + 1) * height - 3.f);
+        auto p1 = win + origin + ImVec2(gap.end * scale, (gap.core_index + 1) * height);
+        drawList->AddRectFilled(p0, p1, IdleCauseColor(gap.cause));
+    }
+}
+
 void Simulator::DrawCore(ImVec2 origin)
 {
     auto drawList = ImGui::GetWindowDrawList();
@@ -940,9 +2102,28 @@ const Preset& get_default_preset()
     return *g_Presets[0];
 }
 
+int get_preset_count()
+{
+    return (int)array_size(g_Presets);
+}
+
+const Preset& get_preset(int index)
+{
+    return *g_Presets[index];
+}
+
 float TimeBox::start() const { return start_time * App::get().DisplayOption.Scale; }
 float TimeBox::end() const { return end_time * App::get().DisplayOption.Scale; }
 
+void Simulator::update_critical_path()
+{
+    if (m_critical_path_timebox_count != m_timeboxes.size()) {
+        m_critical_path = analyze_critical_path(*m_flow, m_option, m_timeboxes);
+        m_critical_path_timebox_count = m_timeboxes.size();
+        m_critical_path_step_count = m_step_count;
+    }
+}
+
 const std::deque<std::shared_ptr<Job>>& Simulator::get_queue()
 {
 
@@ -5,16 +5,24 @@
 #include <string>
 #include <sstream>
 #include <deque>
+#include <functional>
 #include <vector>
 #include <memory>
 #include <atomic>
 #include <random>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "imgui.h"
 #include "imgui_internal.h"
 
 #include "node_editor.h"
+#include "critical_path.h"
+#include "pacing.h"
+#include "distribution.h"
+#include "statistics.h"
+#include "capture.h"
+#include "job_system.h"
 
 constexpr float ConstantScale = 10.f;
 constexpr float DefaultMaxRandom = 2.f;
@@ -29,6 +37,25 @@ struct SimulationOption
     int Seed = 0;
     bool AutoSeed = false;
     bool PriorityQueue = false;
+    bool Vsync = true;
+    float VsyncPeriod = 100.f;
+    int MaxFramesInFlight = 2;
+    PacingMode Pacing = PacingMode::Default;
+    PacingPrediction Prediction = PacingPrediction::Average;
+    float PacingMargin = 10.f;
+    int PacingSampleCount = 8;
+    LimiterMode Limiter = LimiterMode::Off;
+    float LimiterInterval = 200.f;
+    int LimiterDivisor = 2;
+    int LimiterMissCount = 4;
+    bool Replay = false;
+    std::shared_ptr<const FrameCapture> Capture;
+    // Machine model, the defaults are an ideal machine. Durations of the cpu jobs
+    // are divided by the speed, the overhead precedes each cpu job and the wakeup
+    // latency each cpu job of a core which was idle
+    float CoreSpeed = 1.f;
+    float DispatchOverhead = 0.f;
+    float WakeupLatency = 0.f;
 
     bool operator==(const SimulationOption& other)
     {
@@ -36,7 +63,23 @@ struct SimulationOption
             && FramePoolSize == other.FramePoolSize
             && Random == other.Random
             && Seed == other.Seed
-            && AutoSeed == other.AutoSeed;
+            && AutoSeed == other.AutoSeed
+            && Vsync == other.Vsync
+            && VsyncPeriod == other.VsyncPeriod
+            && MaxFramesInFlight == other.MaxFramesInFlight
+            && Pacing == other.Pacing
+            && Prediction == other.Prediction
+            && PacingMargin == other.PacingMargin
+            && PacingSampleCount == other.PacingSampleCount
+            && Limiter == other.Limiter
+            && LimiterInterval == other.LimiterInterval
+            && LimiterDivisor == other.LimiterDivisor
+            && LimiterMissCount == other.LimiterMissCount
+            && Replay == other.Replay
+            && Capture == other.Capture
+            && CoreSpeed == other.CoreSpeed
+            && DispatchOverhead == other.DispatchOverhead
+            && WakeupLatency == other.WakeupLatency;
     }
 
     bool operator!=(const SimulationOption& other)
@@ -61,6 +104,10 @@ struct ControlOption
     bool AutoStep = true;
     int MaxAutoStep = 1000;
     bool Step;
+    int CheckpointInterval = 1000;
+    int StepBackCount = 100;
+    int TargetStep = 0;
+    int TargetFrame = 0;
 };
 
 struct DisplayOption
@@ -69,19 +116,64 @@ struct DisplayOption
     bool ShowFrameRate = true;
     bool ShowCoreTime = true;
     bool ShowFramePool = true;
+    bool ShowIdleGaps = true;
     float Height = 20.f;
     float Scale = 1.f * ConstantScale;
 };
 
 class Job;
 
+enum class Lane
+{
+    Cpu,
+    Gpu,
+    Display,
+};
+
 struct Core
 {
     int index;
     float time = 0.f;
+    Lane lane = Lane::Cpu;
+    int queue = 0;
     std::shared_ptr<Job> current_job;
+    // The core waited for a job since its last one
+    bool idle = false;
 
     bool try_exec();
+    bool accept(const Job& job) const;
+};
+
+// Why a core had nothing to execute
+enum class IdleCause
+{
+    NoReadyJob,
+    WaitTag,
+    FramePool,
+    FramesInFlight,
+    Pacing,
+    // The dispatch overhead and the wakeup latency before a job starts
+    Dispatch,
+};
+
+constexpr int IdleCauseCount = 6;
+
+const char* idle_cause_name(IdleCause cause);
+
+struct IdleGap
+{
+    int core_index;
+    float start;
+    float end;
+    IdleCause cause;
+};
+
+struct CoreUtilization
+{
+    float busy_time = 0.f;
+    float idle_time[IdleCauseCount] = {};
+
+    float total_time() const;
 };
 
 enum class TimeBoxType
@@ -95,8 +187,10 @@ enum class TimeBoxType
 
 struct TimeBox
 {
-    TimeBox(int index, int frame, float start, float end, const std::string& n, uint32_t c, TimeBoxType t)
+    TimeBox(int index, int frame, float start, float end, const std::string& n, uint32_t c, TimeBoxType t, int stage = -1)
         : core_index(index)
+        , frame(frame)
+        , stage(stage)
         , start_time(start)
         , end_time(end)
         , name(n)
@@ -112,6 +206,8 @@ struct TimeBox
     }
 
     int core_index;
+    int frame;
+    int stage;
     std::string frame_index;
     std::string name;
     uint32_t color;
@@ -119,6 +215,8 @@ struct TimeBox
 
     float start() const;
     float end() const;
+    float raw_start() const { return start_time; }
+    float raw_end() const { return end_time; }
 private:
     float end_time;
     float start_time;
@@ -132,9 +230,31 @@ struct Frame
     float start_time = -1.f;
     float end_time = -1.f;
 
+    int pending_gpu_stage = 0;
+    bool gpu_submitted = false;
+    bool cpu_done = false;
+
+    float kick_ready_time = -1.f;
+    float ready_time = -1.f;
+    float gpu_time = 0.f;
+
     std::unordered_map<int, int> finished_stage;
 };
 
+// Copies of the frames, split counters and jobs reached from a simulator state,
+// a frame or counter shared by several jobs is shared by their copies
+struct JobCloneContext
+{
+    std::shared_ptr<Frame> frame(const std::shared_ptr<Frame>& f);
+    std::shared_ptr<DependencyCounter> counter(const std::shared_ptr<DependencyCounter>& c);
+    std::shared_ptr<Job> job(const std::shared_ptr<Job>& j);
+    Core core(const Core& c);
+
+    std::unordered_map<const Frame*, std::shared_ptr<Frame>> frames;
+    std::unordered_map<const DependencyCounter*, std::shared_ptr<DependencyCounter>> counters;
+    std::unordered_map<const Job*, std::shared_ptr<Job>> jobs;
+};
+
 class Job
 {
 public:
@@ -152,8 +272,12 @@ public:
     virtual bool is_ready() const = 0;
     virtual void before_schedule(float time) = 0;
     virtual const char* name() const = 0;
+    virtual int stage_index() const = 0;
+    virtual Lane lane() const = 0;
+    virtual int queue() const = 0;
     virtual bool is_first() const = 0;
     virtual bool is_release() const = 0;
+    virtual std::shared_ptr<Job> clone(JobCloneContext& context) const = 0;
 protected:
     Simulator* m_simulator;
     std::shared_ptr<Frame> m_frame;
@@ -166,24 +290,56 @@ struct FrameRate
 {
     float timestamp;
     float duration;
+    float latency;
+};
+
+struct PacingStatistics
+{
+    int frame_count = 0;
+    float mean_latency = 0.f;
+    float max_latency = 0.f;
+    float mean_interval = 0.f;
+    float interval_variance = 0.f;
 };
 
 class Simulator
 {
 public:
+    // Steps a run without the ui allows per frame it waits for, a flow which presents no frame ends
+    static constexpr int MaxStepsPerFrame = 1000;
+
     Simulator(std::shared_ptr<FrameFlow> flow, const SimulationOption& option);
 
     void step(bool autostep);
+    // Steps until count more frames are presented, at most max_steps_per_frame steps per frame,
+    // and stops early on a stall. discard_results is called after each step when discard is set.
+    // Returns the frames presented.
+    int run_frames(int count, int max_steps_per_frame = MaxStepsPerFrame, bool discard = false);
+    // Steps count times unless the simulation stalls
+    void run_steps(int count);
     void draw();
 
     const std::vector<TimeBox>& get_timeboxes() const { return m_timeboxes; }
     const std::vector<FrameRate>& get_framerates() const { return m_framerate; }
+    // Latest end time and lane count of the timeboxes, draw() scales them with the display options
     const ImVec2& get_max() const { return m_max; }
     const std::deque<std::shared_ptr<Job>>& get_queue();
+    const std::shared_ptr<FrameFlow>& get_flow() const { return m_flow; }
+    const SimulationOption& get_option() const { return m_option; }
+    const FrameLimiter<float>& get_limiter() const { return m_limiter; }
+    const std::string& get_name() const { return m_name; }
+    // The last analysis, redone by draw once the simulation stopped stepping
+    const CriticalPathAnalysis& get_critical_path() const { return m_critical_path; }
+    // Analyzes the whole timeline again when boxes were added since the last analysis
+    void update_critical_path();
+    int critical_path_step_count() const { return m_critical_path_step_count; }
 
     bool frame_pool_empty() const { return m_frame_available.empty(); }
+    bool gpu_queue_full() const { return m_frames_in_flight >= m_option.MaxFramesInFlight; }
 
     float generate();
+    float sample(int stage_index, int frame_index);
+    float job_duration(int stage_index, int frame_index);
 
     std::shared_ptr<Frame> start_frame(float time);
 
@@ -191,17 +347,32 @@ public:
 
     void push_frame(std::shared_ptr<Frame> f);
 
+    void submit_gpu_stage(std::shared_ptr<Frame> f);
+    void finish_gpu_stage(std::shared_ptr<Frame> f);
+    void finish_cpu(std::shared_ptr<Frame> f);
+    void present_frame(std::shared_ptr<Frame> f, float time);
+    float next_present_time(float time) const;
+    void update_limiter(float ready_time);
+    float paced_start_time(int frame_index, float time) const;
+    PacingStatistics compute_pacing_statistics() const;
+    const FrameStatistics& get_statistics() const { return m_statistics; }
+    const std::vector<CoreUtilization>& get_utilization() const { return m_utilization; }
+    const std::vector<IdleGap>& get_idle_gaps() const { return m_idle_gaps; }
+
     std::shared_ptr<Frame> get_frame(int index);
 
-    std::shared_ptr<Job> pop_job();
+    // The first job the core accepts, only among the ready jobs unless ready_only is false
+    std::shared_ptr<Job> pop_job(const Core& core, bool ready_only = true);
+    bool has_job(const Core& core) const;
 
     void DrawCore(ImVec2 origin);
+    void DrawIdleGaps(ImVec2 origin);
 
-    bool has_ready_job() {
+    bool has_ready_job(const Core& core) {
 
         for (auto j : m_job_queue)
         {
-            if (j->is_ready())
+            if (core.accept(*j) && j->is_ready())
             {
                 return true;
             }
@@ -212,24 +383,117 @@ public:
 
     int visible_timebox_count() const { return m_diplayed_timebox; }
     int step_count() const { return m_step_count; }
+    int core_count() const { return m_core_count; }
+    std::string lane_name(int lane) const;
+    // No core could execute or complete a job, stepping does nothing anymore
+    bool is_stalled() const { return m_stalled; }
 
     void freeze(const std::string&name);
 
     void request_start() { m_request_start_count += 1; }
+    // Starts one of the requested frames when the pool has a frame available
+    bool start_requested_frame();
+    // Adds the box of a job executed on the core to the timeline
+    void record_timebox(const Core& core, const Job& job, float start, float duration);
+    void set_name(const std::string& name) { m_name = name; }
+
+    // The frame may already be back in the pool, frame_index is the index it had
+    void finish_stage(std::shared_ptr<Frame> f, int frame_index, int stage_tag);
+    // Called each time the last job of a stage completes
+    void set_stage_listener(std::function<void(int frame_index, int stage_tag)> listener) { m_stage_listener = listener; }
+    // Called each time a frame is presented, with the index it had
+    void set_frame_listener(std::function<void(int frame_index, const FrameRate& rate)> listener) { m_frame_listener = listener; }
+    // Forget the time boxes, frame rates, idle gaps, utilization and checkpoints recorded so far,
+    // so that a run streamed through the listeners keeps a bounded memory
+    void discard_results();
+
+    // A checkpoint is saved every interval steps, 0 disables them
+    void set_checkpoint_interval(int interval) { m_checkpoint_interval = interval; }
+    size_t checkpoint_count() const { return m_checkpoints.size(); }
+
+    // Restore the nearest checkpoint before the target then simulate up to it,
+    // these return false when no checkpoint is early enough
+    bool step_back(int count);
+    bool jump_to_step(int step);
+    // Stop once frame_index has started
+    bool jump_to_frame(int frame_index);
 
 private:
+    struct Checkpoint
+    {
+        int step_count;
+        int frame_count;
+        int request_start_count;
+        int frames_in_flight;
+        float last_present_time;
+        int last_paced_frame;
+        FrameLimiter<float> limiter;
+        float last_push_time;
+        ImVec2 max;
+
+        std::vector<Core> cores;
+        std::vector<std::shared_ptr<Frame>> frames;
+        std::deque<std::shared_ptr<Job>> job_queue;
+        std::deque<std::shared_ptr<Frame>> frame_available;
+
+        std::mt19937 generator;
+        std::uniform_real_distribution<float> distribution;
+        std::vector<float> uniform_samples;
+        size_t next_uniform_sample;
+        std::vector<DurationSampler> samplers;
+
+        std::vector<float> core_busy_time;
+        FrameStatistics statistics;
+        std::vector<CoreUtilization> utilization;
+        PacingSamples<float> pacing_cpu_samples;
+        PacingSamples<float> pacing_gpu_samples;
+
+        // The timeline and the other logs only grow, their length is enough to restore them
+        size_t timebox_count;
+        size_t framerate_count;
+        size_t idle_gap_count;
+        // Except the last gaps, which can still be extended
+        std::vector<IdleGap> idle_gap_tail;
+    };
+
+    void advance();
+    void save_checkpoint();
+    void restore_checkpoint(const Checkpoint& c);
+
+    IdleCause idle_cause(const Core& core) const;
+    void add_idle_gap(const Core& core, float end, IdleCause cause);
+
     int m_core_count;
+    int m_gpu_queue_count;
+    int m_lane_count;
     int m_frame_pool_size;
     int m_frame_count;
+    int m_frames_in_flight = 0;
+    float m_last_present_time = -1.f;
+    int m_last_paced_frame = -1;
+    FrameLimiter<float> m_limiter;
+    PacingSamples<float> m_pacing_cpu_samples;
+    PacingSamples<float> m_pacing_gpu_samples;
+    std::vector<float> m_core_busy_time;
+    FrameStatistics m_statistics;
+    std::vector<CoreUtilization> m_utilization;
+    std::vector<IdleGap> m_idle_gaps;
 
     ImVec2 m_max;
 
     std::shared_ptr<FrameFlow> m_flow;
     float m_critical_path_time;
+    float m_lower_bound;
+
+    CriticalPathAnalysis m_critical_path;
+    size_t m_critical_path_timebox_count = 0;
+    int m_critical_path_step_count = 0;
+    int m_drawn_step_count = -1;
 
     float m_last_push_time = 0.f;
     int m_diplayed_timebox = 0;
     bool m_frozen = false;
+    bool m_stalled = false;
 
 
     int m_request_start_count = 0;
@@ -239,6 +503,10 @@ private:
 
     std::mt19937 m_generator;
     std::uniform_real_distribution<float> m_distribution;
+    std::vector<float> m_uniform_samples;
+    size_t m_next_uniform_sample;
+    std::vector<DurationSampler> m_samplers;
+    std::vector<int> m_capture_columns;
 
     std::vector<Core> m_cores;
     std::vector<std::shared_ptr<Frame>> m_frames;
@@ -247,7 +515,12 @@ private:
     std::vector<TimeBox> m_timeboxes;
     std::vector<FrameRate> m_framerate;
 
+    std::function<void(int frame_index, int stage_tag)> m_stage_listener;
+    std::function<void(int frame_index, const FrameRate& rate)> m_frame_listener;
+
     int m_step_count = 0;
+    int m_checkpoint_interval = 0;
+    std::vector<Checkpoint> m_checkpoints;
 };
 
 struct JobType;
@@ -257,28 +530,59 @@ struct FrameStage;
 class PatternJob : public Job
 {
 public:
-    PatternJob(std::shared_ptr<FrameFlow> flow, int stage_index, Simulator* sim, std::shared_ptr<Frame> f, std::shared_ptr<int> counter = nullptr);
+    PatternJob(std::shared_ptr<FrameFlow> flow, int stage_index, Simulator* sim, std::shared_ptr<Frame> f, std::shared_ptr<DependencyCounter> counter = nullptr);
     
     virtual ImU32 color() const override;
     virtual float duration() const override;
     virtual const char* name() const override;
+    virtual int stage_index() const override;
+    virtual Lane lane() const override;
+    virtual int queue() const override;
     virtual bool is_first() const override;
     virtual bool is_release() const override;
     virtual bool is_ready() const override;
 
     virtual void before_schedule(float time) override;
     virtual bool try_exec(float time) override;
-
+    virtual std::shared_ptr<Job> clone(JobCloneContext& context) const override;
 
 private:
     std::shared_ptr<FrameFlow> m_flow;
     int m_stage_index;
     float m_duration;
 
-    std::shared_ptr<int> m_counter;
+    std::shared_ptr<DependencyCounter> m_counter;
+};
+
+class PresentJob : public Job
+{
+public:
+    PresentJob(Simulator* sim, std::shared_ptr<Frame> f);
+
+    virtual ImU32 color() const override;
+    virtual float duration() const override;
+    virtual const char* name() const override;
+    virtual int stage_index() const override;
+    virtual Lane lane() const override;
+    virtual int queue() const override;
+    virtual bool is_first() const override;
+    virtual bool is_release() const override;
+    virtual bool is_ready() const override;
+
+    virtual void before_schedule(float time) override;
+    virtual bool try_exec(float time) override;
+    virtual std::shared_ptr<Job> clone(JobCloneContext& context) const override;
+
+private:
+    float m_duration = 0.f;
 };
 
 
 void DrawVisualizer();
+// Paints a time box between p0 and p1 with its frame index on the left and its name on the right,
+// shared by the timeline of the simulator and the one of the trace files
+void DrawBox(ImDrawList* drawList, ImVec2 p0, ImVec2 p1, ImU32 color, TimeBoxType type, const char* frameIndex, const char* name, bool critical = false);
 
 const Preset& get_default_preset();
+int get_preset_count();
+const Preset& get_preset(int index);